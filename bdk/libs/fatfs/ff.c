@@ -5194,6 +5194,229 @@ FRESULT f_unlink (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Delete the Contents of an Open Directory                              */
+/*-----------------------------------------------------------------------*/
+/* The tree is walked once with the directory objects, no path is ever   */
+/* resolved again. File entries are marked deleted in place and their    */
+/* cluster chains are freed once the directory sector holding them has   */
+/* been written back.                                                    */
+
+#define RMDIR_PEND_MAX	(FF_MAX_SS / SZDIRE)
+
+static FRESULT rmdir_flush (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs,			/* Filesystem object */
+	FFOBJID* pend,		/* Chains of the files deleted in the current sector */
+	UINT* n_pend		/* Number of pending chains */
+)
+{
+	FRESULT res;
+	UINT i;
+
+
+	res = sync_window(fs);	/* Entries go down before their clusters are freed */
+	for (i = 0; res == FR_OK && i < *n_pend; i++) {
+		res = remove_chain(&pend[i], pend[i].sclust, 0);
+	}
+	*n_pend = 0;
+	return res;
+}
+
+FRESULT f_rmdir_contents (
+	DIR* stack,			/* Directory objects, stack[0] is the open directory to be emptied */
+	UINT depth			/* Number of directory objects (deepest level walked) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DIR *dp, *sdp;
+	FFOBJID pend[RMDIR_PEND_MAX];
+	UINT n_pend = 0, sp = 0;
+	DWORD pend_sect = 0, kept = 0;
+#if FF_USE_LFN
+	DWORD ofs;
+#endif
+	DEF_NAMBUF
+
+
+	res = validate(&stack[0].obj, &fs);	/* Check validity of the directory object */
+	if (res != FR_OK) LEAVE_FF(fs, res);
+	if (depth > 32) depth = 32;			/* Levels holding a kept object are tracked in a bit mask */
+	INIT_NAMBUF(fs);
+
+	for (;;) {
+		dp = &stack[sp];
+		res = DIR_READ_FILE(dp);
+		if (res == FR_NO_FILE) {		/* End of this directory */
+			res = rmdir_flush(fs, pend, &n_pend);
+			if (res != FR_OK || sp == 0) break;
+			sdp = dp;
+			dp = &stack[--sp];		/* The parent still points the entry of the emptied directory */
+			if ((kept & (1UL << (sp + 1))) || (dp->obj.attr & AM_RDO)) {
+				kept |= 1UL << sp;		/* Something was left inside, keep the directory */
+			} else {
+				res = dir_remove(dp);
+				if (res == FR_OK && sdp->obj.sclust != 0) res = remove_chain(&sdp->obj, sdp->obj.sclust, 0);
+			}
+			kept &= ~(1UL << (sp + 1));
+			sdp->obj.fs = 0;
+		} else {
+			if (res != FR_OK) break;
+			if (dp->obj.attr & AM_DIR) {	/* A sub-directory, empty it first */
+				if (sp + 1 >= depth) {
+					kept |= 1UL << sp;		/* Too deep, leave it as is */
+				} else {
+					res = rmdir_flush(fs, pend, &n_pend);
+					if (res == FR_OK) res = move_window(fs, dp->sect);
+					if (res != FR_OK) break;
+					sdp = &stack[sp + 1];
+					sdp->obj.fs = fs;
+#if FF_FS_EXFAT
+					if (fs->fs_type == FS_EXFAT) {
+						sdp->obj.c_scl = dp->obj.sclust;
+						sdp->obj.c_size = ((DWORD)dp->obj.objsize & 0xFFFFFF00) | dp->obj.stat;
+						sdp->obj.c_ofs = dp->blk_ofs;
+						init_alloc_info(fs, &sdp->obj);
+					} else
+#endif
+					{
+						sdp->obj.sclust = ld_clust(fs, dp->dir);
+					}
+					sdp->obj.id = fs->id;
+					res = dir_sdi(sdp, 0);
+					if (res != FR_OK) break;
+					sp++;
+					continue;			/* The parent moves on once the sub-directory is removed */
+				}
+			} else if (dp->obj.attr & AM_RDO) {
+				kept |= 1UL << sp;			/* Cannot remove R/O object */
+			} else {
+				if (n_pend && dp->sect != pend_sect) {	/* Moved to another sector, free what the previous one held */
+					res = rmdir_flush(fs, pend, &n_pend);
+					if (res == FR_OK) res = move_window(fs, dp->sect);
+					if (res != FR_OK) break;
+				}
+				pend[n_pend].fs = fs;
+#if FF_FS_EXFAT
+				if (fs->fs_type == FS_EXFAT) {
+					init_alloc_info(fs, &pend[n_pend]);
+				} else
+#endif
+				{
+					pend[n_pend].sclust = ld_clust(fs, dp->dir);
+				}
+#if FF_USE_LFN
+				if ((FF_FS_EXFAT && fs->fs_type == FS_EXFAT) || (dp->blk_ofs != 0xFFFFFFFF && dp->blk_ofs / SS(fs) != dp->dptr / SS(fs))) {
+					res = dir_remove(dp);	/* The entry block spans sectors, take the long way */
+					if (res != FR_OK) break;
+				} else {
+					for (ofs = (dp->blk_ofs == 0xFFFFFFFF) ? dp->dptr : dp->blk_ofs; ofs <= dp->dptr; ofs += SZDIRE) {
+						fs->win[ofs % SS(fs)] = DDEM;	/* Mark the LFN and SFN entries 'deleted' */
+					}
+					fs->wflag = 1;
+				}
+#else
+				dp->dir[DIR_Name] = DDEM;
+				fs->wflag = 1;
+#endif
+				if (pend[n_pend].sclust != 0) {
+					pend_sect = dp->sect;
+					n_pend++;
+				}
+			}
+		}
+		if (res == FR_OK) res = dir_next(dp, 0);	/* Next entry */
+		if (res == FR_NO_FILE) res = FR_OK;	/* End of table, the next read reports it */
+		if (res != FR_OK) break;
+	}
+
+	if (res == FR_OK) res = sync_fs(fs);
+	if (res == FR_OK && kept) res = FR_DENIED;	/* Report what could not be removed */
+	FREE_NAMBUF();
+	LEAVE_FF(fs, res);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Empty a FAT32 Volume in Place                                         */
+/*-----------------------------------------------------------------------*/
+/* The boot sector is left as it is, so the volume keeps the reserved    */
+/* area, FAT count, FAT size and cluster size it was made with. Only the */
+/* FATs, the root directory cluster, FSINFO and the PrFILE2 safe info    */
+/* are rewritten. Nothing is written when an error other than            */
+/* FR_DISK_ERR is returned.                                              */
+
+FRESULT f_clearfs (
+	const TCHAR* path,	/* Logical drive number */
+	void* work,			/* Pointer to working buffer */
+	UINT len			/* Size of working buffer [byte] */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	BYTE *buf = (BYTE*)work;
+	BYTE pdrv;
+	UINT i, ss, n;
+	DWORD sect, nsect, sz_buf, rclst, rsect, volbase;
+
+
+	res = find_volume(&path, &fs, FA_WRITE);
+	if (res != FR_OK) LEAVE_FF(fs, res);
+	if (fs->fs_type != FS_FAT32) LEAVE_FF(fs, FR_INVALID_PARAMETER);
+	ss = SS(fs);
+	sz_buf = len / ss;
+	rclst = fs->dirbase;
+	if (sz_buf == 0 || rclst * 4 >= ss) LEAVE_FF(fs, FR_NOT_ENOUGH_CORE);	/* The root entry must be in the first FAT sector */
+	rsect = clst2sect(fs, rclst);
+	if (rsect == 0) LEAVE_FF(fs, FR_INVALID_PARAMETER);
+	pdrv = fs->pdrv;
+	volbase = fs->volbase;
+	fs->fs_type = 0;	/* Nothing cached is valid past here, the next access mounts the volume again */
+
+	/* FATs, only the reserved entries and the empty root directory chain are left */
+	for (i = 0; i < fs->n_fats; i++) {
+		mem_set(buf, 0, sz_buf * ss);
+		st_dword(buf + 0, 0x0FFFFFF8);
+		st_dword(buf + 4, 0x0FFFFFFF);
+		st_dword(buf + rclst * 4, 0x0FFFFFFF);
+		sect = fs->fatbase + i * fs->fsize; nsect = fs->fsize;
+		do {
+			n = (nsect > sz_buf) ? sz_buf : nsect;
+			if (disk_write(pdrv, buf, sect, n) != RES_OK) LEAVE_FF(fs, FR_DISK_ERR);
+			mem_set(buf, 0, ss);
+			sect += n; nsect -= n;
+		} while (nsect);
+	}
+
+	/* Root directory */
+	mem_set(buf, 0, sz_buf * ss);
+	sect = rsect; nsect = fs->csize;
+	do {
+		n = (nsect > sz_buf) ? sz_buf : nsect;
+		if (disk_write(pdrv, buf, sect, n) != RES_OK) LEAVE_FF(fs, FR_DISK_ERR);
+		sect += n; nsect -= n;
+	} while (nsect);
+
+	/* PRF2SAFE info (VBR + 3), cleared like f_mkfs with FM_PRF2 so PrFILE2 recreates it */
+	if (disk_write(pdrv, buf, volbase + 3, 1) != RES_OK) LEAVE_FF(fs, FR_DISK_ERR);
+
+	/* FSINFO (VBR + 1), free count and last allocated cluster unknown */
+	if (disk_read(pdrv, buf, volbase + 1, 1) != RES_OK) LEAVE_FF(fs, FR_DISK_ERR);
+	if (ld_dword(buf + FSI_LeadSig) == 0x41615252 && ld_dword(buf + FSI_StrucSig) == 0x61417272) {
+		st_dword(buf + FSI_Free_Count, 0xFFFFFFFF);
+		st_dword(buf + FSI_Nxt_Free, 0xFFFFFFFF);
+		if (disk_write(pdrv, buf, volbase + 1, 1) != RES_OK) LEAVE_FF(fs, FR_DISK_ERR);
+	}
+
+	if (disk_ioctl(pdrv, CTRL_SYNC, 0) != RES_OK) res = FR_DISK_ERR;
+	LEAVE_FF(fs, res);
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Create a Directory                                                    */
 /*-----------------------------------------------------------------------*/
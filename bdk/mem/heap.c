@@ -22,6 +22,7 @@
 #define HEAP_USED_MAGIC 0x50414548 // "HEAP".
 
 heap_t _heap;
+static u32 _arena_peak;
 
 static void _heap_create(void *start)
 {
@@ -215,4 +216,35 @@ void heap_monitor(heap_monitor_t *mon, bool print_node_stats)
 	}
 	mon->total += mon->used;
 	mon->nodes_total = count;
+	mon->arena_peak = _arena_peak;
+}
+
+static void *_heap_top(hnode_t *node)
+{
+	return node ? (void *)node + sizeof(hnode_t) + node->size : _heap.start;
+}
+
+void arena_begin(arena_t *arena)
+{
+	arena->mark = _heap.last;
+}
+
+void *arena_alloc(u32 size)
+{
+	return _heap_alloc(size);
+}
+
+void arena_end(arena_t *arena)
+{
+	// Heap only grows inside an arena, so its final size is also its peak.
+	_arena_peak = _heap_top(_heap.last) - _heap_top(arena->mark);
+
+#ifdef BDK_MALLOC_NO_DEFRAG
+	// Drop every node allocated since arena_begin.
+	_heap.last = arena->mark;
+	if (arena->mark)
+		arena->mark->next = NULL;
+	else
+		_heap.first = NULL;
+#endif
 }
@@ -42,8 +42,14 @@ typedef struct
 	u32 used;
 	u32 nodes_total;
 	u32 nodes_used;
+	u32 arena_peak; // Bytes taken by the last closed arena.
 } heap_monitor_t;
 
+typedef struct _arena_t
+{
+	hnode_t *mark;
+} arena_t;
+
 void heap_init(void *base);
 void heap_set(heap_t *heap);
 void *malloc(u32 size);
@@ -51,5 +57,8 @@ void *calloc(u32 num, u32 size);
 void *zalloc(u32 size);
 void free(void *buf);
 void heap_monitor(heap_monitor_t *mon, bool print_node_stats);
+void arena_begin(arena_t *arena);
+void *arena_alloc(u32 size);
+void arena_end(arena_t *arena);
 
 #endif
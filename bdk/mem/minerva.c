@@ -278,6 +278,14 @@ void minerva_periodic_training()
 	}
 }
 
+minerva_freq_t minerva_get_freq()
+{
+	if (!mtc_call)
+		return 0;
+
+	return mtc_cfg->rate_from;
+}
+
 emc_table_t *minerva_get_mtc_table()
 {
 	if (!mtc_call || no_table)
@@ -79,6 +79,7 @@ void minerva_sdmmc_la_program(void *table, bool t210b01);
 void minerva_prep_boot_hos();
 void minerva_prep_boot_l4t(u32 oc_freq, u32 opt_custom, bool prg_sdmmc_la);
 void minerva_periodic_training();
+minerva_freq_t minerva_get_freq();
 emc_table_t *minerva_get_mtc_table();
 int minerva_get_mtc_table_entries();
 
@@ -103,6 +103,10 @@
 #define NYX_FB2_ADDRESS  0xF6600000
 #define  NYX_FB_SZ         0x384000 // 1280 x 720 x 4.
 
+// SDMMC DMA safe buffer pool. Reusable transfer buffers.
+#define SDMMC_DMA_POOL_ADDR  0xF7000000
+#define  SDMMC_DMA_POOL_SZ       SZ_8M // 16 slots of the biggest transfer buffer (512KB).
+
 // USB buffers.
 #define USBD_ADDR                 0xFEF00000
 #define USB_DESCRIPTOR_ADDR       0xFEF40000
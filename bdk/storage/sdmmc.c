@@ -393,20 +393,77 @@ out:
 	return 0;
 }
 
+sdmmc_bounce_stats_t sdmmc_bounce_stats = {0};
+
+#define SDMMC_DMA_POOL_SLOT_SZ SZ_512K
+#define SDMMC_DMA_POOL_SLOTS   (SDMMC_DMA_POOL_SZ / SDMMC_DMA_POOL_SLOT_SZ)
+
+static u32 _sdmmc_dma_pool_used = 0;
+
+void *sdmmc_dma_alloc(u32 size)
+{
+	// Requests bigger than a slot or with a full pool fall back to the heap.
+	if (size <= SDMMC_DMA_POOL_SLOT_SZ)
+	{
+		for (u32 i = 0; i < SDMMC_DMA_POOL_SLOTS; i++)
+		{
+			if (!(_sdmmc_dma_pool_used & BIT(i)))
+			{
+				_sdmmc_dma_pool_used |= BIT(i);
+				return (void *)(SDMMC_DMA_POOL_ADDR + i * SDMMC_DMA_POOL_SLOT_SZ);
+			}
+		}
+	}
+
+	return malloc(size);
+}
+
+void sdmmc_dma_free(void *buf)
+{
+	u32 addr = (u32)buf;
+
+	if (addr >= SDMMC_DMA_POOL_ADDR && addr < SDMMC_DMA_POOL_ADDR + SDMMC_DMA_POOL_SZ)
+		_sdmmc_dma_pool_used &= ~BIT((addr - SDMMC_DMA_POOL_ADDR) / SDMMC_DMA_POOL_SLOT_SZ);
+	else
+		free(buf);
+}
+
+u32 sdmmc_dma_pool_reset()
+{
+	// Slots still taken were leaked by their last user.
+	u32 leaked = 0;
+	for (u32 i = 0; i < SDMMC_DMA_POOL_SLOTS; i++)
+		if (_sdmmc_dma_pool_used & BIT(i))
+			leaked++;
+
+	_sdmmc_dma_pool_used = 0;
+
+	return leaked;
+}
+
 int sdmmc_storage_read(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf)
 {
 	// Ensure that SDMMC has access to buffer and it's SDMMC DMA aligned.
 	if (mc_client_has_access(buf) && !((u32)buf % SDMMC_ADMA_ADDR_ALIGN))
 		return _sdmmc_storage_readwrite(storage, sector, num_sectors, buf, 0);
 
-	if (num_sectors > (SDMMC_ALT_DMA_BUF_SZ / SDMMC_DAT_BLOCKSIZE))
-		return 1;
-
+	// Bounce through the alt buffer, split if bigger than it.
 	u8 *tmp_buf = (u8 *)SDMMC_ALT_DMA_BUFFER;
-	if (_sdmmc_storage_readwrite(storage, sector, num_sectors, tmp_buf, 0))
-		return 1;
+	u8 *bbuf = (u8 *)buf;
+	while (num_sectors)
+	{
+		u32 blkcnt = MIN(num_sectors, SDMMC_ALT_DMA_BUF_SZ / SDMMC_DAT_BLOCKSIZE);
+		if (_sdmmc_storage_readwrite(storage, sector, blkcnt, tmp_buf, 0))
+			return 1;
+
+		memcpy(bbuf, tmp_buf, SDMMC_DAT_BLOCKSIZE * blkcnt);
 
-	memcpy(buf, tmp_buf, SDMMC_DAT_BLOCKSIZE * num_sectors);
+		sdmmc_bounce_stats.count++;
+		sdmmc_bounce_stats.bytes += SDMMC_DAT_BLOCKSIZE * blkcnt;
+		sector += blkcnt;
+		num_sectors -= blkcnt;
+		bbuf += SDMMC_DAT_BLOCKSIZE * blkcnt;
+	}
 
 	return 0;
 }
@@ -417,13 +474,25 @@ int sdmmc_storage_write(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, v
 	if (mc_client_has_access(buf) && !((u32)buf % SDMMC_ADMA_ADDR_ALIGN))
 		return _sdmmc_storage_readwrite(storage, sector, num_sectors, buf, 1);
 
-	if (num_sectors > (SDMMC_ALT_DMA_BUF_SZ / SDMMC_DAT_BLOCKSIZE))
-		return 1;
-
+	// Bounce through the alt buffer, split if bigger than it.
 	u8 *tmp_buf = (u8 *)SDMMC_ALT_DMA_BUFFER;
-	memcpy(tmp_buf, buf, SDMMC_DAT_BLOCKSIZE * num_sectors);
+	u8 *bbuf = (u8 *)buf;
+	while (num_sectors)
+	{
+		u32 blkcnt = MIN(num_sectors, SDMMC_ALT_DMA_BUF_SZ / SDMMC_DAT_BLOCKSIZE);
+		memcpy(tmp_buf, bbuf, SDMMC_DAT_BLOCKSIZE * blkcnt);
+
+		if (_sdmmc_storage_readwrite(storage, sector, blkcnt, tmp_buf, 1))
+			return 1;
 
-	return _sdmmc_storage_readwrite(storage, sector, num_sectors, tmp_buf, 1);
+		sdmmc_bounce_stats.count++;
+		sdmmc_bounce_stats.bytes += SDMMC_DAT_BLOCKSIZE * blkcnt;
+		sector += blkcnt;
+		num_sectors -= blkcnt;
+		bbuf += SDMMC_DAT_BLOCKSIZE * blkcnt;
+	}
+
+	return 0;
 }
 
 /*
@@ -256,6 +256,18 @@ typedef struct _sdmmc_storage_t
 	sd_ext_reg_t  ser;
 } sdmmc_storage_t;
 
+typedef struct _sdmmc_bounce_stats_t
+{
+	u32 count;
+	u64 bytes;
+} sdmmc_bounce_stats_t;
+
+extern sdmmc_bounce_stats_t sdmmc_bounce_stats;
+
+void *sdmmc_dma_alloc(u32 size);
+void sdmmc_dma_free(void *buf);
+u32  sdmmc_dma_pool_reset();
+
 int  sdmmc_storage_end(sdmmc_storage_t *storage);
 int  sdmmc_storage_read(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf);
 int  sdmmc_storage_write(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf);
@@ -166,6 +166,7 @@ typedef struct _logical_unit_t
 {
 	sdmmc_t *sdmmc;
 	sdmmc_storage_t *storage;
+	usb_ums_backend_t *backend;
 
 	u32 num_sectors;
 	u32 offset;
@@ -440,6 +441,30 @@ static void _reset_buffer(bulk_ctxt_t *bulk_ctxt, u32 ep)
  *  --.- --/-,  23.8 MB/s,  27.2 MB/s, 25.8 MB/s, 17.5 MB/s - SCSI  64KB, Concurrency.
  */
 
+static int _lun_read(logical_unit_t *lun, u32 sector, u32 count, void *buf)
+{
+	if (lun->backend)
+		return lun->backend->read(lun->backend->priv, lun->offset + sector, count, buf);
+
+	return sdmmc_storage_read(lun->storage, lun->offset + sector, count, buf);
+}
+
+static int _lun_write(logical_unit_t *lun, u32 sector, u32 count, void *buf)
+{
+	if (lun->backend)
+		return lun->backend->write(lun->backend->priv, lun->offset + sector, count, buf);
+
+	return sdmmc_storage_write(lun->storage, lun->offset + sector, count, buf);
+}
+
+static int _lun_flush(logical_unit_t *lun)
+{
+	if (lun->backend && lun->backend->flush)
+		return lun->backend->flush(lun->backend->priv);
+
+	return 0;
+}
+
 static int _scsi_read(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 {
 	u32 lba_offset;
@@ -497,7 +522,7 @@ static int _scsi_read(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 		}
 
 		// Do the SDMMC read.
-		if (sdmmc_storage_read(ums->lun.storage, ums->lun.offset + lba_offset, amount, sdmmc_buf))
+		if (_lun_read(&ums->lun, lba_offset, amount, sdmmc_buf))
 			amount = 0;
 
 		// Wait for the async USB transfer to finish.
@@ -652,8 +677,7 @@ static int _scsi_write(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 				goto empty_write;
 
 			// Perform the write.
-			if (sdmmc_storage_write(ums->lun.storage, ums->lun.offset + lba_offset,
-				amount >> UMS_DISK_LBA_SHIFT, (u8 *)bulk_ctxt->bulk_out_buf))
+			if (_lun_write(&ums->lun, lba_offset, amount >> UMS_DISK_LBA_SHIFT, (u8 *)bulk_ctxt->bulk_out_buf))
 				amount = 0;
 
 DPRINTF("file write %X @ %X\n", amount, lba_offset);
@@ -724,7 +748,7 @@ static int _scsi_verify(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 			break;
 		}
 
-		if (sdmmc_storage_read(ums->lun.storage, ums->lun.offset + lba_offset, amount, bulk_ctxt->bulk_in_buf))
+		if (_lun_read(&ums->lun, lba_offset, amount, bulk_ctxt->bulk_in_buf))
 			amount = 0;
 
 DPRINTF("File read %X @ %X\n", amount, lba_offset);
@@ -1331,8 +1355,8 @@ static int _parse_scsi_cmd(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 	case SC_SYNCHRONIZE_CACHE:
 		ums->data_size_from_cmnd = 0;
 		reply = _check_scsi_cmd(ums, 10, DATA_DIR_NONE, (0xf<<2) | (3<<7), 1);
-		if (reply == 0)
-			reply = 0; // Don't bother
+		if (reply == 0 && _lun_flush(&ums->lun))
+			ums->lun.sense_data = SS_WRITE_ERROR;
 		break;
 
 	case SC_TEST_UNIT_READY:
@@ -1849,6 +1873,7 @@ int usb_device_gadget_ums(usb_ctxt_t *usbs)
 	ums.lun.partition   = usbs->partition;
 	ums.lun.num_sectors = usbs->sectors;
 	ums.lun.offset      = usbs->offset;
+	ums.lun.backend     = usbs->backend;
 	ums.lun.removable = 1; // Always removable to force OSes to use prevent media removal.
 	ums.lun.unit_attention_data = SS_RESET_OCCURRED;
 
@@ -1874,6 +1899,12 @@ int usb_device_gadget_ums(usb_ctxt_t *usbs)
 		ums.lun.sdmmc   = &sd_sdmmc;
 		ums.lun.storage = &sd_storage;
 	}
+	else if (usbs->backend)
+	{
+		// Backend owns the eMMC. Sectors must be set by the caller.
+		ums.lun.sdmmc   = &emmc_sdmmc;
+		ums.lun.storage = &emmc_storage;
+	}
 	else
 	{
 		if (emmc_initialize(false))
@@ -1962,7 +1993,9 @@ usb_enum_error:
 	res = 1;
 
 exit:
-	if (ums.lun.type == MMC_EMMC)
+	if (ums.lun.backend)
+		_lun_flush(&ums.lun);
+	else if (ums.lun.type == MMC_EMMC)
 		emmc_end();
 
 init_fail:
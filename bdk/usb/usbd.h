@@ -187,6 +187,14 @@ typedef struct _usb_ops_t
 	bool (*usb_device_get_port_in_sleep)();
 } usb_ops_t;
 
+typedef struct _usb_ums_backend_t
+{
+	int (*read)(void *, u32, u32, void *);
+	int (*write)(void *, u32, u32, void *);
+	int (*flush)(void *);
+	void *priv;
+} usb_ums_backend_t;
+
 typedef struct _usb_ctxt_t
 {
 	u32 type;
@@ -196,6 +204,7 @@ typedef struct _usb_ctxt_t
 	u32 offset;
 	u32 sectors;
 	u32 ro;
+	usb_ums_backend_t *backend; // Raw sdmmc storage is used when NULL.
 
 	// HID.
 	u32 idle;
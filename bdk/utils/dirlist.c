@@ -21,61 +21,100 @@
 #include <libs/fatfs/ff.h>
 #include <mem/heap.h>
 #include <utils/types.h>
+#include <utils/util.h>
 
-dirlist_t *dirlist(const char *directory, const char *pattern, u32 flags)
+static bool _dirlist_filter(const FILINFO *fno, bool show_hidden, bool show_dirs)
+{
+	bool curr_parse = show_dirs ? (fno->fattrib & AM_DIR) : !(fno->fattrib & AM_DIR);
+
+	return curr_parse && (fno->fname[0] != '.') && (show_hidden || !(fno->fattrib & AM_HID));
+}
+
+u32 dirlist_visit(const char *directory, const char *pattern, u32 flags, dirlist_visit_t visit, void *priv)
 {
-	int res = 0;
 	u32 k = 0;
 	DIR dir;
 	FILINFO fno;
 	bool show_hidden = !!(flags & DIR_SHOW_HIDDEN);
-	bool show_dirs   = !!(flags & DIR_SHOW_DIRS);
-	bool ascii_order = !!(flags & DIR_ASCII_ORDER);
+	bool show_dirs   = !!(flags & DIR_SHOW_DIRS) && !pattern;
 
-	dirlist_t *dir_entries = (dirlist_t *)malloc(sizeof(dirlist_t));
+	// Pattern search loads the first match on open.
+	if (pattern ? f_findfirst(&dir, &fno, directory, pattern) : f_opendir(&dir, directory))
+		return 0;
 
-	// Setup pointer tree.
-	for (u32 i = 0; i < DIR_MAX_ENTRIES; i++)
-		dir_entries->name[i] = &dir_entries->data[i * 256];
-
-	if (!pattern && !f_opendir(&dir, directory))
+	for (;;)
 	{
-		for (;;)
+		if (!pattern && f_readdir(&dir, &fno))
+			break;
+
+		if (!fno.fname[0])
+			break;
+
+		if (_dirlist_filter(&fno, show_hidden, show_dirs))
 		{
-			res = f_readdir(&dir, &fno);
-			if (res || !fno.fname[0])
+			k++;
+			if (!visit(fno.fname, fno.fattrib, priv))
 				break;
-
-			bool curr_parse = show_dirs ? (fno.fattrib & AM_DIR) : !(fno.fattrib & AM_DIR);
-
-			if (curr_parse)
-			{
-				if ((fno.fname[0] != '.') && (show_hidden || !(fno.fattrib & AM_HID)))
-				{
-					strcpy(&dir_entries->data[k * 256], fno.fname);
-					if (++k >= DIR_MAX_ENTRIES)
-						break;
-				}
-			}
 		}
-		f_closedir(&dir);
-	}
-	else if (pattern && !f_findfirst(&dir, &fno, directory, pattern) && fno.fname[0])
-	{
-		do
-		{
-			if (!(fno.fattrib & AM_DIR) && (fno.fname[0] != '.') && (show_hidden || !(fno.fattrib & AM_HID)))
-			{
-				strcpy(&dir_entries->data[k * 256], fno.fname);
-				if (++k >= DIR_MAX_ENTRIES)
-					break;
-			}
-			res = f_findnext(&dir, &fno);
-		} while (fno.fname[0] && !res);
-		f_closedir(&dir);
+
+		if (pattern && f_findnext(&dir, &fno))
+			break;
 	}
+	f_closedir(&dir);
+
+	return k;
+}
+
+typedef struct _dirlist_ctx_t
+{
+	dirlist_t *list;
+	char *data;
+	u32 count;
+	u32 size;
+} dirlist_ctx_t;
+
+static bool _dirlist_count(const char *name, u32 attr, void *priv)
+{
+	dirlist_ctx_t *ctx = (dirlist_ctx_t *)priv;
+
+	ctx->size += strlen(name) + 1;
 
-	if (!k)
+	return ++ctx->count < DIR_MAX_ENTRIES;
+}
+
+static bool _dirlist_store(const char *name, u32 attr, void *priv)
+{
+	dirlist_ctx_t *ctx = (dirlist_ctx_t *)priv;
+	u32 len = strlen(name) + 1;
+
+	// Directory changed between passes.
+	if (ctx->list->count >= ctx->count || len > ctx->size)
+		return false;
+
+	ctx->list->name[ctx->list->count++] = ctx->data;
+	memcpy(ctx->data, name, len);
+	ctx->data += len;
+	ctx->size -= len;
+
+	return true;
+}
+
+dirlist_t *dirlist(const char *directory, const char *pattern, u32 flags)
+{
+	dirlist_ctx_t ctx = {0};
+
+	// Size the list first, so only the actual names are allocated.
+	dirlist_visit(directory, pattern, flags, _dirlist_count, &ctx);
+	if (!ctx.count)
+		return NULL;
+
+	dirlist_t *dir_entries = (dirlist_t *)malloc(sizeof(dirlist_t) + (ctx.count + 1) * sizeof(char *) + ctx.size);
+	dir_entries->count = 0;
+	ctx.list = dir_entries;
+	ctx.data = (char *)&dir_entries->name[ctx.count + 1];
+
+	dirlist_visit(directory, pattern, flags, _dirlist_store, &ctx);
+	if (!dir_entries->count)
 	{
 		free(dir_entries);
 
@@ -83,24 +122,11 @@ dirlist_t *dirlist(const char *directory, const char *pattern, u32 flags)
 	}
 
 	// Terminate name list.
-	dir_entries->name[k] = NULL;
-
-	// Choose list ordering.
-	int (*strcmpex)(const char* str1, const char* str2) = ascii_order ? strcmp : strcasecmp;
+	dir_entries->name[dir_entries->count] = NULL;
 
-	// Reorder ini files Alphabetically.
-	for (u32 i = 0; i < k - 1 ; i++)
-	{
-		for (u32 j = i + 1; j < k; j++)
-		{
-			if (strcmpex(dir_entries->name[i], dir_entries->name[j]) > 0)
-			{
-				char *tmp = dir_entries->name[i];
-				dir_entries->name[i] = dir_entries->name[j];
-				dir_entries->name[j] = tmp;
-			}
-		}
-	}
+	// Reorder files Alphabetically.
+	qsort(dir_entries->name, dir_entries->count, sizeof(char *),
+		(flags & DIR_ASCII_ORDER) ? qsort_compare_char : qsort_compare_char_case);
 
 	return dir_entries;
 }
@@ -27,10 +27,14 @@
 
 typedef struct _dirlist_t
 {
-	char *name[DIR_MAX_ENTRIES];
-	char  data[DIR_MAX_ENTRIES * 256];
+	u32   count;
+	char *name[]; // NULL terminated. Names are packed right after it.
 } dirlist_t;
 
+// Return false from the visitor to stop the scan.
+typedef bool (*dirlist_visit_t)(const char *name, u32 attr, void *priv);
+
+u32 dirlist_visit(const char *directory, const char *pattern, u32 flags, dirlist_visit_t visit, void *priv);
 dirlist_t *dirlist(const char *directory, const char *pattern, u32 flags);
 
 #endif
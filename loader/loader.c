@@ -21,7 +21,11 @@
 #include "payload_01.h"
 
 #include <memory_map.h>
+#ifdef LDR_COMPR_LZ4
+#include <libs/compr/lz4.h>
+#else
 #include <libs/compr/lz.h>
+#endif
 #include <soc/bpmp.h>
 #include <soc/clock.h>
 #include <soc/t210.h>
@@ -31,6 +35,18 @@
 #define IPL_PATCHED_RELOC_SZ 0x94
 #define IPL_VERSION_RCFG_OFF 0x120
 
+#ifdef LDR_COMPR_LZ4
+// LZ4 block decode. Output is bounded by the relocated payload.
+static u32 _payload_uncompress(const u8 *src, u8 *dst, u32 size)
+{
+	int res = LZ4_decompress_safe((const char *)src, (char *)dst, size, IPL_RELOC_TOP - (u32)dst);
+
+	return res > 0 ? res : 0;
+}
+#else
+#define _payload_uncompress(src, dst, size) LZ_Uncompress(src, dst, size)
+#endif
+
 boot_cfg_t __attribute__((section ("._boot_cfg"))) b_cfg;
 const volatile ipl_ver_meta_t __attribute__((section ("._ipl_version"))) ipl_ver = {
 	.magic = LS_MAGIC,
@@ -77,12 +93,12 @@ void loader_main()
 	// Set source address of the first part.
 	u8 *src_addr = (void *)(IPL_RELOC_TOP - payload_size);
 	// Uncompress first part.
-	u32 dst_pos = LZ_Uncompress((const u8 *)src_addr, (u8 *)IPL_LOAD_ADDR, sizeof(payload_00));
+	u32 dst_pos = _payload_uncompress((const u8 *)src_addr, (u8 *)IPL_LOAD_ADDR, sizeof(payload_00));
 
 	// Set source address of the second part. Includes compiler alignment.
 	src_addr += (u32)payload_01 - (u32)payload_00;
 	// Uncompress second part.
-	LZ_Uncompress((const u8 *)src_addr, (u8 *)IPL_LOAD_ADDR + dst_pos, sizeof(payload_01));
+	_payload_uncompress((const u8 *)src_addr, (u8 *)IPL_LOAD_ADDR + dst_pos, sizeof(payload_01));
 
 	// Copy over boot configuration storage.
 	memcpy((u8 *)(IPL_LOAD_ADDR + IPL_PATCHED_RELOC_SZ), &b_cfg, sizeof(boot_cfg_t));
@@ -0,0 +1,60 @@
+#include <string.h>
+#include "bench.h"
+#include <utils/sprintf.h>
+
+void bench_run(const bench_env_t *env, const bench_test_t *test, bench_result_t *res) {
+	memset(res, 0, sizeof(*res));
+
+	u32 slots = test->span / test->chunk;
+	u32 seed = 0x2545F491; // Same offsets on every run.
+	u32 offset = 0;
+	u32 bounces = env->bounces ? env->bounces() : 0;
+	u32 start = env->now_us();
+
+	while (true) {
+		u32 pos;
+		if (test->random) {
+			if (!slots)
+				break;
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			pos = (seed % slots) * test->chunk;
+		} else {
+			if (test->span && offset + test->chunk > test->span)
+				break;
+			pos = offset;
+			offset += test->chunk;
+		}
+
+		res->err = test->io(test->ctx, pos, test->chunk, env->buf);
+		res->elapsed_us = env->now_us() - start;
+		if (res->err)
+			break;
+
+		res->calls++;
+		res->bytes += (u64)test->chunk * test->unit;
+		if (res->elapsed_us >= env->budget_us)
+			break;
+	}
+
+	if (env->bounces)
+		res->bounces = env->bounces() - bounces;
+}
+
+u32 bench_kb_per_s(const bench_result_t *res) {
+	return res->elapsed_us ? (u32)((res->bytes >> 10) * 1000000 / res->elapsed_us) : 0;
+}
+
+u32 bench_ops_per_s(const bench_result_t *res) {
+	return res->elapsed_us ? (u32)((u64)res->calls * 1000000 / res->elapsed_us) : 0;
+}
+
+u32 bench_csv_header(char *out) {
+	return s_printf(out, "test,chunk_bytes,calls,kb,us,kb_per_s,ops_per_s,bounces,error\n");
+}
+
+u32 bench_csv_line(char *out, const bench_test_t *test, const bench_result_t *res) {
+	return s_printf(out, "%s,%d,%d,%d,%d,%d,%d,%d,%d\n", test->name, test->chunk * test->unit, res->calls,
+		(u32)(res->bytes >> 10), res->elapsed_us, bench_kb_per_s(res), bench_ops_per_s(res), res->bounces, res->err);
+}
@@ -0,0 +1,44 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <utils/types.h>
+
+// Storage and crypto timing core. Only needs types and s_printf, so it also builds on the host
+// against file-backed storage and a software SE.
+
+// One access of count units at offset. 0 on success, like the storage drivers.
+typedef int (*bench_io_t)(void *ctx, u32 offset, u32 count, void *buf);
+
+typedef struct _bench_test_t {
+	const char *name;
+	bench_io_t io;
+	void *ctx;
+	u32 unit;    // Bytes per unit, 512 for sectors.
+	u32 chunk;   // Units per access.
+	u32 span;    // Units the test may touch. 0 for no limit, sequential only.
+	bool random; // Chunk-aligned random offsets instead of a sequential pass.
+} bench_test_t;
+
+typedef struct _bench_env_t {
+	u32 (*now_us)();
+	u32 (*bounces)(); // Optional DMA bounce counter.
+	u32 budget_us;    // A test stops after this long or at the end of its span.
+	void *buf;        // At least chunk * unit bytes for every test.
+} bench_env_t;
+
+typedef struct _bench_result_t {
+	u32 calls;
+	u64 bytes;
+	u32 elapsed_us;
+	u32 bounces;
+	int err;
+} bench_result_t;
+
+void bench_run(const bench_env_t *env, const bench_test_t *test, bench_result_t *res);
+u32  bench_kb_per_s(const bench_result_t *res);
+u32  bench_ops_per_s(const bench_result_t *res);
+// CSV text, returns the length written.
+u32  bench_csv_header(char *out);
+u32  bench_csv_line(char *out, const bench_test_t *test, const bench_result_t *res);
+
+#endif
@@ -0,0 +1,182 @@
+#include <string.h>
+#include "benchmark.h"
+#include "bench.h"
+#include <libs/fatfs/ff.h>
+#include <mem/heap.h>
+#include <sec/se.h>
+#include <sec/se_t210.h>
+#include <soc/timer.h>
+#include <storage/emmc.h>
+#include <storage/sd.h>
+#include <storage/sdmmc.h>
+#include <utils/list.h>
+#include <utils/sprintf.h>
+
+#include "../keys/crypto.h"
+#include "../perf/perf_mode.h"
+#include "../storage/nx_emmc_bis.h"
+#include "../tools.h"
+#include "../gfx/messages.h"
+
+#define BENCH_TIME_US     2000000
+#define BENCH_SEQ_SECTORS 1024 // 512 KB per access.
+#define BENCH_RND_SECTORS 8    // 4 KB per access.
+#define BENCH_SD_SECTORS  (SZ_64M / EMMC_BLOCKSIZE)
+#define BENCH_BUF_SIZE    (BENCH_SEQ_SECTORS * EMMC_BLOCKSIZE)
+#define BENCH_CSV_SIZE    SZ_4K
+#define BENCH_SD_PATH     "sd:/LockSmith-RCM/benchmark.tmp"
+
+static u32 _bench_bounces() {
+	return sdmmc_bounce_stats.count;
+}
+
+static int _bench_emmc_read(void *ctx, u32 offset, u32 count, void *buf) {
+	return sdmmc_storage_read(&emmc_storage, offset, count, buf);
+}
+
+static int _bench_bis_read(void *ctx, u32 offset, u32 count, void *buf) {
+	return nx_emmc_bis_read(offset, count, buf);
+}
+
+static int _bench_sd_io(FIL *fp, bool write, u32 offset, u32 count, void *buf) {
+	UINT bw;
+	u32 size = count * EMMC_BLOCKSIZE;
+	if (f_tell(fp) != (FSIZE_t)offset * EMMC_BLOCKSIZE && f_lseek(fp, (FSIZE_t)offset * EMMC_BLOCKSIZE))
+		return 1;
+	if (write ? f_write(fp, buf, size, &bw) : f_read(fp, buf, size, &bw))
+		return 1;
+	return bw != size;
+}
+
+static int _bench_sd_write(void *ctx, u32 offset, u32 count, void *buf) {
+	return _bench_sd_io((FIL *)ctx, true, offset, count, buf);
+}
+
+static int _bench_sd_read(void *ctx, u32 offset, u32 count, void *buf) {
+	return _bench_sd_io((FIL *)ctx, false, offset, count, buf);
+}
+
+static int _bench_aes_xts(void *ctx, u32 offset, u32 count, void *buf) {
+	return se_aes_crypt_xts(KS_AES_CMAC, KS_AES_ECB, ENCRYPT, offset, buf, buf, EMMC_BLOCKSIZE, count);
+}
+
+static int _bench_sha256(void *ctx, u32 offset, u32 count, void *buf) {
+	u8 hash[SE_SHA_256_SIZE] __attribute__((aligned(4)));
+	return se_sha_hash_256_oneshot(hash, buf, count * EMMC_BLOCKSIZE);
+}
+
+static int _bench_rsa(void *ctx, u32 offset, u32 count, void *buf) {
+	for (u32 i = 0; i < count; i++) {
+		if (se_rsa_exp_mod(0, buf, SE_RSA2048_DIGEST_SIZE, buf, SE_RSA2048_DIGEST_SIZE))
+			return 1;
+	}
+	return 0;
+}
+
+static void _bench_one(const bench_env_t *env, const bench_test_t *test, bench_result_t *res, char *csv, u32 *csv_len) {
+	bench_run(env, test, res);
+	if (res->err)
+		log_printf(true, LOG_ERR, LOG_MSG_BENCHMARK_ERROR, test->name, res->err);
+	else
+		log_printf(true, LOG_INFO, LOG_MSG_BENCHMARK_RESULT, test->name, bench_kb_per_s(res), bench_ops_per_s(res));
+	if (*csv_len + 128 < BENCH_CSV_SIZE)
+		*csv_len += bench_csv_line(csv + *csv_len, test, res);
+}
+
+void benchmark() {
+	cls();
+	char csv_path[128];
+	s_printf(csv_path, "sd:/LockSmith-RCM/benchmark_%s.csv", menu_on_sysnand ? "sysnand" : "emunand");
+	log_printf(true, LOG_INFO, LOG_MSG_BENCHMARK_BEGIN, csv_path);
+
+	u8 *buf = sdmmc_dma_alloc(BENCH_BUF_SIZE);
+	char *csv = malloc(BENCH_CSV_SIZE);
+	if (!buf || !csv) {
+		log_printf(true, LOG_ERR, LOG_MSG_MALLOC_ERROR);
+		goto out;
+	}
+
+	perf_mode_enter("benchmark");
+
+	bench_env_t env = { get_tmr_us, _bench_bounces, BENCH_TIME_US, buf };
+	bench_result_t res;
+	u32 csv_len = bench_csv_header(csv);
+
+	// Raw eMMC and decrypted SYSTEM reads.
+	LIST_INIT(gpt);
+	if (mount_nand_part(&gpt, "SYSTEM", true, true, false, false, NULL, NULL, NULL, NULL)) {
+		u32 bis_sectors = nx_emmc_bis_sectors_ex(0);
+		emmc_set_partition(EMMC_GPP);
+		const bench_test_t nand_tests[] = {
+			{ "emmc_seq_read", _bench_emmc_read, NULL, EMMC_BLOCKSIZE, BENCH_SEQ_SECTORS, emmc_storage.sec_cnt, false },
+			{ "emmc_rnd_read", _bench_emmc_read, NULL, EMMC_BLOCKSIZE, BENCH_RND_SECTORS, emmc_storage.sec_cnt, true  },
+			{ "bis_seq_read",  _bench_bis_read,  NULL, EMMC_BLOCKSIZE, BENCH_SEQ_SECTORS, bis_sectors,          false },
+			{ "bis_rnd_read",  _bench_bis_read,  NULL, EMMC_BLOCKSIZE, BENCH_RND_SECTORS, bis_sectors,          true  },
+		};
+		for (u32 i = 0; i < ARRAY_SIZE(nand_tests); i++)
+			_bench_one(&env, &nand_tests[i], &res, csv, &csv_len);
+		unmount_nand_part(&gpt, false, true, true, false);
+	}
+
+	// SD through FatFs. The read pass covers what the write pass managed to write.
+	FIL fp;
+	sd_mount();
+	if (!f_open(&fp, BENCH_SD_PATH, FA_CREATE_ALWAYS | FA_READ | FA_WRITE)) {
+		bench_test_t sd_test = { "sd_seq_write", _bench_sd_write, &fp, EMMC_BLOCKSIZE, BENCH_SEQ_SECTORS, BENCH_SD_SECTORS, false };
+		_bench_one(&env, &sd_test, &res, csv, &csv_len);
+		f_sync(&fp);
+
+		if (res.calls) {
+			sd_test.name = "sd_seq_read";
+			sd_test.io = _bench_sd_read;
+			sd_test.span = res.bytes / EMMC_BLOCKSIZE;
+			_bench_one(&env, &sd_test, &res, csv, &csv_len);
+
+			sd_test.name = "sd_rnd_read";
+			sd_test.chunk = BENCH_RND_SECTORS;
+			sd_test.random = true;
+			_bench_one(&env, &sd_test, &res, csv, &csv_len);
+		}
+
+		f_close(&fp);
+		f_unlink(BENCH_SD_PATH);
+	} else {
+		log_printf(true, LOG_ERR, LOG_MSG_BENCHMARK_ERROR, "sd_seq_write", 1);
+	}
+
+	// SE, with throwaway keys in the scratch keyslots.
+	u8 key[SE_RSA2048_DIGEST_SIZE] __attribute__((aligned(4)));
+	u8 mod[SE_RSA2048_DIGEST_SIZE] __attribute__((aligned(4)));
+	se_rng_pseudo(key, sizeof(key));
+	se_rng_pseudo(mod, sizeof(mod));
+	mod[0] |= 0x80;
+	se_aes_key_set(KS_AES_ECB, key, SE_KEY_128_SIZE);
+	se_aes_key_set(KS_AES_CMAC, key + SE_KEY_128_SIZE, SE_KEY_128_SIZE);
+	se_rsa_key_set(0, mod, sizeof(mod), key, sizeof(key));
+	se_rng_pseudo(buf, SE_RSA2048_DIGEST_SIZE);
+	buf[0] = 0; // Below the modulus.
+
+	const bench_test_t se_tests[] = {
+		{ "se_rsa2048",  _bench_rsa,     NULL, SE_RSA2048_DIGEST_SIZE, 1,                 0, false },
+		{ "se_aes_xts",  _bench_aes_xts, NULL, EMMC_BLOCKSIZE,         BENCH_SEQ_SECTORS, 0, false },
+		{ "se_sha256",   _bench_sha256,  NULL, EMMC_BLOCKSIZE,         BENCH_SEQ_SECTORS, 0, false },
+	};
+	for (u32 i = 0; i < ARRAY_SIZE(se_tests); i++)
+		_bench_one(&env, &se_tests[i], &res, csv, &csv_len);
+
+	se_rsa_key_clear(0);
+	se_aes_key_clear(KS_AES_ECB);
+	se_aes_key_clear(KS_AES_CMAC);
+
+	perf_mode_exit();
+
+	if (sd_save_to_file(csv, csv_len, csv_path))
+		log_printf(true, LOG_ERR, LOG_MSG_BENCHMARK_ERROR, csv_path, 1);
+	else
+		log_printf(true, LOG_OK, LOG_MSG_BENCHMARK_END);
+
+out:
+	free(csv);
+	sdmmc_dma_free(buf);
+	save_screenshot_and_go_back("benchmark");
+}
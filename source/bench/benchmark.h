@@ -0,0 +1,7 @@
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+// Times raw eMMC, BIS, SD and SE throughput on this console and writes a CSV to SD.
+void benchmark();
+
+#endif
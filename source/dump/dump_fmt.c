@@ -0,0 +1,521 @@
+#include <string.h>
+#include "dump_fmt.h"
+#include <mem/heap.h>
+#include <utils/sprintf.h>
+#include "../gfx/messages.h"
+#include "../tools.h"
+#ifdef LS_LZ4_DUMPS
+#include <libs/compr/lz4.h>
+#endif
+
+static const char _sha_hex_chars[16] = "0123456789abcdef";
+
+void sha_hex(char *dst, const u8 *hash) {
+	for (u32 i = 0; i < SE_SHA_256_SIZE; i++) {
+		*dst++ = _sha_hex_chars[hash[i] >> 4];
+		*dst++ = _sha_hex_chars[hash[i] & 0xF];
+	}
+	*dst = '\0';
+}
+
+// Queues the next block of a stream on the SE. The engine hashes it while the caller does SD I/O on the same buffer.
+int sha_stream_start(sha_stream_t *s, const void *buf, u32 size) {
+	bool first = !s->done;
+	s->done += size;
+	if (first && s->done == s->total)
+		return se_sha_hash_256_async(s->hash, buf, size);
+	if (first)
+		return se_sha_hash_256_partial_start(s->hash, buf, size, false);
+	if (s->done == s->total)
+		return se_sha_hash_256_partial_end(s->hash, s->total, buf, size, false);
+	return se_sha_hash_256_partial_update(s->hash, buf, size, false);
+}
+
+// Before the last block, the result is the running chaining value. The SE keeps it across the BIS AES calls.
+int sha_stream_wait(sha_stream_t *s) {
+	return se_sha_hash_256_finalize(s->hash);
+}
+
+// Chunk entries sit on SHA_MANIFEST_CHUNK boundaries. The end of the stream is the whole-file line instead.
+static bool _sha_stream_at_mark(const sha_stream_t *s) {
+	return s->done != s->total && !(s->done & (SHA_MANIFEST_CHUNK - 1));
+}
+
+static u32 _sha_stream_chunk(const sha_stream_t *s) {
+	return (u32)((s->done + SHA_MANIFEST_CHUNK - 1) / SHA_MANIFEST_CHUNK);
+}
+
+bool dump_put(FIL *fp, const void *buf, u32 size) {
+	UINT bw;
+	return !f_write(fp, buf, size, &bw) && bw == size;
+}
+
+void lz4c_free(lz4c_t *lz) {
+	free(lz->sizes);
+	free(lz->cbuf);
+	free(lz->state);
+}
+
+#ifdef LS_LZ4_DUMPS
+
+bool lz4c_create(lz4c_t *lz, FIL *fp, u64 raw_size) {
+	lz->fp = fp;
+	lz->hdr = (lz4c_hdr_t){ LZ4C_MAGIC, LZ4C_VERSION, 0, LZ4C_BLOCK_SIZE, DIV_ROUND_UP(raw_size, LZ4C_BLOCK_SIZE), raw_size };
+	lz->sizes = zalloc(lz->hdr.blocks * sizeof(u32));
+	lz->cbuf = malloc(COPY_BUF_SIZE);
+	lz->state = malloc(LZ4_sizeofState());
+
+	// The size table is rewritten once every block is known.
+	return dump_put(fp, &lz->hdr, sizeof(lz->hdr)) && dump_put(fp, lz->sizes, lz->hdr.blocks * sizeof(u32));
+}
+
+// Incompressible blocks are stored as is, so a chunk never grows past COPY_BUF_SIZE.
+bool lz4c_write(lz4c_t *lz, const u8 *buf, u32 size) {
+	u32 out = 0;
+	for (u32 pos = 0; pos < size; pos += LZ4C_BLOCK_SIZE) {
+		u32 len = MIN(size - pos, LZ4C_BLOCK_SIZE);
+		if (lz->block >= lz->hdr.blocks)
+			return false;
+
+		int csize = LZ4_compress_fast_extState(lz->state, (const char *)buf + pos, (char *)lz->cbuf + out, len, len - 1, 1);
+		if (csize > 0) {
+			lz->sizes[lz->block++] = csize;
+			out += csize;
+		} else {
+			memcpy(lz->cbuf + out, buf + pos, len);
+			lz->sizes[lz->block++] = len | LZ4C_RAW;
+			out += len;
+		}
+	}
+	return dump_put(lz->fp, lz->cbuf, out);
+}
+
+bool lz4c_finish(lz4c_t *lz) {
+	return lz->block == lz->hdr.blocks && !f_lseek(lz->fp, sizeof(lz->hdr)) && dump_put(lz->fp, lz->sizes, lz->hdr.blocks * sizeof(u32));
+}
+
+bool lz4c_open(lz4c_t *lz, FIL *fp) {
+	UINT br;
+	lz->fp = fp;
+	if (f_read(fp, &lz->hdr, sizeof(lz->hdr), &br) || br != sizeof(lz->hdr) || lz->hdr.magic != LZ4C_MAGIC ||
+		lz->hdr.version != LZ4C_VERSION || lz->hdr.block_size != LZ4C_BLOCK_SIZE || lz->hdr.blocks != DIV_ROUND_UP(lz->hdr.raw_size, LZ4C_BLOCK_SIZE))
+		return false;
+
+	u64 data = sizeof(lz->hdr) + (u64)lz->hdr.blocks * sizeof(u32);
+	if (data > f_size(fp))
+		return false;
+
+	lz->sizes = malloc(lz->hdr.blocks * sizeof(u32));
+	lz->cbuf = malloc(COPY_BUF_SIZE);
+	if (f_read(fp, lz->sizes, lz->hdr.blocks * sizeof(u32), &br) || br != lz->hdr.blocks * sizeof(u32))
+		return false;
+
+	// A truncated or padded file is refused here, not halfway through a flash.
+	for (u32 i = 0; i < lz->hdr.blocks; i++) {
+		if ((lz->sizes[i] & ~LZ4C_RAW) > LZ4C_BLOCK_SIZE)
+			return false;
+		data += lz->sizes[i] & ~LZ4C_RAW;
+	}
+	return data == f_size(fp);
+}
+
+void lz4c_rewind(lz4c_t *lz) {
+	lz->block = 0;
+	f_lseek(lz->fp, sizeof(lz->hdr) + lz->hdr.blocks * sizeof(u32));
+}
+
+// Reads the blocks covering the next size bytes in one go and expands them into buf.
+bool lz4c_read(lz4c_t *lz, u8 *buf, u32 size) {
+	u32 first = lz->block, in = 0;
+	UINT br;
+
+	for (u32 pos = 0; pos < size; pos += LZ4C_BLOCK_SIZE) {
+		if (lz->block >= lz->hdr.blocks || (lz->sizes[lz->block] & ~LZ4C_RAW) > LZ4C_BLOCK_SIZE)
+			return false;
+		in += lz->sizes[lz->block++] & ~LZ4C_RAW;
+	}
+	if (f_read(lz->fp, lz->cbuf, in, &br) || br != in)
+		return false;
+
+	in = 0;
+	for (u32 pos = 0, i = first; pos < size; pos += LZ4C_BLOCK_SIZE, i++) {
+		u32 len = MIN(size - pos, LZ4C_BLOCK_SIZE);
+		u32 csize = lz->sizes[i] & ~LZ4C_RAW;
+		if (lz->sizes[i] & LZ4C_RAW) {
+			if (csize != len)
+				return false;
+			memcpy(buf + pos, lz->cbuf + in, len);
+		} else if (LZ4_decompress_safe((const char *)lz->cbuf + in, (char *)buf + pos, csize, len) != (int)len) {
+			return false;
+		}
+		in += csize;
+	}
+	return true;
+}
+#endif
+
+bool dump_get(FIL *fp, lz4c_t *lz, u8 *buf, u32 size) {
+#ifdef LS_LZ4_DUMPS
+	if (lz)
+		return lz4c_read(lz, buf, size);
+#endif
+	UINT br;
+	return !f_read(fp, buf, size, &br) && br == size;
+}
+
+static bool _sha_manifest_put(FIL *mf, const char *line) {
+	return dump_put(mf, line, strlen(line));
+}
+
+bool sha_manifest_mark(FIL *mf, const sha_stream_t *s) {
+	if (!_sha_stream_at_mark(s))
+		return true;
+
+	char line[SHA_HEX_LEN + 16];
+	s_printf(line, "# %d ", _sha_stream_chunk(s));
+	char *p = line + strlen(line);
+	sha_hex(p, s->hash);
+	memcpy(p + SHA_HEX_LEN, "\n", 2);
+	return _sha_manifest_put(mf, line);
+}
+
+// sha256sum compatible line for the whole image.
+bool sha_manifest_head(FIL *mf, const u8 *hash, const char *path) {
+	char line[SHA_HEX_LEN + 256];
+	const char *name = strrchr(path, '/');
+	sha_hex(line, hash);
+	s_printf(line + SHA_HEX_LEN, "  %s\n", name ? name + 1 : path);
+	return _sha_manifest_put(mf, line);
+}
+
+// Hashes a restore image against its manifest before anything is written. Images without a manifest pass.
+bool sha_manifest_verify(FIL *fp, const char *path, u8 *buff, lz4c_t *lz) {
+	char mpath[256], line[128], whole[SHA_HEX_LEN], hex[SHA_HEX_LEN + 1];
+	FIL mf;
+
+	s_printf(mpath, "%s%s", path, SHA_MANIFEST_EXT);
+	if (f_open(&mf, mpath, FA_READ))
+		return true;
+
+	sha_stream_t sha = { .total = lz ? lz->hdr.raw_size : f_size(fp) };
+	bool ok = f_gets(line, sizeof(line), &mf) && strlen(line) > SHA_HEX_LEN;
+	memcpy(whole, line, SHA_HEX_LEN);
+
+	while (ok && sha.done < sha.total) {
+		ui_spinner_draw();
+		u32 size = MIN(sha.total - sha.done, COPY_BUF_SIZE);
+		if (!dump_get(fp, lz, buff, size)) {
+			log_printf(true, LOG_ERR, LOG_MSG_ERR_FILE_READ);
+			f_close(&mf);
+			return false;
+		}
+		if (sha_stream_start(&sha, buff, size) || sha_stream_wait(&sha)) {
+			ok = false;
+			break;
+		}
+		if (_sha_stream_at_mark(&sha)) {
+			sha_hex(hex, sha.hash);
+			char *p = f_gets(line, sizeof(line), &mf) ? strrchr(line, ' ') : NULL;
+			ok = p && !memcmp(p + 1, hex, SHA_HEX_LEN);
+		}
+	}
+	f_close(&mf);
+
+	if (ok) {
+		sha_hex(hex, sha.hash);
+		ok = !memcmp(whole, hex, SHA_HEX_LEN);
+	}
+	if (!ok) {
+		log_printf(true, LOG_ERR, LOG_MSG_FLASH_PARTITION_HASH_MISMATCH, _sha_stream_chunk(&sha));
+		return false;
+	}
+
+	log_printf(true, LOG_INFO, LOG_MSG_FLASH_PARTITION_HASH_OK);
+#ifdef LS_LZ4_DUMPS
+	if (lz) {
+		lz4c_rewind(lz);
+		return true;
+	}
+#endif
+	f_lseek(fp, 0);
+	return true;
+}
+
+#define SPARSE_CHUNK_CLUSTERS  (COPY_BUF_SIZE / SPARSE_CLUSTER_SIZE)
+
+enum {
+	SPARSE_SKIP = 0,
+	SPARSE_DATA,
+	SPARSE_ZERO
+};
+
+static bool _sparse_is_zero(const u8 *buf) {
+	const u32 *p = (const u32 *)buf;
+	for (u32 i = 0; i < SPARSE_CLUSTER_SIZE / sizeof(u32); i++) {
+		if (p[i])
+			return false;
+	}
+	return true;
+}
+
+// Length of the folder part of path, trailing slash included.
+static u32 _sparse_dir_len(const char *path) {
+	const char *name = strrchr(path, '/');
+	return name ? name - path + 1 : 0;
+}
+
+// Stores the non-zero clusters, or only the ones whose hash changed from base_path. The .clh file always gets every cluster hash.
+bool sparse_dump(FIL *fp, FIL *hf, const char *path, const char *base_path, u32 lba, u32 clusters, bool bis, u8 *buff) {
+	sparse_hdr_t hdr = { .magic = SPARSE_MAGIC, .version = SPARSE_VERSION, .cluster_size = SPARSE_CLUSTER_SIZE, .clusters = clusters };
+	u8 zero_hash[SE_SHA_256_SIZE];
+	bool diff = base_path != NULL;
+	bool ok = false;
+	u32 stored = 0;
+	UINT br;
+	FIL bf;
+
+	// COPY_BUF_SIZE is only known at runtime, so the per-chunk hashes live on the heap.
+	u8 (*hashes)[SE_SHA_256_SIZE] = malloc(SPARSE_CHUNK_CLUSTERS * SE_SHA_256_SIZE * (diff ? 2 : 1));
+	u8 (*base_hashes)[SE_SHA_256_SIZE] = hashes + SPARSE_CHUNK_CLUSTERS;
+
+	if (diff) {
+		// A base in the same folder is stored by name, so the backup folder can be moved as a whole.
+		u32 dir = _sparse_dir_len(path);
+		const char *base = dir && !strncmp(base_path, path, dir) ? base_path + dir : base_path;
+		char bpath[256];
+		s_printf(bpath, "%s%s", base_path, SPARSE_HASH_EXT);
+		if (strlen(base) >= sizeof(hdr.base) || f_open(&bf, bpath, FA_READ)) {
+			log_printf(true, LOG_ERR, LOG_MSG_DUMP_BAD_FILE, base_path);
+			free(hashes);
+			return false;
+		}
+		if (f_size(&bf) != (u64)clusters * SE_SHA_256_SIZE) {
+			log_printf(true, LOG_ERR, LOG_MSG_DUMP_BAD_FILE, base_path);
+			goto out;
+		}
+		hdr.flags = SPARSE_FLAG_DIFF;
+		strcpy(hdr.base, base);
+	}
+
+	memset(buff, 0, SPARSE_CLUSTER_SIZE);
+	se_sha_hash_256_oneshot(zero_hash, buff, SPARSE_CLUSTER_SIZE);
+	if (!dump_put(fp, &hdr, sizeof(hdr))) {
+		log_printf(true, LOG_ERR, LOG_MSG_DUMP_PARTITION_ERR_PARTITION_WRITE);
+		goto out;
+	}
+
+	for (u32 cur = 0; cur < clusters;) {
+		ui_spinner_draw();
+		u32 num = MIN(clusters - cur, SPARSE_CHUNK_CLUSTERS);
+		if (part_io(false, bis, lba + cur * SPARSE_CLUSTER_SECTORS, num * SPARSE_CLUSTER_SECTORS, buff) ||
+			(diff && (f_read(&bf, base_hashes, num * SE_SHA_256_SIZE, &br) || br != num * SE_SHA_256_SIZE))) {
+			log_printf(true, LOG_ERR, LOG_MSG_ERR_FILE_READ);
+			goto out;
+		}
+
+		// Runs end at the chunk edge, so an extent's data is always contiguous in buff.
+		u32 run_start = 0, run_len = 0, run_kind = SPARSE_SKIP;
+		for (u32 i = 0; i <= num; i++) {
+			u32 kind = SPARSE_SKIP;
+			if (i < num) {
+				u8 *p = buff + i * SPARSE_CLUSTER_SIZE;
+				bool zero = _sparse_is_zero(p);
+				if (zero)
+					memcpy(hashes[i], zero_hash, SE_SHA_256_SIZE);
+				else
+					se_sha_hash_256_oneshot(hashes[i], p, SPARSE_CLUSTER_SIZE);
+
+				if (diff && !memcmp(hashes[i], base_hashes[i], SE_SHA_256_SIZE))
+					kind = SPARSE_SKIP;
+				else if (zero)
+					kind = diff ? SPARSE_ZERO : SPARSE_SKIP;
+				else
+					kind = SPARSE_DATA;
+			}
+
+			if (run_len && kind != run_kind) {
+				sparse_ext_t ext = { cur + run_start, run_len | (run_kind == SPARSE_ZERO ? SPARSE_EXT_ZERO : 0) };
+				if (!dump_put(fp, &ext, sizeof(ext)) ||
+					(run_kind == SPARSE_DATA && !dump_put(fp, buff + run_start * SPARSE_CLUSTER_SIZE, run_len * SPARSE_CLUSTER_SIZE))) {
+					log_printf(true, LOG_ERR, LOG_MSG_DUMP_PARTITION_ERR_PARTITION_WRITE);
+					goto out;
+				}
+				stored += run_len;
+				run_len = 0;
+			}
+			if (kind != SPARSE_SKIP) {
+				if (!run_len) {
+					run_start = i;
+					run_kind = kind;
+				}
+				run_len++;
+			}
+		}
+
+		if (!dump_put(hf, hashes, num * SE_SHA_256_SIZE)) {
+			log_printf(true, LOG_ERR, LOG_MSG_DUMP_PARTITION_ERR_PARTITION_WRITE);
+			goto out;
+		}
+		cur += num;
+	}
+
+	sparse_ext_t end = { 0, 0 };
+	if (!dump_put(fp, &end, sizeof(end))) {
+		log_printf(true, LOG_ERR, LOG_MSG_DUMP_PARTITION_ERR_PARTITION_WRITE);
+		goto out;
+	}
+	log_printf(true, LOG_INFO, LOG_MSG_SPARSE_DUMP_DONE, stored, clusters);
+	ok = true;
+
+out:
+	if (diff)
+		f_close(&bf);
+	free(hashes);
+	return ok;
+}
+
+static bool _sparse_fill_zero(u32 lba, u32 cluster, u32 count, bool bis, u8 *buff) {
+	memset(buff, 0, COPY_BUF_SIZE);
+	while (count) {
+		ui_spinner_draw();
+		u32 num = MIN(count, SPARSE_CHUNK_CLUSTERS);
+		if (part_io(true, bis, lba + cluster * SPARSE_CLUSTER_SECTORS, num * SPARSE_CLUSTER_SECTORS, buff)) {
+			log_printf(true, LOG_ERR, LOG_MSG_FLASH_PARTITION_ERR_PARTITION_WRITE);
+			return false;
+		}
+		cluster += num;
+		count -= num;
+	}
+	return true;
+}
+
+// One pass over the extents. Without write it only checks the layout and, when a .clh file exists, every stored cluster hash.
+static bool _sparse_walk(FIL *fp, const char *path, const sparse_hdr_t *hdr, u32 lba, bool bis, u8 *buff, bool write) {
+	bool diff = hdr->flags & SPARSE_FLAG_DIFF;
+	bool ok = false;
+	u32 next = 0;
+	UINT br;
+	FIL hf;
+	char hpath[256];
+
+	s_printf(hpath, "%s%s", path, SPARSE_HASH_EXT);
+	bool check = !write && !f_open(&hf, hpath, FA_READ);
+	u8 (*hashes)[SE_SHA_256_SIZE] = check ? malloc(SPARSE_CHUNK_CLUSTERS * SE_SHA_256_SIZE) : NULL;
+	if (check && f_size(&hf) != (u64)hdr->clusters * SE_SHA_256_SIZE) {
+		log_printf(true, LOG_ERR, LOG_MSG_DUMP_BAD_FILE, hpath);
+		goto out;
+	}
+
+	f_lseek(fp, sizeof(*hdr));
+	while (true) {
+		sparse_ext_t ext;
+		if (f_read(fp, &ext, sizeof(ext), &br) || br != sizeof(ext)) {
+			log_printf(true, LOG_ERR, LOG_MSG_DUMP_BAD_FILE, path);
+			goto out;
+		}
+		u32 count = ext.count & ~SPARSE_EXT_ZERO;
+		if (!count)
+			ext.cluster = hdr->clusters;
+		if (ext.cluster < next || ext.cluster > hdr->clusters || count > hdr->clusters - ext.cluster) {
+			log_printf(true, LOG_ERR, LOG_MSG_DUMP_BAD_FILE, path);
+			goto out;
+		}
+
+		if (write && !diff && !_sparse_fill_zero(lba, next, ext.cluster - next, bis, buff))
+			goto out;
+		if (!count)
+			break;
+
+		if (ext.count & SPARSE_EXT_ZERO) {
+			if (write && !_sparse_fill_zero(lba, ext.cluster, count, bis, buff))
+				goto out;
+		} else if (!write && !check) {
+			if (f_lseek(fp, f_tell(fp) + (u64)count * SPARSE_CLUSTER_SIZE)) {
+				log_printf(true, LOG_ERR, LOG_MSG_ERR_FILE_READ);
+				goto out;
+			}
+		} else {
+			for (u32 done = 0; done < count;) {
+				ui_spinner_draw();
+				u32 num = MIN(count - done, SPARSE_CHUNK_CLUSTERS);
+				u32 cluster = ext.cluster + done;
+				if (f_read(fp, buff, num * SPARSE_CLUSTER_SIZE, &br) || br != num * SPARSE_CLUSTER_SIZE) {
+					log_printf(true, LOG_ERR, LOG_MSG_ERR_FILE_READ);
+					goto out;
+				}
+
+				if (write) {
+					if (part_io(true, bis, lba + cluster * SPARSE_CLUSTER_SECTORS, num * SPARSE_CLUSTER_SECTORS, buff)) {
+						log_printf(true, LOG_ERR, LOG_MSG_FLASH_PARTITION_ERR_PARTITION_WRITE);
+						goto out;
+					}
+				} else {
+					u8 hash[SE_SHA_256_SIZE];
+					if (f_lseek(&hf, (u64)cluster * SE_SHA_256_SIZE) || f_read(&hf, hashes, num * SE_SHA_256_SIZE, &br) || br != num * SE_SHA_256_SIZE) {
+						log_printf(true, LOG_ERR, LOG_MSG_ERR_FILE_READ);
+						goto out;
+					}
+					for (u32 i = 0; i < num; i++) {
+						se_sha_hash_256_oneshot(hash, buff + i * SPARSE_CLUSTER_SIZE, SPARSE_CLUSTER_SIZE);
+						if (memcmp(hash, hashes[i], SE_SHA_256_SIZE)) {
+							log_printf(true, LOG_ERR, LOG_MSG_FLASH_PARTITION_HASH_MISMATCH, cluster + i);
+							goto out;
+						}
+					}
+				}
+				done += num;
+			}
+		}
+		next = ext.cluster + count;
+	}
+
+	if (check)
+		log_printf(true, LOG_INFO, LOG_MSG_FLASH_PARTITION_HASH_OK);
+	ok = true;
+
+out:
+	if (check)
+		f_close(&hf);
+	free(hashes);
+	return ok;
+}
+
+// Everything in a diff chain is checked before the first sector is written, then the base is laid down and the diff on top.
+static bool _sparse_restore(FIL *fp, const char *path, u32 lba, u32 clusters, bool bis, u8 *buff, u32 depth) {
+	sparse_hdr_t hdr;
+	UINT br;
+
+	if (depth >= SPARSE_MAX_CHAIN || f_read(fp, &hdr, sizeof(hdr), &br) || br != sizeof(hdr) || hdr.magic != SPARSE_MAGIC ||
+		hdr.version != SPARSE_VERSION || hdr.cluster_size != SPARSE_CLUSTER_SIZE || hdr.clusters != clusters) {
+		log_printf(true, LOG_ERR, LOG_MSG_DUMP_BAD_FILE, path);
+		return false;
+	}
+	if (!_sparse_walk(fp, path, &hdr, lba, bis, buff, false))
+		return false;
+
+	if (hdr.flags & SPARSE_FLAG_DIFF) {
+		// Same lookup as sparse_dump stored it: by name next to this dump, or as is when it names a drive.
+		FIL bf;
+		hdr.base[sizeof(hdr.base) - 1] = '\0';
+		u32 dir = strchr(hdr.base, ':') ? 0 : _sparse_dir_len(path);
+		char *bpath = malloc(dir + sizeof(hdr.base));
+		memcpy(bpath, path, dir);
+		strcpy(bpath + dir, hdr.base);
+		if (f_open(&bf, bpath, FA_READ)) {
+			log_printf(true, LOG_ERR, LOG_MSG_ERR_OPEN_FILE, bpath);
+			free(bpath);
+			return false;
+		}
+		bool ok = _sparse_restore(&bf, bpath, lba, clusters, bis, buff, depth + 1);
+		f_close(&bf);
+		free(bpath);
+		if (!ok)
+			return false;
+	}
+
+	return _sparse_walk(fp, path, &hdr, lba, bis, buff, true);
+}
+
+bool sparse_restore(FIL *fp, const char *path, u32 lba, u32 clusters, bool bis, u8 *buff) {
+	return _sparse_restore(fp, path, lba, clusters, bis, buff, 0);
+}
@@ -0,0 +1,96 @@
+#ifndef _DUMP_FMT_H_
+#define _DUMP_FMT_H_
+
+#include <libs/fatfs/ff.h>
+#include <sec/se.h>
+#include <storage/emmc.h>
+#include <utils/types.h>
+
+// A dump gets a sha256sum compatible first line for the whole image and a "# n <hash>" line per chunk.
+// Chunk lines hold the running SHA-256 state at each SHA_MANIFEST_CHUNK boundary.
+#define SHA_MANIFEST_EXT   ".sha256"
+#define SHA_MANIFEST_CHUNK SZ_4M
+#define SHA_HEX_LEN        (SE_SHA_256_SIZE * 2)
+
+typedef struct _sha_stream_t {
+	u64 total;
+	u64 done;
+	u8 hash[SE_SHA_256_SIZE];
+} sha_stream_t;
+
+// Only built with LZ4_DUMPS=1. Without it the magic is still known so restores can refuse the file.
+#define LZ4C_MAGIC      0x345A534C // "LSZ4".
+#define LZ4C_VERSION    1
+#define LZ4C_BLOCK_SIZE SZ_64K
+#define LZ4C_RAW        BIT(31)
+
+typedef struct _lz4c_hdr_t {
+	u32 magic;
+	u16 version;
+	u16 reserved;
+	u32 block_size;
+	u32 blocks;
+	u64 raw_size;
+} lz4c_hdr_t;
+
+// Blocks are compressed independently and their sizes follow the header, so any block is one seek away.
+typedef struct _lz4c_t {
+	FIL *fp;
+	lz4c_hdr_t hdr;
+	u32 *sizes;
+	u32 block;
+	u8 *cbuf;
+	void *state;
+} lz4c_t;
+
+#define SPARSE_MAGIC           0x5053534C // "LSSP".
+#define SPARSE_VERSION         1
+#define SPARSE_FLAG_DIFF       BIT(0)
+#define SPARSE_EXT_ZERO        BIT(31)
+#define SPARSE_HASH_EXT        ".clh"
+#define SPARSE_MAX_CHAIN       8
+#define SPARSE_CLUSTER_SECTORS 32 // Same granularity as the BIS cluster cache.
+#define SPARSE_CLUSTER_SIZE    (SPARSE_CLUSTER_SECTORS * EMMC_BLOCKSIZE)
+
+typedef struct _sparse_hdr_t {
+	u32 magic;
+	u16 version;
+	u16 flags;
+	u32 cluster_size;
+	u32 clusters;
+	char base[128]; // Dump a diff applies on top of, relative to the diff's folder unless it names a drive.
+} sparse_hdr_t;
+
+// Extents are ascending. Gaps are zero in a full dump and left to the base in a diff.
+typedef struct _sparse_ext_t {
+	u32 cluster;
+	u32 count; // With SPARSE_EXT_ZERO no data follows. A count of 0 ends the file.
+} sparse_ext_t;
+
+bool dump_put(FIL *fp, const void *buf, u32 size);
+
+void sha_hex(char *dst, const u8 *hash);
+int  sha_stream_start(sha_stream_t *s, const void *buf, u32 size);
+int  sha_stream_wait(sha_stream_t *s);
+bool sha_manifest_head(FIL *mf, const u8 *hash, const char *path);
+// Adds the chunk line when the stream just crossed a chunk boundary.
+bool sha_manifest_mark(FIL *mf, const sha_stream_t *s);
+bool sha_manifest_verify(FIL *fp, const char *path, u8 *buff, lz4c_t *lz);
+// Next size bytes of a restore image, expanded when lz is set.
+bool dump_get(FIL *fp, lz4c_t *lz, u8 *buf, u32 size);
+
+// The .clh file next to a sparse dump holds every cluster hash. A diff only needs that file from its base.
+bool sparse_dump(FIL *fp, FIL *hf, const char *path, const char *base_path, u32 lba, u32 clusters, bool bis, u8 *buff);
+bool sparse_restore(FIL *fp, const char *path, u32 lba, u32 clusters, bool bis, u8 *buff);
+
+void lz4c_free(lz4c_t *lz);
+#ifdef LS_LZ4_DUMPS
+bool lz4c_create(lz4c_t *lz, FIL *fp, u64 raw_size);
+bool lz4c_write(lz4c_t *lz, const u8 *buf, u32 size);
+bool lz4c_finish(lz4c_t *lz);
+bool lz4c_open(lz4c_t *lz, FIL *fp);
+void lz4c_rewind(lz4c_t *lz);
+bool lz4c_read(lz4c_t *lz, u8 *buf, u32 size);
+#endif
+
+#endif
@@ -474,7 +474,7 @@ void fuse_check() {
 			while (btn_read() == (BTN_VOL_UP | BTN_VOL_DOWN))
 				msleep(10);
 
-			if (!save_fb_to_bmp("fuse_check"))
+			if (!save_fb_to_qoi("fuse_check"))
 			{
 				SETCOLOR(COLOR_GREEN, COLOR_DEFAULT);
 				print_centered(620, "Screenshot saved!");
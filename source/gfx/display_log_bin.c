@@ -134,6 +134,7 @@ void show_log_viewer() {
 			top++;
 		} else if (k == BTN_POWER) {
 			log_export_txt("sd:/LockSmith-RCM/log.txt");
+			log_export_bin("sd:/LockSmith-RCM/log.bin");
 			break;
 		}
 	}
@@ -43,11 +43,13 @@ static void gfx_con_scroll(u32 lines_px)
 
 	memmove(fb, fb + lines_px * stride, move_rows * stride * sizeof(u32));
 
+	// Fill one row, then block copy it over the rest of the cleared area.
 	const u32 fill_col = gfx_con.bgcol;
 	u32 *dst = fb + move_rows * stride;
-	const u32 count = lines_px * stride;
-	for (u32 i = 0; i < count; i++)
+	for (u32 i = 0; i < stride; i++)
 		dst[i] = fill_col;
+	for (u32 i = 1; i < lines_px; i++)
+		memcpy(dst + i * stride, dst, stride * sizeof(u32));
 }
 
 static const u8 _gfx_font[] = {
@@ -207,112 +209,93 @@ void gfx_con_setpos(u32 x, u32 y)
 	gfx_con.y = y;
 }
 
-void gfx_putc(char c)
+// Draw one font row (bit 0 is the leftmost pixel), each bit `scale` pixels wide.
+static inline void _gfx_put_glyph_row(u32 *fb, u32 v, u32 scale)
 {
-	// Duplicate code for performance reasons.
-	switch (gfx_con.fntsz)
+	if (gfx_con.fillbg)
 	{
-	case 16:
-		if (c >= 32 && c <= 126)
+		// Full span, no per-pixel branching.
+		const u32 col[2] = { gfx_con.bgcol, gfx_con.fgcol };
+		u32 *end = fb + 8 * scale;
+		if (scale == 2)
 		{
-			u8 *cbuf = (u8 *)&_gfx_font[8 * (c - 32)];
-			u32 *fb = gfx_ctxt.fb + gfx_con.x + gfx_con.y * gfx_ctxt.stride;
-
-			for (u32 i = 0; i < 16; i+=2)
-			{
-				u8 v = *cbuf;
-				for (u32 k = 0; k < 2; k++)
-				{
-					for (u32 j = 0; j < 8; j++)
-					{
-						if (v & 1)
-						{
-							*fb = gfx_con.fgcol;
-							fb++;
-							*fb = gfx_con.fgcol;
-						}
-						else if (gfx_con.fillbg)
-						{
-							*fb = gfx_con.bgcol;
-							fb++;
-							*fb = gfx_con.bgcol;
-						}
-						else
-							fb++;
-						v >>= 1;
-						fb++;
-					}
-					fb += gfx_ctxt.stride - 16;
-					v = *cbuf;
-				}
-				cbuf++;
-			}
-			gfx_con.x += 16;
-			if (gfx_con.x > gfx_ctxt.width - 16)
-			{
-				gfx_con.x = 0;
-				gfx_con.y += 16;
-				if (gfx_con.y > gfx_ctxt.height - 16)
-				{
-					if (gfx_con.scroll_enabled) gfx_con_scroll(16);
-					gfx_con.y = gfx_ctxt.height - 16;
-				}
-			}
+			for (; fb < end; fb += 2, v >>= 1)
+				fb[0] = fb[1] = col[v & 1];
 		}
-		else if (c == '\n')
+		else
 		{
-			gfx_con.x = 0;
-			gfx_con.y += 16;
-			if (gfx_con.y > gfx_ctxt.height - 16)
+			for (; fb < end; fb++, v >>= 1)
+				*fb = col[v & 1];
+		}
+	}
+	else
+	{
+		// Transparent background. Stop once no set bits are left.
+		for (; v; fb += scale, v >>= 1)
+		{
+			if (v & 1)
 			{
-				if (gfx_con.scroll_enabled) gfx_con_scroll(16);
-				gfx_con.y = gfx_ctxt.height - 16;
+				fb[0] = gfx_con.fgcol;
+				if (scale == 2)
+					fb[1] = gfx_con.fgcol;
 			}
 		}
-		break;
-	case 8:
-	default:
-		if (c >= 32 && c <= 126)
+	}
+}
+
+void gfx_putc(char c)
+{
+	const u32 fntsz = gfx_con.fntsz == 16 ? 16 : 8;
+
+	if (c >= 32 && c <= 126)
+	{
+		const u8 *cbuf = &_gfx_font[8 * (c - 32)];
+		const u32 stride = gfx_ctxt.stride;
+		u32 *fb = gfx_ctxt.fb + gfx_con.x + gfx_con.y * stride;
+
+		if (fntsz == 16)
 		{
-			u8 *cbuf = (u8 *)&_gfx_font[8 * (c - 32)];
-			u32 *fb = gfx_ctxt.fb + gfx_con.x + gfx_con.y * gfx_ctxt.stride;
+			// Each font row is drawn twice, the copy is a single block move when filled.
 			for (u32 i = 0; i < 8; i++)
 			{
-				u8 v = *cbuf++;
-				for (u32 j = 0; j < 8; j++)
-				{
-					if (v & 1)
-						*fb = gfx_con.fgcol;
-					else if (gfx_con.fillbg)
-						*fb = gfx_con.bgcol;
-					v >>= 1;
-					fb++;
-				}
-				fb += gfx_ctxt.stride - 8;
+				_gfx_put_glyph_row(fb, cbuf[i], 2);
+				if (gfx_con.fillbg)
+					memcpy(fb + stride, fb, 16 * sizeof(u32));
+				else
+					_gfx_put_glyph_row(fb + stride, cbuf[i], 2);
+				fb += stride * 2;
 			}
-			gfx_con.x += 8;
-			if (gfx_con.x > gfx_ctxt.width - 8)
+		}
+		else
+		{
+			for (u32 i = 0; i < 8; i++)
 			{
-				gfx_con.x = 0;
-				gfx_con.y += 8;
-				if (gfx_con.y > gfx_ctxt.height - 8)
-				{
-					if (gfx_con.scroll_enabled) gfx_con_scroll(8);
-					gfx_con.y = gfx_ctxt.height - 8;
-				}
+				_gfx_put_glyph_row(fb, cbuf[i], 1);
+				fb += stride;
 			}
 		}
-		else if (c == '\n')
+
+		gfx_con.x += fntsz;
+		if (gfx_con.x > gfx_ctxt.width - fntsz)
 		{
 			gfx_con.x = 0;
-			gfx_con.y += 8;
-			if (gfx_con.y > gfx_ctxt.height - 8)
+			gfx_con.y += fntsz;
+			if (gfx_con.y > gfx_ctxt.height - fntsz)
 			{
-				if (gfx_con.scroll_enabled) gfx_con_scroll(8);
-				gfx_con.y = gfx_ctxt.height - 8;
+				if (gfx_con.scroll_enabled) gfx_con_scroll(fntsz);
+				gfx_con.y = gfx_ctxt.height - fntsz;
 			}
 		}
-		break;
+	}
+	else if (c == '\n')
+	{
+		gfx_con.x = 0;
+		gfx_con.y += fntsz;
+		if (gfx_con.y > gfx_ctxt.height - fntsz)
+		{
+			if (gfx_con.scroll_enabled) gfx_con_scroll(fntsz);
+			gfx_con.y = gfx_ctxt.height - fntsz;
+		}
 	}
 }
 
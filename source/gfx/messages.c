@@ -5,6 +5,7 @@
 #include "../gfx/gfx.h"
 #include <libs/fatfs/ff.h>
 #include <mem/heap.h>
+#include <soc/timer.h>
 #include <utils/sprintf.h>
 #include <utils/types.h>
 
@@ -14,10 +15,32 @@
 // The header is added to the include path by the top-level Makefile.
 #include "messages_packed.h"
 
+#ifdef LOGMSG_POOL_COMPRESSED
+#include <libs/compr/lz.h>
+
+// Unpacked on first lookup and kept for the payload lifetime.
+static u8 *g_logmsg_pool;
+#endif
+
+bool log_msg_init() {
+#ifdef LOGMSG_POOL_COMPRESSED
+    if (!g_logmsg_pool) {
+        g_logmsg_pool = malloc(g_logmsg_pool_size);
+        if (!g_logmsg_pool)
+            return false;
+        LZ_Uncompress(g_logmsg_pool_lz, g_logmsg_pool, sizeof(g_logmsg_pool_lz));
+    }
+#endif
+    return true;
+}
+
  const char *log_msg_get(log_msg_id_t id) {
     if ((unsigned)id >= (unsigned)LOG_MSG_COUNT)
         return "";
 
+    if (!log_msg_init())
+        return "";
+
     // logmsg_off_t is generated by tools/pack_assets (uint16_t or uint32_t).
     size_t off = (size_t)g_logmsg_offsets[(unsigned)id];
     if (off >= (size_t)g_logmsg_pool_size)
@@ -76,6 +99,8 @@ const char * const g_log_messages[LOG_MSG_COUNT] = {
 	[LOG_MSG_ERROR_PRODINFO_SHA_VERIF]   = "SHA256 verification error at 0x%x",
 	[LOG_MSG_ERROR_PRODINFO_SHA_COMPARE]   = "SHA256 compare error at 0x%x",
 	[LOG_MSG_ERR_MOUNT_PARTITION]   = "Unable to mount %s partition.",
+	[LOG_MSG_ERR_FORMAT_PARTITION]   = "Unable to clear %s partition in place (error %d), deleting files instead.",
+	[LOG_MSG_ERR_CLEAR_PARTITION]   = "Error: clearing %s partition failed (error %d), its file system is damaged. Restore a backup.",
 	[LOG_MSG_DELETE_SAVE_SYSTEM]   = "Deleting save file %s from SYSTEM...",
 	[LOG_MSG_DELETE_SAVE_USER]   = "Deleting save file %s from USER...",
 	[LOG_MSG_ERR_OPEN_FILE]   = "Cannot open file '%s'",
@@ -92,15 +117,29 @@ const char * const g_log_messages[LOG_MSG_COUNT] = {
 	[LOG_MSG_FLASH_PARTITION_FILE_NOT_ALLIGNED]   = "Error: file size not sector aligned.",
 	[LOG_MSG_FLASH_PARTITION_ERR_PARTITION_WRITE]   = "Error when flashing partition.",
 	[LOG_MSG_FLASH_PARTITION_SUCCESS]   = "Flash of partition done.",
+	[LOG_MSG_FLASH_PARTITION_DIFF_DONE]   = "%d KB written, %d KB already up to date.",
 	[LOG_MSG_DUMP_PARTITION_BEGIN]   = "Dumping '%s' to '%s'",
 	[LOG_MSG_DUMP_PARTITION_NOT_ALLIGNED]   = "Error: partition size not aligned.",
 	[LOG_MSG_DUMP_PARTITION_ERR_PARTITION_WRITE]   = "Error when dumping partition.",
 	[LOG_MSG_DUMP_PARTITION_SUCCESS]   = "Dump of partition done.",
+	[LOG_MSG_DUMP_PARTITION_SPEED]   = "%d MB dumped in %d s, %d MB/s with %s.",
+	[LOG_MSG_FLASH_PARTITION_HASH_OK]   = "File matches its SHA-256 manifest.",
+	[LOG_MSG_FLASH_PARTITION_HASH_MISMATCH]   = "Error: file does not match its SHA-256 manifest (chunk %d).",
+	[LOG_MSG_DUMP_BAD_FILE]   = "Error: '%s' is not a valid dump file.",
+	[LOG_MSG_SPARSE_DUMP_DONE]   = "%d of %d clusters stored.",
+	[LOG_MSG_LZ4_DUMP_DONE]   = "%d MB compressed to %d MB.",
+	[LOG_MSG_LZ4_NOT_BUILT]   = "Error: '%s' is an LZ4 dump, this build was made without LZ4_DUMPS=1.",
+	[LOG_MSG_PRODINFO_RAW_ONLY]   = "Error: PRODINFO is only dumped and restored raw, '%s' is a sparse or LZ4 dump.",
+	[LOG_MSG_USB_UMS_BEGIN]   = "Exporting '%s' over USB. Eject it on the host or press VOL+ and VOL- to stop.",
+	[LOG_MSG_USB_UMS_ERROR]   = "Error: USB export failed.",
 	[LOG_MSG_FOLDER_COPY_BEGIN]   = "Copying '%s' to '%s'...",
 	[LOG_MSG_FOLDER_DELETE_BEGIN]   = "Removing '%s'...",
 	[LOG_MSG_FOLDER_COPY_ERROR]   = "Copy failed: %s (%d)",
 	[LOG_MSG_FOLDER_DELETE_END]   = "Folder removed",
 	[LOG_MSG_FOLDER_COPY_END]   = "Folder copied",
+	[LOG_MSG_FILE_TRANSFERT_FROM_NANDS]   = "Copying '%s' from %s to %s on %s partition...",
+	[LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR]   = "Copy between nands failed (error %d).",
+	[LOG_MSG_FILE_TRANSFERT_FROM_NANDS_SUCCESS]   = "File transfer done",
 	[LOG_MSG_BATCH_BEGIN]   = "Batch Begin",
 	[LOG_MSG_NEXT_BATCH_ON_SYSNAND]   = "Next function will be on sysnand",
 	[LOG_MSG_NEXT_BATCH_ON_EMUNAND]   = "Next function will be on emunand",
@@ -171,6 +210,7 @@ const char * const g_log_messages[LOG_MSG_COUNT] = {
 	[LOG_MSG_KEYS_DUMP_ERR_SSL_KEY_DERIVATION]   = "Unable to derive SSL key.",
 	[LOG_MSG_KEYS_DUMP_ERR_ETICKET_KEY_DERIVATION]   = "Unable to derive ETicket key.",
 	[LOG_MSG_KEYS_DUMP_ERR_GET_SD_SEED]   = "Unable to get SD seed.",
+	[LOG_MSG_KEYS_DUMP_SD_SEED_SCAN]   = "SD seed scan done in %d us.",
 	[LOG_MSG_KEYS_DUMP_ERR_TITLEKEYS_DERIVATION]   = "Unable to derive titlekeys.",
 	[LOG_MSG_KEYS_DUMP_KEYS_FOUNDED]   = "Found %d %s keys.",
 	[LOG_MSG_KEYS_DUMP_KEYS_FOUNDED_VIA]   = "Found through master_key_%02x.",
@@ -204,6 +244,10 @@ const char * const g_log_messages[LOG_MSG_COUNT] = {
 	[LOG_MSG_INCOGNITO_VERIF_SUCCESS]   = "Verification successful! Serial:%s",
 	[LOG_MSG_INCOGNITO_ERR]   = "Incognito error!",
 	[LOG_MSG_INCOGNITO_SUCCESS]   = "Incognito done!",
+	[LOG_MSG_BENCHMARK_BEGIN]   = "Benchmark begin, results go to %s.",
+	[LOG_MSG_BENCHMARK_RESULT]   = "%s: %d KB/s, %d ops/s.",
+	[LOG_MSG_BENCHMARK_ERROR]   = "%s failed (error %d).",
+	[LOG_MSG_BENCHMARK_END]   = "Benchmark done.",
 	[LOG_MSG_BATCH_END]     = "Batch end"
 };
 #endif
@@ -273,6 +317,7 @@ void log_printf(bool record_message, log_level_t lvl, log_msg_id_t id, ...) {
 		e->level = lvl;
 		e->msg_id = id;
 		e->argc = 0;
+		e->time_ms = get_tmr_ms();
 	}
 
 	u32 color = log_color_from_level(lvl);
@@ -342,6 +387,9 @@ void log_printf(bool record_message, log_level_t lvl, log_msg_id_t id, ...) {
 		argc > 3 ? args[3] : 0
 	);
 	debug_log_write("\n");
+	// Error paths may never reach the next action boundary.
+	if (lvl == LOG_ERR)
+		debug_log_flush();
 }
 
 u32 log_arg_value(log_entry_t *e, int i) {
@@ -358,6 +406,8 @@ u32 log_arg_value(log_entry_t *e, int i) {
 	return e->argv[i];
 }
 
+#define LOG_EXPORT_BUF_SIZE SZ_32K
+
 void log_export_txt(const char *path) {
 	if (g_log_count == 0 || g_log_count > LOG_MAX_ENTRIES) {
 		return;
@@ -367,12 +417,30 @@ void log_export_txt(const char *path) {
 	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE))
 		return;
 
+	char *buf = (char *)malloc(LOG_EXPORT_BUF_SIZE);
+	if (!buf) {
+		f_close(&fp);
+		return;
+	}
+
+	// Format lines into the staging buffer and only write it out when full.
+	u32 pos = 0;
 	for (u32 i = 0; i < g_log_count; i++) {
 		log_entry_t *e = &g_log_buf[i];
 		const char *fmt = log_msg_get((log_msg_id_t)e->msg_id);
 
-		char line[256];
-		char *p = line;
+		// Upper bound of the formatted line, numbers are at most 10 chars.
+		u32 need = strlen(fmt) + 8 + LOG_MAX_ARGS * 10;
+		for (u32 j = 0; j < e->argc; j++) {
+			if (e->arg_type[j] == LOG_ARG_STR)
+				need += strlen((const char *)log_arg_value(e, j));
+		}
+		if (pos + need > LOG_EXPORT_BUF_SIZE) {
+			f_write(&fp, buf, pos, NULL);
+			pos = 0;
+		}
+
+		char *p = buf + pos;
 
 		*p++ = '0' + e->level;
 		*p++ = ' ';
@@ -387,11 +455,36 @@ void log_export_txt(const char *path) {
 		);
 
 		*p++ = '\n';
-		*p = 0;
+		pos = p - buf;
+	}
+
+	if (pos)
+		f_write(&fp, buf, pos, NULL);
 
-		UINT bw;
-		f_write(&fp, line, strlen(line), &bw);
+	free(buf);
+	f_close(&fp);
+}
+
+// Raw dump of the log for pack_assets -d, which expands it against the messages pool.
+void log_export_bin(const char *path) {
+	if (g_log_count == 0 || g_log_count > LOG_MAX_ENTRIES) {
+		return;
 	}
+	mkdir_recursive(path);
+	FIL fp;
+	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE))
+		return;
+
+	log_bin_hdr_t hdr = {
+		.magic = LOG_BIN_MAGIC,
+		.version = LOG_BIN_VERSION,
+		.entry_size = sizeof(log_entry_t),
+		.count = g_log_count,
+		.str_pool_size = g_log_str_pos
+	};
+
+	if (!f_write(&fp, &hdr, sizeof(hdr), NULL) && !f_write(&fp, g_log_buf, sizeof(log_entry_t) * g_log_count, NULL))
+		f_write(&fp, g_log_str_pool, g_log_str_pos, NULL);
 
 	f_close(&fp);
-}
\ No newline at end of file
+}
@@ -50,6 +50,8 @@ typedef enum {
 	LOG_MSG_ERROR_PRODINFO_SHA_VERIF,
 	LOG_MSG_ERROR_PRODINFO_SHA_COMPARE,
 	LOG_MSG_ERR_MOUNT_PARTITION,
+	LOG_MSG_ERR_FORMAT_PARTITION,
+	LOG_MSG_ERR_CLEAR_PARTITION,
 	LOG_MSG_DELETE_SAVE_SYSTEM,
 	LOG_MSG_DELETE_SAVE_USER,
 	LOG_MSG_ERR_OPEN_FILE,
@@ -66,17 +68,31 @@ typedef enum {
 	LOG_MSG_FLASH_PARTITION_FILE_NOT_ALLIGNED,
 	LOG_MSG_FLASH_PARTITION_ERR_PARTITION_WRITE,
 	LOG_MSG_FLASH_PARTITION_SUCCESS,
+	LOG_MSG_FLASH_PARTITION_DIFF_DONE,
 	LOG_MSG_DUMP_PARTITION_BEGIN,
 
 	LOG_MSG_DUMP_PARTITION_NOT_ALLIGNED,
 	LOG_MSG_DUMP_PARTITION_ERR_PARTITION_WRITE,
 	LOG_MSG_DUMP_PARTITION_SUCCESS,
+	LOG_MSG_DUMP_PARTITION_SPEED,
+	LOG_MSG_FLASH_PARTITION_HASH_OK,
+	LOG_MSG_FLASH_PARTITION_HASH_MISMATCH,
+	LOG_MSG_DUMP_BAD_FILE,
+	LOG_MSG_SPARSE_DUMP_DONE,
+	LOG_MSG_LZ4_DUMP_DONE,
+	LOG_MSG_LZ4_NOT_BUILT,
+	LOG_MSG_PRODINFO_RAW_ONLY,
+	LOG_MSG_USB_UMS_BEGIN,
+	LOG_MSG_USB_UMS_ERROR,
 
 	LOG_MSG_FOLDER_COPY_BEGIN,
 	LOG_MSG_FOLDER_DELETE_BEGIN,
 	LOG_MSG_FOLDER_COPY_ERROR,
 	LOG_MSG_FOLDER_DELETE_END,
 	LOG_MSG_FOLDER_COPY_END,
+	LOG_MSG_FILE_TRANSFERT_FROM_NANDS,
+	LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR,
+	LOG_MSG_FILE_TRANSFERT_FROM_NANDS_SUCCESS,
 	LOG_MSG_BATCH_BEGIN,
 	LOG_MSG_NEXT_BATCH_ON_SYSNAND,
 	LOG_MSG_NEXT_BATCH_ON_EMUNAND,
@@ -148,6 +164,7 @@ typedef enum {
 	LOG_MSG_KEYS_DUMP_ERR_SSL_KEY_DERIVATION,
 	LOG_MSG_KEYS_DUMP_ERR_ETICKET_KEY_DERIVATION,
 	LOG_MSG_KEYS_DUMP_ERR_GET_SD_SEED,
+	LOG_MSG_KEYS_DUMP_SD_SEED_SCAN,
 	LOG_MSG_KEYS_DUMP_ERR_TITLEKEYS_DERIVATION,
 	LOG_MSG_KEYS_DUMP_KEYS_FOUNDED,
 	LOG_MSG_KEYS_DUMP_KEYS_FOUNDED_VIA,
@@ -182,29 +199,15 @@ typedef enum {
 	LOG_MSG_INCOGNITO_VERIF_SUCCESS,
 	LOG_MSG_INCOGNITO_ERR,
 	LOG_MSG_INCOGNITO_SUCCESS,
+	LOG_MSG_BENCHMARK_BEGIN,
+	LOG_MSG_BENCHMARK_RESULT,
+	LOG_MSG_BENCHMARK_ERROR,
+	LOG_MSG_BENCHMARK_END,
 	LOG_MSG_BATCH_END,
 	LOG_MSG_COUNT
 } log_msg_id_t;
 		// LOG_MSG_dump_PARTITION_FILE_TO_BIG,
 	// [LOG_MSG_dump_PARTITION_FILE_TO_BIG]   = "Partition too big for SD remaining space",
-	// LOG_MSG_FILE_TRANSFERT_FROM_NANDS_SYS_TO_EMU_SYSTEM,
-	// LOG_MSG_FILE_TRANSFERT_FROM_NANDS_SYS_TO_EMU_USER,
-	// LOG_MSG_FILE_TRANSFERT_FROM_NANDS_EMU_TO_SYS_SYSTEM,
-	// LOG_MSG_FILE_TRANSFERT_FROM_NANDS_EMU_TO_SYS_USER,
-	// LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR_OPEN_SRC,
-	// LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR_READ_SRC,
-	// LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR_OPEN_DST,
-	// LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR_WRITE_DST,
-	// LOG_MSG_FILE_TRANSFERT_FROM_NANDS_SUCCESS,
-	// [LOG_MSG_FILE_TRANSFERT_FROM_NANDS_SYS_TO_EMU_SYSTEM]   = "File '%s' transfert from sysnand to emunand on SYSTEM partition",
-	// [LOG_MSG_FILE_TRANSFERT_FROM_NANDS_SYS_TO_EMU_USER]   = "File '%s' transfert from sysnand to emunand on USER partition",
-	// [LOG_MSG_FILE_TRANSFERT_FROM_NANDS_EMU_TO_SYS_SYSTEM]   = "File '%s' transfert from emunand to sysnand on SYSTEM partition",
-	// [LOG_MSG_FILE_TRANSFERT_FROM_NANDS_EMU_TO_SYS_USER]   = "File '%s' transfert from emunand to sysnand on USER partition",
-	// [LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR_OPEN_SRC]   = "Error when opening source file",
-	// [LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR_READ_SRC]   = "Read error on source file.",
-	// [LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR_OPEN_DST]   = "Error when opening dest file.",
-	// [LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR_WRITE_DST]   = "Write error on dest file.",
-	// [LOG_MSG_FILE_TRANSFERT_FROM_NANDS_SUCCESS]   = "File transfer done",
 	// LOG_MSG_RM_PARENTAL_CONTROL_SUCCESS,
 	// LOG_MSG_SYNCH_JOYCONS_INFOS_1,
 	// LOG_MSG_SYNCH_JOYCONS_INFOS_2,
@@ -240,8 +243,20 @@ typedef struct {
 	u8  argc;
 	u8 arg_type[LOG_MAX_ARGS];
 	u32 argv[LOG_MAX_ARGS];
+	u32 time_ms;
 } log_entry_t;
 
+// Binary log: header, entries, then the string pool they point into.
+#define LOG_BIN_MAGIC   0x474C534C // "LSLG"
+#define LOG_BIN_VERSION 1
+typedef struct {
+	u32 magic;
+	u16 version;
+	u16 entry_size;
+	u32 count;
+	u32 str_pool_size;
+} log_bin_hdr_t;
+
 #define LOG_MAX_ENTRIES 400
 #define LOG_STR_POOL_SIZE 4096*2
 
@@ -253,7 +268,10 @@ u32 log_arg_value(log_entry_t *e, int i);
 u32 log_color_from_level(u8 lvl);
 void log_printf(bool record_message, log_level_t lvl, log_msg_id_t id, ...);
 void log_export_txt(const char *path);
+void log_export_bin(const char *path);
 
+// Unpacks the messages pool if it is compressed. log_msg_get calls it on first use.
+bool log_msg_init();
 const char *log_msg_get(log_msg_id_t id);
 
 /*
@@ -175,12 +175,12 @@ void *tui_do_menu(menu_t *menu)
 
 		// Check for VOL+ and VOL- pressed together for screenshot
 		if (btn == (BTN_VOL_UP | BTN_VOL_DOWN)) {
-			int res = save_fb_to_bmp("menu");
+			int res = save_fb_to_qoi("menu");
 			u32 cx, cy;
 			gfx_con_getpos(&cx, &cy);
 			gfx_con_setpos(0, 1191);
 			if (!res) {
-				gfx_printf("%kScreenshot saved to sd:/LockSmith-RCM/screenshots/menu.bmp%k           ", COLOR_CYAN_L, COLOR_SOFT_WHITE);
+				gfx_printf("%kScreenshot saved to sd:/LockSmith-RCM/screenshots/menu.qoi%k           ", COLOR_CYAN_L, COLOR_SOFT_WHITE);
 			} else {
 				gfx_printf("%kScreenshot failed!%k                                     ", COLOR_ERROR, COLOR_SOFT_WHITE);
 			}
@@ -214,6 +214,7 @@ void *tui_do_menu(menu_t *menu)
 			{
 			case MENT_HANDLER:
 				ent->handler(ent->data);
+				debug_log_flush();
 				gfx_con.scroll_enabled = false;
 				break;
 			case MENT_MENU:
@@ -207,6 +207,7 @@ bool writeData(u8 *buffer, u32 offset, u32 length, void (*progress_callback)(u32
 		(*progress_callback)(0, length);
 	}
 	bool result = false;
+	cal0_cache_invalidate();
 
 	u32 initialLength = length;
 
@@ -94,18 +94,59 @@ static int se_aes_crypt_xts_nx(u32 tweak_ks, u32 crypt_ks, int enc, u64 sec, voi
 	return 0;
 }
 
+// Decrypted CAL0 of the nand it was read from. Keys or nand changes and CAL0 writes drop it.
+typedef struct _cal0_cache_t {
+	u8 *buf;
+	bool valid;
+	int emu_enabled;
+	u64 emu_sector;
+	char *emu_path;
+	u32 hits;
+	u32 misses;
+} cal0_cache_t;
+
+static cal0_cache_t cal0_cache = {0};
+
+// Same size as the emuMMC path buffers in emummc.c.
+#define CAL0_CACHE_PATH_SIZE 0x200
+
+static const char *_cal0_cache_path() {
+	return emu_cfg.path ? emu_cfg.path : "";
+}
+
+static bool _cal0_cache_match() {
+	return cal0_cache.valid && cal0_cache.emu_enabled == emu_cfg.enabled && (!emu_cfg.enabled ||
+		(cal0_cache.emu_sector == emu_cfg.sector && !strcmp(cal0_cache.emu_path, _cal0_cache_path())));
+}
+
+bool cal0_cache_init() {
+	// Allocated once at boot, outside of any action arena.
+	if (!cal0_cache.buf)
+		cal0_cache.buf = malloc(NX_EMMC_CALIBRATION_SIZE);
+	if (!cal0_cache.emu_path)
+		cal0_cache.emu_path = malloc(CAL0_CACHE_PATH_SIZE);
+	cal0_cache.valid = false;
+	return cal0_cache.buf && cal0_cache.emu_path;
+}
+
+void cal0_cache_invalidate() {
+	cal0_cache.valid = false;
+}
+
 bool cal0_read(u32 tweak_ks, u32 crypt_ks, void *read_buffer, const char* sd_path) {
 	// nx_emmc_cal0_t *cal0 = (nx_emmc_cal0_t *)read_buffer;
 
-	// Check if CAL0 was already read into this buffer
-	// if (cal0->magic != MAGIC_CAL0) {
-	if (rd_u32_le(read_buffer + pi_off(PI_F_MagicNumber)) == MAGIC_CAL0) {
-		return true;
-	}
-
 	u32 sector = NX_EMMC_CALIBRATION_OFFSET / EMMC_BLOCKSIZE;
 
 	if (sd_path == NULL) {
+		if (_cal0_cache_match()) {
+			memcpy(read_buffer, cal0_cache.buf, NX_EMMC_CALIBRATION_SIZE);
+			cal0_cache.hits++;
+			debug_log_write("CAL0 cache hit (%d hits, %d misses)\n", cal0_cache.hits, cal0_cache.misses);
+			return true;
+		}
+		cal0_cache.misses++;
+		debug_log_write("CAL0 cache miss (%d hits, %d misses)\n", cal0_cache.hits, cal0_cache.misses);
 		if (emummc_storage_read(sector, NX_EMMC_CALIBRATION_SIZE / EMMC_BLOCKSIZE, read_buffer)) {
 			log_printf(true, LOG_ERR, LOG_MSG_ERROR_PRODINFO_READ);
 			return false;
@@ -139,6 +180,15 @@ bool cal0_read(u32 tweak_ks, u32 crypt_ks, void *read_buffer, const char* sd_pat
 		return false;
 	}
 
+	// A path too long to copy is never cached, so it can't match another one by its prefix.
+	if (sd_path == NULL && cal0_cache.buf && cal0_cache.emu_path && strlen(_cal0_cache_path()) < CAL0_CACHE_PATH_SIZE) {
+		memcpy(cal0_cache.buf, read_buffer, NX_EMMC_CALIBRATION_SIZE);
+		cal0_cache.emu_enabled = emu_cfg.enabled;
+		cal0_cache.emu_sector = emu_cfg.sector;
+		strcpy(cal0_cache.emu_path, _cal0_cache_path());
+		cal0_cache.valid = true;
+	}
+
 	return true;
 }
 
@@ -22,7 +22,11 @@
 
 u16 crc16_calc_continue(u16 crc, const u8 *buf, u32 len);
 u16 crc16_calc(const u8 *buf, u32 len);
+// Nand reads are served from a cache of the last decrypted CAL0 of the same nand.
 bool cal0_read(u32 tweak_ks, u32 crypt_ks, void *read_buffer, const char* sd_path);
+bool cal0_cache_init();
+// Must be called after any write to PRODINFO or change of BIS keys.
+void cal0_cache_invalidate();
 // bool cal0_get_ssl_rsa_key(const nx_emmc_cal0_t *cal0, const void **out_key, u32 *out_key_size, const void **out_iv, u32 *out_generation);
 // bool cal0_get_eticket_rsa_key(const nx_emmc_cal0_t *cal0, const void **out_key, u32 *out_key_size, const void **out_iv, u32 *out_generation);
 bool cal0_get_ssl_rsa_key(const u8 *buf, const void **out_key, u32 *out_key_size, const void **out_iv, u32 *out_generation);
@@ -2,41 +2,57 @@
 #include "keyfile.h"
 #include <utils/types.h>
 #include <libs/fatfs/ff.h>
+#include <mem/heap.h>
 #include <string.h>
-#include <utils/ini.h>
 #include <storage/sd.h>
 #include "../gfx/gfx.h"
 
 #include "../tools.h"
 
-#define GetHexFromChar(c) ((c & 0x0F) + (c >= 'A' ? 9 : 0))
+#define KEYFILE_CHUNK_SIZE SZ_16K
+#define KEYFILE_NAME_MAX   32
+#define KEYFILE_VAL_MAX    (SE_KEY_128_SIZE * 2)
 
-char *getKey(const char *search, link_t *inilist) {
-	LIST_FOREACH_ENTRY(ini_sec_t, ini_sec, inilist, link){
-		if (ini_sec->type == INI_CHOICE){
-			LIST_FOREACH_ENTRY(ini_kv_t, kv, &ini_sec->kvs, link) {
-				if (!strcmp(search, kv->key)) {
-					return kv->val;
-				}
-			}
-		}   
-	}
-	return NULL;
-}
+typedef struct _keyfile_key_t {
+	const char *name;
+	u32 size;
+} keyfile_key_t;
 
-bool AddKey(u8 *buff, char *in, u32 len){
-	if (in == NULL || strlen(in) != len * 2)
-		return false;
+// Keys needed for BIS access. Order matches the destination table in GetKeysFromFile.
+static const keyfile_key_t _keyfile_keys[] = {
+	{ "bis_key_00",   SE_KEY_128_SIZE * 2 },
+	{ "bis_key_01",   SE_KEY_128_SIZE * 2 },
+	{ "bis_key_02",   SE_KEY_128_SIZE * 2 },
+	{ "header_key",   SE_KEY_128_SIZE * 2 },
+	{ "save_mac_key", SE_KEY_128_SIZE },
+};
 
-	for (u32 i = 0; i < len; i++) {
-		// buff[i] = (u8)((GetHexFromChar(in[i * 2]) << 4) | GetHexFromChar(in[i * 2 + 1]));
-		u8 hi = GetHexFromChar(in[i * 2]);
-		u8 lo = GetHexFromChar(in[i * 2 + 1]);
-		if (hi > 0xF || lo > 0xF)
-			return false;
-		buff[i] = (hi << 4) | lo;
-	}
-	return true;
+// Perfect hash over the wanted names: (first char + last char + length) & 7.
+static const s8 _keyfile_slots[8] = { 4, -1, -1, 3, 0, 1, 2, -1 };
+
+typedef enum {
+	KF_NAME,
+	KF_EQUALS,
+	KF_VALUE,
+	KF_SKIP
+} keyfile_state_t;
+
+static int _keyfile_lookup(const char *name, u32 len) {
+	if (!len)
+		return -1;
+	int idx = _keyfile_slots[(name[0] + name[len - 1] + len) & 7];
+	if (idx < 0 || strlen(_keyfile_keys[idx].name) != len || memcmp(_keyfile_keys[idx].name, name, len))
+		return -1;
+	return idx;
+}
+
+static ALWAYS_INLINE int _hex_nibble(char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c |= 0x20;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
 }
 
 bool GetKeysFromFile(char *path, key_storage_t* dumpedKeys) {
@@ -45,42 +61,110 @@ bool GetKeysFromFile(char *path, key_storage_t* dumpedKeys) {
 		return false;
 	}
 
-	LIST_INIT(iniList);
-	if (ini_parse(&iniList, path, false)) {
-		debug_log_write("Init parse error in bis keys extract via file\n");
+	FIL fp;
+	if (f_open(&fp, path, FA_READ)) {
+		debug_log_write("Keys file open error in bis keys extract via file\n");
 		return false;
 	}
 
-	// add biskeys, mkey 0, header_key, save_mac_key
-	if (!AddKey(dumpedKeys->bis_key[0], getKey("bis_key_00", &iniList), SE_KEY_128_SIZE * 2)) {
-		debug_log_write("bis key 0 extract via file error\n");
-		ini_free(&iniList);
-		return false;
-	}
-	if (!AddKey(dumpedKeys->bis_key[1], getKey("bis_key_01", &iniList), SE_KEY_128_SIZE * 2)) {
-		debug_log_write("bis key 1 extract via file error\n");
-		ini_free(&iniList);
+	char *buf = (char *)sdmmc_dma_alloc(KEYFILE_CHUNK_SIZE);
+	if (!buf) {
+		f_close(&fp);
 		return false;
 	}
-	if (!AddKey(dumpedKeys->bis_key[2], getKey("bis_key_02", &iniList), SE_KEY_128_SIZE * 2)) {
-		debug_log_write("bis key 2 extract via file error\n");
-		ini_free(&iniList);
-		return false;
+
+	u8 *dst[ARRAY_SIZE(_keyfile_keys)] = {
+		dumpedKeys->bis_key[0], dumpedKeys->bis_key[1], dumpedKeys->bis_key[2], dumpedKeys->header_key, dumpedKeys->save_mac_key
+	};
+	const u32 all_found = BIT(ARRAY_SIZE(_keyfile_keys)) - 1;
+	u32 found = 0;
+
+	keyfile_state_t state = KF_NAME;
+	char name[KEYFILE_NAME_MAX];
+	u8 val[KEYFILE_VAL_MAX];
+	u32 name_len = 0, nibbles = 0;
+	int key_idx = -1;
+	UINT br = 0;
+
+	// Single pass over the file, one chunk at a time. Lines may span chunks.
+	while (found != all_found && !f_read(&fp, buf, KEYFILE_CHUNK_SIZE, &br) && br) {
+		for (u32 i = 0; i < br; i++) {
+			char c = buf[i];
+
+			if (c == '\n' || c == '\r') {
+				if (state == KF_VALUE && nibbles == _keyfile_keys[key_idx].size * 2) {
+					memcpy(dst[key_idx], val, _keyfile_keys[key_idx].size);
+					found |= BIT(key_idx);
+				}
+				state = KF_NAME;
+				name_len = 0;
+				continue;
+			}
+
+			switch (state) {
+			case KF_NAME:
+				if (c == ' ' || c == '\t' || c == '=') {
+					key_idx = _keyfile_lookup(name, name_len);
+					if (key_idx < 0 || (found & BIT(key_idx)))
+						state = KF_SKIP;
+					else if (c == '=') {
+						state = KF_VALUE;
+						nibbles = 0;
+					} else
+						state = KF_EQUALS;
+				} else if (name_len < KEYFILE_NAME_MAX)
+					name[name_len++] = c;
+				else
+					state = KF_SKIP;
+				break;
+
+			case KF_EQUALS:
+				if (c == '=') {
+					state = KF_VALUE;
+					nibbles = 0;
+				} else if (c != ' ' && c != '\t')
+					state = KF_SKIP;
+				break;
+
+			case KF_VALUE:
+				if (c == ' ' || c == '\t')
+					break;
+				int v = _hex_nibble(c);
+				if (v < 0 || nibbles >= _keyfile_keys[key_idx].size * 2) {
+					state = KF_SKIP;
+					break;
+				}
+				if (nibbles & 1)
+					val[nibbles >> 1] |= v;
+				else
+					val[nibbles >> 1] = v << 4;
+				nibbles++;
+				break;
+
+			case KF_SKIP:
+				break;
+			}
+		}
 	}
-	if (!AddKey(dumpedKeys->header_key, getKey("header_key", &iniList), SE_KEY_128_SIZE * 2)) {
-		debug_log_write("header key extract via file error\n");
-		ini_free(&iniList);
-		return false;
+
+	// Flush the last key when the file has no trailing newline.
+	if (state == KF_VALUE && nibbles == _keyfile_keys[key_idx].size * 2) {
+		memcpy(dst[key_idx], val, _keyfile_keys[key_idx].size);
+		found |= BIT(key_idx);
 	}
-	if (!AddKey(dumpedKeys->save_mac_key, getKey("save_mac_key", &iniList), SE_KEY_128_SIZE)) {
-		debug_log_write("save_mac key extract via file error\n");
-		ini_free(&iniList);
+
+	sdmmc_dma_free(buf);
+	f_close(&fp);
+
+	if (found != all_found) {
+		for (u32 i = 0; i < ARRAY_SIZE(_keyfile_keys); i++) {
+			if (!(found & BIT(i)))
+				debug_log_write("%s extract via file error\n", _keyfile_keys[i].name);
+		}
 		return false;
 	}
-	// AddKey(dumpedKeys->master_key[0], getKey("master_key_00", &iniList), SE_KEY_128_SIZE);
 
 	gfx_puts(" Done");
 	debug_log_write("bis key extract via file success\n");
-	ini_free(&iniList);
 	return true;
-}
\ No newline at end of file
+}
@@ -29,6 +29,7 @@
 #include <gfx_utils.h>
 #include "../gfx/tui.h"
 #include "../hos/hos.h"
+#include "../perf/perf_mode.h"
 #include <libs/fatfs/ff.h>
 #include <libs/nx_savedata/header.h>
 #include <libs/nx_savedata/save.h>
@@ -60,24 +61,57 @@
 
 static u32 _key_count = 0, _titlekey_count = 0;
 
-static void _save_key(const char *name, const void *data, u32 len, char *outbuf) {
+static const char _hex_chars[16] = "0123456789abcdef";
+
+static ALWAYS_INLINE char *_hex_encode(char *dst, const u8 *src, u32 len) {
+	for (u32 i = 0; i < len; i++) {
+		*dst++ = _hex_chars[src[i] >> 4];
+		*dst++ = _hex_chars[src[i] & 0xF];
+	}
+	return dst;
+}
+
+static void _key_text_flush(key_text_t *out) {
+	UINT bw;
+	if (out->pos && (!out->fp || f_write(out->fp, out->buf, out->pos, &bw) || bw != out->pos))
+		out->failed = true;
+	out->pos = 0;
+}
+
+static void _save_key(const char *name, const void *data, u32 len, key_text_t *out) {
 	if (!key_exists(data))
 		return;
-	u32 pos = strlen(outbuf);
-	pos += s_printf(&outbuf[pos], "%s = ", name);
-	for (u32 i = 0; i < len; i++)
-		pos += s_printf(&outbuf[pos], "%02x", *(u8*)(data + i));
-	s_printf(&outbuf[pos], "\n");
+	u32 name_len = strlen(name);
+	// Name, " = ", hex data and newline.
+	u32 line_len = name_len + 3 + len * 2 + 1;
+	if (out->pos + line_len > out->size)
+		_key_text_flush(out);
+	if (line_len > out->size) {
+		EPRINTFARGS("Key %s too long, not saved.", name);
+		out->failed = true;
+		return;
+	}
+	char *p = out->buf + out->pos;
+	memcpy(p, name, name_len);
+	p += name_len;
+	memcpy(p, " = ", 3);
+	p = _hex_encode(p + 3, data, len);
+	*p++ = '\n';
+	out->pos = p - out->buf;
 	_key_count++;
 }
 
-static void _save_key_family(const char *name, const void *data, u32 start_key, u32 num_keys, u32 len, char *outbuf) {
-	char *temp_name = calloc(1, 0x40);
+static void _save_key_family(const char *name, const void *data, u32 start_key, u32 num_keys, u32 len, key_text_t *out) {
+	char temp_name[0x40];
+	u32 name_len = strlen(name);
+	memcpy(temp_name, name, name_len);
+	temp_name[name_len] = '_';
+	temp_name[name_len + 3] = 0;
 	for (u32 i = 0; i < num_keys; i++) {
-		s_printf(temp_name, "%s_%02x", name, i + start_key);
-		_save_key(temp_name, data + i * len, len, outbuf);
+		u8 idx = i + start_key;
+		_hex_encode(&temp_name[name_len + 1], &idx, 1);
+		_save_key(temp_name, data + i * len, len, out);
 	}
-	free(temp_name);
 }
 
 static void _derive_master_keys_mariko(key_storage_t *keys, bool is_dev) {
@@ -347,6 +381,9 @@ static bool _get_titlekeys_from_save(u32 buf_size, const u8 *save_mac_key, title
 	return true;
 }
 
+// Save blocks read per chunk while looking for the SD seed.
+#define SD_SEED_SCAN_CHUNK (SAVE_BLOCK_SIZE_DEFAULT * 16)
+
 static bool _derive_sd_seed(key_storage_t *keys) {
 	FIL fp;
 	u32 read_bytes = 0;
@@ -379,17 +416,29 @@ static bool _derive_sd_seed(key_storage_t *keys) {
 		return false;
 	}
 
-	u8 read_buf[0x20] __attribute__((aligned(4))) = {0};
+	u8 *read_buf = sdmmc_dma_alloc(SD_SEED_SCAN_CHUNK);
+	if (!read_buf) {
+		f_close(&fp);
+		return false;
+	}
+
 	// Skip the two header blocks and only check the first bytes of each block
-	// File contents are always block-aligned
-	for (u32 i = SAVE_BLOCK_SIZE_DEFAULT * 2; i < f_size(&fp); i += SAVE_BLOCK_SIZE_DEFAULT) {
-		if (f_lseek(&fp, i) || f_read(&fp, read_buf, 0x20, &read_bytes) || read_bytes != 0x20)
-			break;
-		if (memcmp(keys->temp_key, read_buf, sizeof(keys->temp_key)) == 0) {
-			memcpy(keys->sd_seed, read_buf + 0x10, sizeof(keys->sd_seed));
-			break;
+	// File contents are always block-aligned, so read many blocks at once and compare in memory
+	u32 start_time = get_tmr_us();
+	bool found = false;
+	if (!f_lseek(&fp, SAVE_BLOCK_SIZE_DEFAULT * 2)) {
+		while (!found && !f_read(&fp, read_buf, SD_SEED_SCAN_CHUNK, &read_bytes) && read_bytes >= 0x20) {
+			for (u32 off = 0; off + 0x20 <= read_bytes; off += SAVE_BLOCK_SIZE_DEFAULT) {
+				if (memcmp(keys->temp_key, read_buf + off, sizeof(keys->temp_key)) == 0) {
+					memcpy(keys->sd_seed, read_buf + off + 0x10, sizeof(keys->sd_seed));
+					found = true;
+					break;
+				}
+			}
 		}
 	}
+	log_printf(true, LOG_INFO, LOG_MSG_KEYS_DUMP_SD_SEED_SCAN, get_tmr_us() - start_time);
+	sdmmc_dma_free(read_buf);
 	f_close(&fp);
 
 	// TPRINTF("SD Seed...      ");
@@ -555,8 +604,23 @@ static void _save_keys_to_sd(key_storage_t *keys, titlekey_buffer_t *titlekey_bu
 		return;
 	}
 
-	u32 text_buffer_size = MAX(_titlekey_count * sizeof(titlekey_text_buffer_t) + 1, SZ_32K); // TODO SZ_16K before is 0x4000 (16 KO) so need to extend size if global keys need more than this size, now use SZ_32K
-	char *text_buffer = (char *)calloc(1, text_buffer_size);
+	f_mkdir("sd:/switch");
+
+	const char *keyfile_path = is_dev ? "sd:/switch/dev.keys" : "sd:/switch/prod.keys";
+
+	FIL fp;
+	UINT bw;
+	key_text_t text_out = { .buf = (char *)malloc(SZ_32K), .pos = 0, .size = SZ_32K, .fp = &fp, .failed = false };
+	key_text_t *text_buffer = &text_out;
+	if (!text_out.buf) {
+		log_printf(true, LOG_ERR, LOG_MSG_MALLOC_ERROR);
+		return;
+	}
+	if (f_open(&fp, keyfile_path, FA_CREATE_ALWAYS | FA_WRITE)) {
+		log_printf(true, LOG_ERR, LOG_MSG_KEYS_DUMP_ERR_SAVE_KEYS_FILE);
+		free(text_out.buf);
+		return;
+	}
 
 	SAVE_KEY(aes_kek_generation_source);
 	SAVE_KEY(aes_key_generation_source);
@@ -636,42 +700,53 @@ static void _save_keys_to_sd(key_storage_t *keys, titlekey_buffer_t *titlekey_bu
 	log_printf(true, LOG_INFO, LOG_MSG_KEYS_DUMP_KEYS_FOUNDED_VIA, KB_FIRMWARE_VERSION_MAX);
 	gfx_printf("\n");
 
-	f_mkdir("sd:/switch");
-
-	const char *keyfile_path = is_dev ? "sd:/switch/dev.keys" : "sd:/switch/prod.keys";
+	_key_text_flush(text_buffer);
+	f_close(&fp);
 
 	FILINFO fno;
-	if (!sd_save_to_file(text_buffer, strlen(text_buffer), keyfile_path) && !f_stat(keyfile_path, &fno)) {
+	if (!text_out.failed && !f_stat(keyfile_path, &fno)) {
 		log_printf(true, LOG_OK, LOG_MSG_KEYS_DUMP_SAVE_FILES, (u32)fno.fsize, keyfile_path);
 	} else {
 		log_printf(true, LOG_ERR, LOG_MSG_KEYS_DUMP_ERR_SAVE_KEYS_FILE);
 	}
 
 	if (_titlekey_count == 0 || !titlekey_buffer) {
-		free(text_buffer);
+		free(text_out.buf);
 		return;
 	}
-	memset(text_buffer, 0, text_buffer_size);
 
-	titlekey_text_buffer_t *titlekey_text = (titlekey_text_buffer_t *)text_buffer;
+	// Stream titlekeys to SD in buffer sized chunks.
+	bool write_ok = true;
+	keyfile_path = "sd:/switch/title.keys";
+	if (f_open(&fp, keyfile_path, FA_CREATE_ALWAYS | FA_WRITE)) {
+		log_printf(true, LOG_ERR, LOG_MSG_KEYS_DUMP_ERR_SAVE_TITLEKEYS_FILE);
+		free(text_out.buf);
+		return;
+	}
 
-	for (u32 i = 0; i < _titlekey_count; i++) {
-		for (u32 j = 0; j < SE_KEY_128_SIZE; j++)
-			s_printf(&titlekey_text[i].rights_id[j * 2], "%02x", titlekey_buffer->rights_ids[i][j]);
-		s_printf(titlekey_text[i].equals, " = ");
-		for (u32 j = 0; j < SE_KEY_128_SIZE; j++)
-			s_printf(&titlekey_text[i].titlekey[j * 2], "%02x", titlekey_buffer->titlekeys[i][j]);
-		s_printf(titlekey_text[i].newline, "\n");
+	text_out.pos = 0;
+	for (u32 i = 0; i < _titlekey_count && write_ok; i++) {
+		titlekey_text_buffer_t *titlekey_text = (titlekey_text_buffer_t *)&text_out.buf[text_out.pos];
+		_hex_encode(titlekey_text->rights_id, titlekey_buffer->rights_ids[i], SE_KEY_128_SIZE);
+		memcpy(titlekey_text->equals, " = ", sizeof(titlekey_text->equals));
+		_hex_encode(titlekey_text->titlekey, titlekey_buffer->titlekeys[i], SE_KEY_128_SIZE);
+		titlekey_text->newline[0] = '\n';
+		text_out.pos += sizeof(titlekey_text_buffer_t);
+
+		if (text_out.pos + sizeof(titlekey_text_buffer_t) > text_out.size || i == _titlekey_count - 1) {
+			write_ok = !f_write(&fp, text_out.buf, text_out.pos, &bw) && bw == text_out.pos;
+			text_out.pos = 0;
+		}
 	}
+	f_close(&fp);
 
-	keyfile_path = "sd:/switch/title.keys";
-	if (!sd_save_to_file(text_buffer, strlen(text_buffer), keyfile_path) && !f_stat(keyfile_path, &fno)) {
+	if (write_ok && !f_stat(keyfile_path, &fno)) {
 		log_printf(true, LOG_OK, LOG_MSG_KEYS_DUMP_SAVE_FILES, (u32)fno.fsize, keyfile_path);
 	} else {
 		log_printf(true, LOG_ERR, LOG_MSG_KEYS_DUMP_ERR_SAVE_TITLEKEYS_FILE);
 	}
 
-	free(text_buffer);
+	free(text_out.buf);
 }
 
 static void _derive_keys() {
@@ -734,7 +809,7 @@ static void _derive_keys() {
 }
 
 void derive_amiibo_keys() {
-	minerva_change_freq(FREQ_1600);
+	perf_mode_enter("dump_amiibo_keys");
 
 	// display_backlight_brightness(h_cfg.backlight, 1000);
 	// gfx_clear_partial_grey(0x1B, 32, 1224);
@@ -747,6 +822,7 @@ void derive_amiibo_keys() {
 	key_storage_t *keys = is_dev ? &dev_keys : &prod_keys;
 
 	if (!mount_nand_part(NULL, "BOOT0", true, true, false, false, NULL, NULL, NULL, NULL)) {
+		perf_mode_exit();
 		return;
 	}
 
@@ -758,7 +834,7 @@ void derive_amiibo_keys() {
 
 	if (!key_exists(keys->master_key[0])) {
 		log_printf(true, LOG_ERR, LOG_MSG_AMIIBO_KEYS_DUMP_ERR_MASTER_KEY);
-		minerva_change_freq(FREQ_800);
+		perf_mode_exit();
 		save_screenshot_and_go_back("dump_amiibo_keys");
 		return;
 	}
@@ -785,12 +861,12 @@ void derive_amiibo_keys() {
 		}
 	}
 
-	minerva_change_freq(FREQ_800);
+	perf_mode_exit();
 	save_screenshot_and_go_back("dump_amiibo_keys");
 }
 
 void dump_keys(bool no_display) {
-	minerva_change_freq(FREQ_1600);
+	perf_mode_enter("dump_keys");
 
 	if (no_display) {
 		gfx_con.mute = true;
@@ -812,7 +888,7 @@ void dump_keys(bool no_display) {
 	// h_cfg.emummc_force_disable = emu_cfg.sector == 0 && !emu_cfg.path;
 	// emu_cfg.enabled = !h_cfg.emummc_force_disable;
 
-	minerva_change_freq(FREQ_800);
+	perf_mode_exit();
 
 	extern bool g_cmac_bypassed;
 	if (g_cmac_bypassed) {
@@ -827,9 +903,7 @@ void dump_keys(bool no_display) {
 }
 
 u8 global_save_mac_key[SE_KEY_128_SIZE];
-bool prepare_bis_keys(bool from_file, key_storage_t *keys_out) {
-	// minerva_change_freq(FREQ_1600);
-
+static bool _prepare_bis_keys(bool from_file, key_storage_t *keys_out) {
 	if (!check_keyslot_access()) {
 		return false;
 	}
@@ -875,8 +949,13 @@ bool prepare_bis_keys(bool from_file, key_storage_t *keys_out) {
 	se_aes_key_set(7, keys->header_key + 0x10, 0x10);
 	// se_aes_key_set(8, keys->save_mac_key, 0x10);
 
-	// minerva_change_freq(FREQ_800);
-
 	unmount_nand_part(NULL, true, false, true, false);
 	return true;
+}
+
+bool prepare_bis_keys(bool from_file, key_storage_t *keys_out) {
+	perf_mode_enter("prepare_bis_keys");
+	bool res = _prepare_bis_keys(from_file, keys_out);
+	perf_mode_exit();
+	return res;
 }
\ No newline at end of file
@@ -20,6 +20,7 @@
 #include "crypto.h"
 
 #include "../hos/hos.h"
+#include <libs/fatfs/ff.h>
 #include <sec/se_t210.h>
 #include <utils/types.h>
 
@@ -33,6 +34,15 @@
 	start_time = get_tmr_us(); \
 	minerva_periodic_training()
 
+// Key file text output with tracked write position. Flushed to fp whenever it fills.
+typedef struct _key_text_t {
+	char *buf;
+	u32   pos;
+	u32   size;
+	FIL  *fp;
+	bool  failed;
+} key_text_t;
+
 // save key wrapper
 #define SAVE_KEY(name) _save_key(#name, name, sizeof(name), text_buffer)
 // save key with different name than variable
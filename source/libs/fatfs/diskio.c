@@ -31,6 +31,9 @@
 #include "../../storage/nx_emmc_bis.h"
 #include <storage/sdmmc.h>
 
+// The raw eMMC volume is not used, its slot holds the second BIS volume.
+#define DRIVE_BIS2 DRIVE_EMMC
+
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
 /*-----------------------------------------------------------------------*/
@@ -69,6 +72,9 @@ DRESULT disk_read (
 	case DRIVE_BIS:
 		return nx_emmc_bis_read(sector, count, buff) ? RES_ERROR : RES_OK;
 		// return nx_emmc_bis_read(sector, count, buff);
+
+	case DRIVE_BIS2:
+		return nx_emmc_bis_read_ex(1, sector, count, buff) ? RES_ERROR : RES_OK;
 	}
 
 	return RES_ERROR;
@@ -92,6 +98,9 @@ DRESULT disk_write (
 	case DRIVE_BIS:
 		return nx_emmc_bis_write(sector, count, (void *)buff) ? RES_ERROR : RES_OK;
 		// return nx_emmc_bis_write(sector, count, (void *)buff);
+
+	case DRIVE_BIS2:
+		return nx_emmc_bis_write_ex(1, sector, count, (void *)buff) ? RES_ERROR : RES_OK;
 	}
 
 	return RES_ERROR;
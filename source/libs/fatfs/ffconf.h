@@ -38,22 +38,24 @@
 /  f_findnext(). (0:Disable, 1:Enable 2:Enable with matching altname[] too) */
 
 
+#ifndef FF_USE_MKFS
 #define FF_USE_MKFS		0
+#endif
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
+// The host checks in tools/tests enable it to make their RAM disks.
+
+#define FF_MKFS_LABEL	"NO NAME    "
+/* This option sets the FAT volume label used by f_mkfs(). Must be 11 characters. */
 
 #define FF_FASTFS		0
 
-#if FF_FASTFS
 #define FF_USE_FASTSEEK	1
-#else
-#define FF_USE_FASTSEEK	0
-#endif
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 #define FF_SIMPLE_GPT 1
 /* This option switches support for the first GPT partition. (0:Disable or 1:Enable) */
 
-#define FF_USE_EXPAND	0
+#define FF_USE_EXPAND	1
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
 
 
@@ -176,7 +178,7 @@
 
 #define FF_STR_VOLUME_ID	1
 // Order is important. Any change to order, must also be reflected to diskio drive enum.
-#define FF_VOLUME_STRS		"sd","ram","emmc","bis"
+#define FF_VOLUME_STRS		"sd","ram","bis2","bis"
 /* FF_STR_VOLUME_ID switches support for volume ID in arbitrary strings.
 /  When FF_STR_VOLUME_ID is set to 1 or 2, arbitrary strings can be used as drive
 /  number in the path name. FF_VOLUME_STRS defines the volume ID strings for each
@@ -35,6 +35,7 @@
 #include <soc/hw_init.h>
 #include <soc/timer.h>
 #include "storage/emummc.h"
+#include "storage/fastseek.h"
 #include <storage/emmc.h>
 #include "storage/nx_emmc_bis.h"
 #include <storage/sd.h>
@@ -46,6 +47,9 @@
 #include <utils/sprintf.h>
 #include <utils/util.h>
 
+#ifdef LS_BENCHMARK
+#include "bench/benchmark.h"
+#endif
 #include "fuse_check/fuse_check.h"
 #include "incognito/incognito.h"
 #include "keys/cal0_read.h"
@@ -158,7 +162,21 @@ static void run_auto_action(const auto_action_t *a, bool on_emunand) {
 		log_printf(true, LOG_WARN, LOG_MSG_NEXT_BATCH_ON_EMUNAND);
 	}
 
+	// Each action starts from the same heap watermark.
+	// Globals that allocate on first use must do so before the mark, or arena_end hands their memory to the next action.
+	// The debug log buffer is allocated at boot by debug_log_start.
+	arena_t arena;
+	heap_monitor_t mon;
+	log_msg_init();
+	arena_begin(&arena);
 	a->func();
+	arena_end(&arena);
+	heap_monitor(&mon, false);
+	debug_log_write("%s: heap peak %d bytes\n", a->name, mon.arena_peak);
+	u32 leaked = sdmmc_dma_pool_reset();
+	if (leaked)
+		debug_log_write("%s: %d DMA pool slots not freed\n", a->name, leaked);
+	debug_log_flush();
 
 	sd_mount();
 out:
@@ -285,6 +303,7 @@ static void launch_reboot_payload() {
 
 static void _ipl_reload()
 {
+	debug_log_flush();
 	free((BYTE*)copy_buf);
 	free((u8*)cal0_buf);
 	emunand_list_free();
@@ -296,6 +315,7 @@ static void _ipl_reload()
 }
 
 static void STATE_POWER_OFF() {
+	debug_log_flush();
 	free((BYTE*)copy_buf);
 	free((u8*)cal0_buf);
 	emunand_list_free();
@@ -303,6 +323,7 @@ static void STATE_POWER_OFF() {
 }
 
 static void STATE_REBOOT_FULL() {
+	debug_log_flush();
 	free((BYTE*)copy_buf);
 	free((u8*)cal0_buf);
 	emunand_list_free();
@@ -310,6 +331,7 @@ static void STATE_REBOOT_FULL() {
 }
 
 static void STATE_REBOOT_RCM() {
+	debug_log_flush();
 	free((BYTE*)copy_buf);
 	free((u8*)cal0_buf);
 	emunand_list_free();
@@ -317,6 +339,7 @@ static void STATE_REBOOT_RCM() {
 }
 
 static void STATE_REBOOT_BYPASS_FUSES() {
+	debug_log_flush();
 	free((BYTE*)copy_buf);
 	free((u8*)cal0_buf);
 	emunand_list_free();
@@ -493,6 +516,112 @@ static void restore_prodinfo() {
 	save_screenshot_and_go_back("restore_prodinfo");
 }
 
+static const char *const bis_sparse_parts[] = { "SYSTEM", "USER" };
+
+// The first dump is a full sparse one, later ones only keep what changed since it.
+static void dump_bis_sparse() {
+	cls();
+	char base[256], path[256];
+	const char *nand = menu_on_sysnand ? "sysnand" : "emunand";
+	for (u32 i = 0; i < ARRAY_SIZE(bis_sparse_parts); i++) {
+		s_printf(base, "sd:/LockSmith-RCM/backups/%s/%s_%s.lssp", emmc_id, bis_sparse_parts[i], nand);
+		s_printf(path, "%s.clh", base);
+		bool ok;
+		if (f_stat(path, NULL) != FR_OK) {
+			ok = dump_part_sparse(base, bis_sparse_parts[i], NULL, true);
+		} else {
+			s_printf(path, "sd:/LockSmith-RCM/backups/%s/%s_%s_diff.lssp", emmc_id, bis_sparse_parts[i], nand);
+			ok = dump_part_sparse(path, bis_sparse_parts[i], base, true);
+		}
+		if (!ok) {
+			break;
+		}
+	}
+	save_screenshot_and_go_back("dump_bis_sparse");
+}
+
+static void restore_bis_sparse() {
+	cls();
+	log_printf(true, LOG_INFO, LOG_MSG_FNC_BEGIN, "restore SYSTEM and USER");
+	if (!wait_vol_plus()) {
+		return;
+	}
+	char path[256];
+	const char *nand = menu_on_sysnand ? "sysnand" : "emunand";
+	for (u32 i = 0; i < ARRAY_SIZE(bis_sparse_parts); i++) {
+		s_printf(path, "sd:/LockSmith-RCM/backups/%s/%s_%s_diff.lssp", emmc_id, bis_sparse_parts[i], nand);
+		if (f_stat(path, NULL) != FR_OK) {
+			s_printf(path, "sd:/LockSmith-RCM/backups/%s/%s_%s.lssp", emmc_id, bis_sparse_parts[i], nand);
+		}
+		if (!flash_or_dump_part(true, path, bis_sparse_parts[i], true)) {
+			break;
+		}
+	}
+	save_screenshot_and_go_back("restore_bis_sparse");
+}
+
+#ifdef LS_LZ4_DUMPS
+static const char *const boot_parts[] = { "BOOT0", "BOOT1" };
+
+static void dump_boot_lz4() {
+	cls();
+	char path[256];
+	const char *nand = menu_on_sysnand ? "sysnand" : "emunand";
+	for (u32 i = 0; i < ARRAY_SIZE(boot_parts); i++) {
+		s_printf(path, "sd:/LockSmith-RCM/backups/%s/%s_%s.lz4c", emmc_id, boot_parts[i], nand);
+		if (!dump_part_lz4(path, boot_parts[i], false)) {
+			break;
+		}
+	}
+	save_screenshot_and_go_back("dump_boot_lz4");
+}
+
+static void restore_boot_lz4() {
+	cls();
+	log_printf(true, LOG_INFO, LOG_MSG_FNC_BEGIN, "restore BOOT0 and BOOT1");
+	if (!wait_vol_plus()) {
+		return;
+	}
+	char path[256];
+	const char *nand = menu_on_sysnand ? "sysnand" : "emunand";
+	for (u32 i = 0; i < ARRAY_SIZE(boot_parts); i++) {
+		s_printf(path, "sd:/LockSmith-RCM/backups/%s/%s_%s.lz4c", emmc_id, boot_parts[i], nand);
+		if (!flash_or_dump_part(true, path, boot_parts[i], false)) {
+			break;
+		}
+	}
+	save_screenshot_and_go_back("restore_boot_lz4");
+}
+#endif
+
+#ifdef LS_USB_UMS
+static ment_t ment_usb_parts[] = {
+	MDEF_BACK(COLOR_TURQUOISE),
+	MDEF_CHGLINE(),
+	{ MENT_DATA, "PRODINFOF", COLOR_TURQUOISE, "PRODINFOF", 1 },
+	{ MENT_DATA, "SAFE", COLOR_TURQUOISE, "SAFE", 1 },
+	{ MENT_DATA, "SYSTEM", COLOR_ORANGE, "SYSTEM", 1 },
+	{ MENT_DATA, "USER", COLOR_ORANGE, "USER", 1 },
+	MDEF_END()
+};
+
+static void usb_mount_bis() {
+	cls();
+	menu_t menu = { ment_usb_parts, "Choose a partition to mount over USB", 0, 0 };
+	const char *part = (const char *)tui_do_menu(&menu);
+	if (!part) {
+		return;
+	}
+	cls();
+	log_printf(true, LOG_INFO, LOG_MSG_FNC_BEGIN, "USB mount");
+	if (!wait_vol_plus()) {
+		return;
+	}
+	usb_mount_bis_part(part);
+	save_screenshot_and_go_back("usb_mount_bis");
+}
+#endif
+
 static void apply_incognito() {
 	// return;
 	cls();
@@ -608,6 +737,12 @@ static const auto_action_t auto_actions[] = {
 	{ "dump_prodinfo", dump_prodinfo, true  },
 	// { "dump_saves", dump_saves, true  },
 	{ "restore_prodinfo", restore_prodinfo, true  },
+	{ "dump_bis_sparse", dump_bis_sparse, true  },
+	{ "restore_bis_sparse", restore_bis_sparse, true  },
+#ifdef LS_LZ4_DUMPS
+	{ "dump_boot_lz4", dump_boot_lz4, true  },
+	{ "restore_boot_lz4", restore_boot_lz4, true  },
+#endif
 	{ "dump_fw", DumpFw, true  },
 	{ "incognito", apply_incognito, true  },
 	{ "fix_dg", fix_downgrade, true  },
@@ -624,6 +759,9 @@ static const auto_action_t auto_actions[] = {
 	{ "dump_keys",    keys_dump,     true  },
 	{ "dump_amiibo_keys",    dump_amiibo_keys,     false  },
 	{ "dump_mariko_partial_keys",    dump_mariko_partial_keys,     false  },
+#ifdef LS_BENCHMARK
+	{ "benchmark",    benchmark,     true  },
+#endif
 };
 
 ment_t ment_top[] = {
@@ -639,9 +777,11 @@ ment_t ment_top[] = {
 	// MDEF_HANDLER("Dump game saves", dump_saves, COLOR_TURQUOISE),
 	MDEF_CAPTION("---------------", COLOR_WHITE),
 	MDEF_HANDLER("Dump PRODINFO", dump_prodinfo, COLOR_TURQUOISE),
+	MDEF_HANDLER("Dump SYSTEM and USER (sparse)", dump_bis_sparse, COLOR_TURQUOISE),
 	MDEF_HANDLER("Verify and fix prodinfo nand", test_prodinfo_nand, COLOR_TURQUOISE),
 	MDEF_HANDLER("Verify and fix prodinfo backup", test_prodinfo_backup, COLOR_TURQUOISE),
 	MDEF_HANDLER("Restore PRODINFO", restore_prodinfo, COLOR_RED),
+	MDEF_HANDLER("Restore SYSTEM and USER", restore_bis_sparse, COLOR_RED),
 	MDEF_HANDLER("Apply Incognito", apply_incognito, COLOR_RED),
 	MDEF_HANDLER("Build PRODINFO file from scratch", build_prodinfo_from_scratch, COLOR_TURQUOISE),
 	MDEF_HANDLER("Build PRODINFO file from donor", build_prodinfo_from_donor, COLOR_TURQUOISE),
@@ -665,11 +805,29 @@ ment_t ment_top[] = {
 	MDEF_HANDLER("Reboot (RCM)", STATE_REBOOT_RCM, COLOR_ORANGE),
 	MDEF_HANDLER("Reboot LockSmith-RCM", _ipl_reload, COLOR_TURQUOISE),
 	MDEF_HANDLER("Power off", STATE_POWER_OFF, COLOR_TURQUOISE),
+#ifdef LS_LZ4_DUMPS
+	MDEF_CAPTION("---------------", COLOR_WHITE),
+	MDEF_HANDLER("Dump BOOT0 and BOOT1 (LZ4)", dump_boot_lz4, COLOR_TURQUOISE),
+	MDEF_HANDLER("Restore BOOT0 and BOOT1 (LZ4)", restore_boot_lz4, COLOR_RED),
+#endif
+#ifdef LS_USB_UMS
+	MDEF_CAPTION("---------------", COLOR_WHITE),
+	MDEF_HANDLER("Mount decrypted partition over USB", usb_mount_bis, COLOR_RED),
+#endif
 	MDEF_END()
 };
 
 menu_t menu_top = { ment_top, NULL, 0, 0 };
 
+#ifdef LS_LZ4_DUMPS
+// Dump then restore, right before the optional USB entries.
+#ifdef LS_USB_UMS
+#define MENU_LZ4_DUMP (ARRAY_SIZE(ment_top) - 5)
+#else
+#define MENU_LZ4_DUMP (ARRAY_SIZE(ment_top) - 3)
+#endif
+#endif
+
 void grey_out_menu_item(ment_t *menu) {
 	// menu->type = MENT_CAPTION;
 	// menu->color = 0xFF555555;
@@ -710,13 +868,22 @@ void mask_emmc_need_for_menu() {
 	grey_out_menu_item(&ment_top[16]);
 	grey_out_menu_item(&ment_top[17]);
 	grey_out_menu_item(&ment_top[18]);
+	grey_out_menu_item(&ment_top[19]);
 	grey_out_menu_item(&ment_top[20]);
-	grey_out_menu_item(&ment_top[21]);
 	grey_out_menu_item(&ment_top[22]);
 	grey_out_menu_item(&ment_top[23]);
 	grey_out_menu_item(&ment_top[24]);
-	// grey_out_menu_item(&ment_top[25]);
-	// grey_out_menu_item(&ment_top[26]);
+	grey_out_menu_item(&ment_top[25]);
+	grey_out_menu_item(&ment_top[26]);
+	// grey_out_menu_item(&ment_top[27]);
+	// grey_out_menu_item(&ment_top[28]);
+#ifdef LS_LZ4_DUMPS
+	grey_out_menu_item(&ment_top[MENU_LZ4_DUMP]);
+	grey_out_menu_item(&ment_top[MENU_LZ4_DUMP + 1]);
+#endif
+#ifdef LS_USB_UMS
+	grey_out_menu_item(&ment_top[ARRAY_SIZE(ment_top) - 2]);
+#endif
 }
 
 void mask_file_load_keys_need_for_menu() {
@@ -725,10 +892,10 @@ void mask_file_load_keys_need_for_menu() {
 	grey_out_menu_item(&ment_top[5]);
 	grey_out_menu_item(&ment_top[6]);
 	grey_out_menu_item(&ment_top[7]);
-	grey_out_menu_item(&ment_top[15]);
-	grey_out_menu_item(&ment_top[16]);
 	grey_out_menu_item(&ment_top[17]);
 	grey_out_menu_item(&ment_top[18]);
+	grey_out_menu_item(&ment_top[19]);
+	grey_out_menu_item(&ment_top[20]);
 }
 
 void mask_no_sd_menu_options() {
@@ -740,24 +907,33 @@ void mask_no_sd_menu_options() {
 	grey_out_menu_item(&ment_top[6]);
 	grey_out_menu_item(&ment_top[8]);
 	grey_out_menu_item(&ment_top[10]);
-	grey_out_menu_item(&ment_top[12]);
+	grey_out_menu_item(&ment_top[11]);
 	grey_out_menu_item(&ment_top[13]);
+	grey_out_menu_item(&ment_top[14]);
 	grey_out_menu_item(&ment_top[15]);
-	grey_out_menu_item(&ment_top[16]);
 	grey_out_menu_item(&ment_top[17]);
 	grey_out_menu_item(&ment_top[18]);
-	grey_out_menu_item(&ment_top[23]);
-	grey_out_menu_item(&ment_top[24]);
-		grey_out_menu_item(&ment_top[26]);
-		grey_out_menu_item(&ment_top[27]);
+	grey_out_menu_item(&ment_top[19]);
+	grey_out_menu_item(&ment_top[20]);
+	grey_out_menu_item(&ment_top[25]);
+	grey_out_menu_item(&ment_top[26]);
 		grey_out_menu_item(&ment_top[28]);
+		grey_out_menu_item(&ment_top[29]);
+		grey_out_menu_item(&ment_top[30]);
+#ifdef LS_LZ4_DUMPS
+	grey_out_menu_item(&ment_top[MENU_LZ4_DUMP]);
+	grey_out_menu_item(&ment_top[MENU_LZ4_DUMP + 1]);
+#endif
+#ifdef LS_USB_UMS
+	grey_out_menu_item(&ment_top[ARRAY_SIZE(ment_top) - 2]);
+#endif
 }
 
 static void mask_specific_menu_options() {
 	// Grey out "switch nand work " and "sync joycons" if emunand or sysnand not present.
 	if (!emummc_available || !sysmmc_available) {
 		grey_out_menu_item(&ment_top[0]); // switch between sysnand and emunand work
-		// grey_out_menu_item(&ment_top[24]); // Syncronize joycons
+		// grey_out_menu_item(&ment_top[26]); // Syncronize joycons
 	}
 
 	if (f_stat("sd:/LockSmith-RCM/prod.keys", NULL)) {
@@ -778,52 +954,53 @@ static void mask_specific_menu_options() {
 		s_printf(path, "sd:/LockSmith-RCM/backups/%s/PRODINFO_emunand_dec.bin", emmc_id);
 	}
 	if (f_stat(path, NULL) != FR_OK) {
-		grey_out_menu_item(&ment_top[12]);
 		grey_out_menu_item(&ment_top[13]);
+		grey_out_menu_item(&ment_top[14]);
 	}
 	*/
 
 	// Grey out PRODINFO build (and build and flash) from donor if  donor file  not found.
 	if (f_stat(DONOR_PRODINFO_FILENAME, NULL)) {
-		grey_out_menu_item(&ment_top[16]);
 		grey_out_menu_item(&ment_top[18]);
+		grey_out_menu_item(&ment_top[20]);
 	}
 
 	// Grey out unbrick via EmmcHacGen package options if   files and folders not found.
 	if (f_stat("cdj_package_files", NULL) || f_stat("cdj_package_files/BCPKG2-1-Normal-Main.bin", NULL) || f_stat("cdj_package_files/BCPKG2-2-Normal-Sub.bin", NULL) || f_stat("cdj_package_files/BCPKG2-3-SafeMode-Main.bin", NULL) || f_stat("cdj_package_files/BCPKG2-4-SafeMode-Sub.bin", NULL) || f_stat("cdj_package_files/BOOT0.bin", NULL) || f_stat("cdj_package_files/BOOT1.bin", NULL) || f_stat("cdj_package_files/SYSTEM/Contents/placehld", NULL) || f_stat("cdj_package_files/SYSTEM/Contents/registered", NULL) || f_stat("cdj_package_files/SYSTEM/save", NULL)) {
-		grey_out_menu_item(&ment_top[23]);
-		grey_out_menu_item(&ment_top[24]);
+		grey_out_menu_item(&ment_top[25]);
+		grey_out_menu_item(&ment_top[26]);
 	}
 
 	// Grey out Hekate reboot if update.bin not found.
 	if (f_stat("bootloader/update.bin", NULL)) {
-		grey_out_menu_item(&ment_top[27]);
+		grey_out_menu_item(&ment_top[29]);
 	}
 
 	// Grey out Payload.bin reboot if not found.
 	if (f_stat("payload.bin", NULL)) {
-		grey_out_menu_item(&ment_top[28]);
+		grey_out_menu_item(&ment_top[30]);
 	}
 
 	// Grey out reboot to RCM option if on Mariko or patched console, else grey out reboot OFW options if auto-rcm enabled
 	if (h_cfg.t210b01 || h_cfg.rcm_patched) {
-		grey_out_menu_item(&ment_top[32]);
+		grey_out_menu_item(&ment_top[34]);
 	} else {
 		if (is_autorcm_enabled()) {
-			grey_out_menu_item(&ment_top[30]);
-			grey_out_menu_item(&ment_top[31]);
+			grey_out_menu_item(&ment_top[32]);
+			grey_out_menu_item(&ment_top[33]);
 		}
 	}
 
 // Grey out reboot OFW options if sysnand not founded
 	if (!sysmmc_available) {
-		grey_out_menu_item(&ment_top[30]);
 		grey_out_menu_item(&ment_top[32]);
+		grey_out_menu_item(&ment_top[34]);
 	}
 }
 
 bool init_and_verify_bis_keys(bool from_file) {
 	static bool internal_call = false;
+	cal0_cache_invalidate();
 	if (!internal_call) {
 		reset_menu(&menu_top);
 	}
@@ -979,6 +1156,10 @@ void init_payload() {
 		btn_wait();
 		power_set_state(POWER_OFF_RESET);
 	}
+	// Without the cache CAL0 is only read again each time.
+	cal0_cache_init();
+	// Without the pool image files seek through the FAT chain.
+	fastseek_init();
 	if (f_stat("sd:/switch/AIO_LS_pack_Updater/called_via_AIO_LS_pack_Updater", NULL) == FR_OK) {
 		called_from_AIO_LS_Pack_Updater = true;
 		f_unlink("sd:/switch/AIO_LS_pack_Updater/called_via_AIO_LS_pack_Updater");
@@ -1043,6 +1224,7 @@ void init_payload() {
 			free((BYTE*)copy_buf);
 			free((u8*)cal0_buf);
 			emunand_list_free();
+			debug_log_flush();
 			if (mark_for_shutdown) power_set_state(POWER_OFF_RESET);
 		}
 	}
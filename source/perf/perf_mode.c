@@ -0,0 +1,94 @@
+#include "perf_mode.h"
+#include <mem/minerva.h>
+#include <power/max17050.h>
+#include <soc/bpmp.h>
+#include <soc/timer.h>
+#include <thermal/tmp451.h>
+
+#include "../tools.h"
+
+extern bpmp_freq_t bpmp_fid_current;
+
+static u32 _depth = 0;
+static bool _boosted = false;
+static bpmp_freq_t _saved_fid;
+static minerva_freq_t _saved_freq;
+static const char *_name;
+static u32 _start_ms;
+static u32 _tick_ms;
+
+// Pure policy, no hardware access.
+static bool _perf_mode_allowed(u32 soc_temp, u32 batt_pct, int batt_mv, bool charging) {
+	if (soc_temp >= PERF_MODE_TEMP_MAX)
+		return false;
+	if (!charging && (batt_pct < PERF_MODE_BATT_MIN_PCT || batt_mv < PERF_MODE_BATT_MIN_MV))
+		return false;
+	return true;
+}
+
+static void _perf_mode_boost() {
+	_saved_fid = bpmp_fid_current;
+	_saved_freq = have_minerva ? minerva_get_freq() : 0;
+	if (_saved_freq)
+		minerva_change_freq(FREQ_1600);
+	if (_saved_fid < BPMP_CLK_DEFAULT_BOOST)
+		bpmp_clk_rate_set(BPMP_CLK_DEFAULT_BOOST);
+	_boosted = true;
+}
+
+static void _perf_mode_unboost() {
+	if (!_boosted)
+		return;
+	if (_saved_freq)
+		minerva_change_freq(_saved_freq);
+	bpmp_clk_rate_set(_saved_fid);
+	_boosted = false;
+}
+
+void perf_mode_enter(const char *name) {
+	if (_depth++)
+		return;
+
+	u32 soc_temp = tmp451_get_soc_temp(true);
+	u32 batt_pct = 0;
+	int batt_mv = 0, batt_ma = 0;
+	max17050_get_property(MAX17050_RepSOC, (int *)&batt_pct);
+	max17050_get_property(MAX17050_VCELL, &batt_mv);
+	max17050_get_property(MAX17050_Current, &batt_ma);
+	batt_pct >>= 8;
+
+	if (_perf_mode_allowed(soc_temp, batt_pct, batt_mv, batt_ma > 0))
+		_perf_mode_boost();
+
+	debug_log_write("Perf %s begin: %s, SoC %d C, battery %d%% %d mV\n",
+		name, _boosted ? "boosted" : "idle clocks", soc_temp, batt_pct, batt_mv);
+
+	_name = name;
+	_start_ms = get_tmr_ms();
+	_tick_ms = _start_ms;
+}
+
+void perf_mode_exit() {
+	if (!_depth || --_depth)
+		return;
+
+	debug_log_write("Perf %s end: %d ms, %s\n", _name, get_tmr_ms() - _start_ms, _boosted ? "boosted" : "idle clocks");
+
+	_perf_mode_unboost();
+}
+
+void perf_mode_tick() {
+	if (!_boosted || get_tmr_ms() - _tick_ms < PERF_MODE_TICK_MS)
+		return;
+
+	_tick_ms = get_tmr_ms();
+
+	u32 soc_temp = tmp451_get_soc_temp(true);
+	if (soc_temp >= PERF_MODE_TEMP_MAX) {
+		debug_log_write("Perf %s throttled at %d ms, SoC %d C\n", _name, _tick_ms - _start_ms, soc_temp);
+		_perf_mode_unboost();
+		return;
+	}
+
+	minerva_periodic_training();
+}
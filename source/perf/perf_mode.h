@@ -0,0 +1,18 @@
+#ifndef _PERF_MODE_H_
+#define _PERF_MODE_H_
+
+#include <utils/types.h>
+
+#define PERF_MODE_TEMP_MAX     70   // SoC degrees C. Hotter than that, heavy actions run at idle clocks.
+#define PERF_MODE_BATT_MIN_PCT 10
+#define PERF_MODE_BATT_MIN_MV  3600 // Battery limits only apply when not charging.
+#define PERF_MODE_TICK_MS      500
+
+// Raises DRAM and BPMP clocks for a heavy action, when temperature and battery allow it.
+// Calls nest, only the outermost pair changes clocks and logs the action time.
+void perf_mode_enter(const char *name);
+void perf_mode_exit();
+// Called by the progress spinner of long loops. Keeps DRAM trained at 1600 MHz and drops the boost if the SoC gets too hot.
+void perf_mode_tick();
+
+#endif
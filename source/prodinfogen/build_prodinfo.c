@@ -21,6 +21,7 @@
 #include <gfx_utils.h>
 #include "../gfx/tui.h"
 #include "../hos/hos.h"
+#include "../perf/perf_mode.h"
 #include <libs/fatfs/ff.h>
 #include <libs/nx_savedata/save.h>
 #include <mem/heap.h>
@@ -259,7 +260,7 @@ static bool _read_donor_prodinfo(imported_parts_t* output, const char* donor_pro
 }
 
 void build_prodinfo(const char* optional_donor_filename, bool end_with_key_press) {
-	minerva_change_freq(FREQ_1600);
+	perf_mode_enter("build_prodinfo");
 	u32 start_time, end_time;
 
 	// display_backlight_brightness(h_cfg.backlight, 1000);
@@ -336,8 +337,7 @@ void build_prodinfo(const char* optional_donor_filename, bool end_with_key_press
 	log_printf(true, LOG_OK, LOG_MSG_PRODINFOGEN_WRITING_FILE, end_time - start_time);
 	gfx_printf("\n");
 
-
-	minerva_change_freq(FREQ_800);
+	perf_mode_exit();
 	if (end_with_key_press) {
 		save_screenshot_and_go_back("PRODINFO_build");
 	}
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 
 #include "emummc.h"
+#include "fastseek.h"
 #include "../config.h"
 #include <storage/sdmmc.h>
 #include <utils/ini.h>
@@ -221,6 +222,7 @@ int emummc_storage_read(u32 sector, u32 num_sectors, void *buf)
 			EPRINTF("Failed to open emuMMC image.");
 			return 1;
 		}
+		fastseek_attach(&fp);
 		f_lseek(&fp, (u64)sector << 9);
 		if (f_read(&fp, buf, (u64)num_sectors << 9, NULL))
 		{
@@ -263,6 +265,7 @@ int emummc_storage_write(u32 sector, u32 num_sectors, void *buf)
 		if (f_open(&fp, emu_cfg.emummc_file_based_path, FA_WRITE))
 			return 1;
 
+		fastseek_attach(&fp);
 		f_lseek(&fp, (u64)sector << 9);
 		if (f_write(&fp, buf, (u64)num_sectors << 9, NULL))
 		{
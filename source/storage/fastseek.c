@@ -0,0 +1,80 @@
+#include "fastseek.h"
+#include <libs/fatfs/diskio.h>
+#include <mem/heap.h>
+
+typedef struct _fastseek_map_t
+{
+	DWORD sclust;
+	FSIZE_t size;
+	DWORD *tbl;
+} fastseek_map_t;
+
+static DWORD *fastseek_pool;
+static fastseek_map_t *fastseek_maps;
+static u32 fastseek_used;
+static u32 fastseek_count;
+static WORD fastseek_fs_id;
+
+void fastseek_reset()
+{
+	fastseek_used  = 0;
+	fastseek_count = 0;
+}
+
+bool fastseek_init()
+{
+	// 32KB would not fit in the IPL's BSS, and the maps must outlive every action arena.
+	if (!fastseek_pool)
+	{
+		fastseek_pool = malloc(FASTSEEK_POOL_SIZE * sizeof(DWORD));
+		fastseek_maps = malloc(FASTSEEK_MAX_FILES * sizeof(fastseek_map_t));
+	}
+	fastseek_reset();
+
+	return fastseek_pool && fastseek_maps;
+}
+
+bool fastseek_attach(FIL *fp)
+{
+	FATFS *fs = fp->obj.fs;
+
+	if (!fastseek_pool || !fs || fs->pdrv != DRIVE_SD || !fp->obj.sclust)
+		return false;
+
+	// Files of a previous mount can't be used anymore, neither can their maps.
+	if (fs->id != fastseek_fs_id)
+	{
+		fastseek_reset();
+		fastseek_fs_id = fs->id;
+	}
+
+	for (u32 i = 0; i < fastseek_count; i++)
+	{
+		if (fastseek_maps[i].sclust == fp->obj.sclust && fastseek_maps[i].size == fp->obj.objsize)
+		{
+			fp->cltbl = fastseek_maps[i].tbl;
+			return true;
+		}
+	}
+
+	if (fastseek_count == FASTSEEK_MAX_FILES || FASTSEEK_POOL_SIZE - fastseek_used < 4)
+		return false;
+
+	// Build the map in what is left of the pool, then keep only what it used.
+	DWORD *tbl = &fastseek_pool[fastseek_used];
+	tbl[0] = FASTSEEK_POOL_SIZE - fastseek_used;
+	fp->cltbl = tbl;
+	if (f_lseek(fp, CREATE_LINKMAP))
+	{
+		fp->cltbl = NULL;
+		return false;
+	}
+
+	fastseek_maps[fastseek_count].sclust = fp->obj.sclust;
+	fastseek_maps[fastseek_count].size   = fp->obj.objsize;
+	fastseek_maps[fastseek_count].tbl    = tbl;
+	fastseek_count++;
+	fastseek_used += tbl[0];
+
+	return true;
+}
@@ -0,0 +1,19 @@
+#ifndef FASTSEEK_H
+#define FASTSEEK_H
+
+#include <libs/fatfs/ff.h>
+#include <utils/types.h>
+
+#define FASTSEEK_POOL_SIZE 8192 // DWORDs shared by every cluster map. A contiguous file needs 4.
+#define FASTSEEK_MAX_FILES 16
+
+// Takes the pool from the heap. Call once at boot, before any action arena. Files seek the normal way until then.
+bool fastseek_init();
+// Gives an opened SD file a cluster map, built on first use and kept until the SD is remounted.
+// Seeks then skip the FAT chain walk. Returns false when the pool is full, the file seeks the normal way.
+// Only for files that keep their size while open, a mapped file can't grow.
+bool fastseek_attach(FIL *fp);
+// Drops every map. Needed when files are deleted and recreated without a remount.
+void fastseek_reset();
+
+#endif
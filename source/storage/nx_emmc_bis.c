@@ -28,6 +28,8 @@
 #include <storage/sdmmc.h>
 #include <utils/types.h>
 
+#include "nx_emmc_bis.h"
+
 #define BIS_CLUSTER_SECTORS   32
 #define BIS_CLUSTER_SIZE      16384
 #define BIS_CACHE_MAX_ENTRIES 16384
@@ -50,16 +52,47 @@ typedef struct _bis_cache_t
 	cluster_cache_t clusters[];
 } bis_cache_t;
 
-static u8  ks_crypt = 0;
-static u8  ks_tweak = 0;
-static u32 emu_offset = 0;
-static emmc_part_t *system_part = NULL;
+typedef struct _bis_ctx_t
+{
+	emmc_part_t *part;
+	u32  emu_offset;
+	bool sysmmc; // Physical eMMC, even while emuMMC is enabled.
+	u8   ks_crypt;
+	u8   ks_tweak;
+	u32  prev_cluster;
+	u32  prev_sector;
+	u8   tweak[SE_KEY_128_SIZE] __attribute__((aligned(4)));
+} bis_ctx_t;
+
+// Context 0 is the only one that can use the cluster cache.
+static bis_ctx_t bis_ctxs[NX_EMMC_BIS_CTX_MAX];
 static u32 *cache_lookup_tbl = (u32 *)NX_BIS_LOOKUP_ADDR;
 static bis_cache_t *bis_cache = (bis_cache_t *)NX_BIS_CACHE_ADDR;
 
-static int nx_emmc_bis_write_block(u32 sector, u32 count, void *buff, bool flush)
+static int _nx_emmc_bis_part_io(bis_ctx_t *ctx, bool write, u32 sector, u32 count, void *buff)
+{
+	if (ctx->emu_offset)
+	{
+		sector += ctx->emu_offset + ctx->part->lba_start;
+		return write ? sdmmc_storage_write(&sd_storage, sector, count, buff) : sdmmc_storage_read(&sd_storage, sector, count, buff);
+	}
+
+	if (ctx->sysmmc)
+	{
+		// The last LBA is inclusive.
+		if (ctx->part->lba_start + sector > ctx->part->lba_end)
+			return 1;
+
+		sector += ctx->part->lba_start;
+		return write ? sdmmc_storage_write(&emmc_storage, sector, count, buff) : sdmmc_storage_read(&emmc_storage, sector, count, buff);
+	}
+
+	return write ? emmc_part_write(ctx->part, sector, count, buff) : emmc_part_read(ctx->part, sector, count, buff);
+}
+
+static int nx_emmc_bis_write_block(bis_ctx_t *ctx, u32 sector, u32 count, void *buff, bool flush)
 {
-	if (!system_part)
+	if (!ctx->part)
 		return 3; // Not ready.
 
 	int res;
@@ -67,7 +100,7 @@ static int nx_emmc_bis_write_block(u32 sector, u32 count, void *buff, bool flush
 	u32  cluster = sector / BIS_CLUSTER_SECTORS;
 	u32  aligned_sector = cluster * BIS_CLUSTER_SECTORS;
 	u32  sector_in_cluster = sector % BIS_CLUSTER_SECTORS;
-	u32  lookup_idx = cache_lookup_tbl[cluster];
+	u32  lookup_idx = ctx == bis_ctxs ? cache_lookup_tbl[cluster] : (u32)BIS_CACHE_LOOKUP_TBL_EMPTY_ENTRY;
 	bool is_cached = lookup_idx != (u32)BIS_CACHE_LOOKUP_TBL_EMPTY_ENTRY;
 
 	// Write to cached cluster.
@@ -91,14 +124,10 @@ static int nx_emmc_bis_write_block(u32 sector, u32 count, void *buff, bool flush
 	}
 
 	// Encrypt cluster.
-	if (se_aes_crypt_xts_sec_nx(ks_tweak, ks_crypt, ENCRYPT, cluster, tweak, true, sector_in_cluster, bis_cache->dma_buff, buff, count * EMMC_BLOCKSIZE))
+	if (se_aes_crypt_xts_sec_nx(ctx->ks_tweak, ctx->ks_crypt, ENCRYPT, cluster, tweak, true, sector_in_cluster, bis_cache->dma_buff, buff, count * EMMC_BLOCKSIZE))
 		return 1; // Encryption error.
 
-	// If not reading from cache, do a regular read and decrypt.
-	if (!emu_offset)
-		res = emmc_part_write(system_part, sector, count, bis_cache->dma_buff);
-	else
-		res = sdmmc_storage_write(&sd_storage, emu_offset + system_part->lba_start + sector, count, bis_cache->dma_buff);
+	res = _nx_emmc_bis_part_io(ctx, true, sector, count, bis_cache->dma_buff);
 	if (res)
 		return 1; // R/W error.
 
@@ -114,7 +143,7 @@ static int nx_emmc_bis_write_block(u32 sector, u32 count, void *buff, bool flush
 
 static void _nx_emmc_bis_cluster_cache_init(bool enable_cache)
 {
-	u32 cache_lookup_tbl_size = (system_part->lba_end - system_part->lba_start + 1) / BIS_CLUSTER_SECTORS * sizeof(*cache_lookup_tbl);
+	u32 cache_lookup_tbl_size = (bis_ctxs[0].part->lba_end - bis_ctxs[0].part->lba_start + 1) / BIS_CLUSTER_SECTORS * sizeof(*cache_lookup_tbl);
 
 	// Clear cache header.
 	memset(bis_cache, 0, sizeof(bis_cache_t));
@@ -134,7 +163,7 @@ static void _nx_emmc_bis_flush_cache()
 	for (u32 i = 0; i < bis_cache->top_idx && bis_cache->dirty_cnt; i++)
 	{
 		if (bis_cache->clusters[i].dirty) {
-			nx_emmc_bis_write_block(bis_cache->clusters[i].cluster_idx * BIS_CLUSTER_SECTORS, BIS_CLUSTER_SECTORS, NULL, true);
+			nx_emmc_bis_write_block(bis_ctxs, bis_cache->clusters[i].cluster_idx * BIS_CLUSTER_SECTORS, BIS_CLUSTER_SECTORS, NULL, true);
 			bis_cache->dirty_cnt--;
 		}
 	}
@@ -142,12 +171,8 @@ static void _nx_emmc_bis_flush_cache()
 	_nx_emmc_bis_cluster_cache_init(true);
 }
 
-static int nx_emmc_bis_read_block_normal(u32 sector, u32 count, void *buff)
+static int nx_emmc_bis_read_block_normal(bis_ctx_t *ctx, u32 sector, u32 count, void *buff)
 {
-	static u32 prev_cluster = -1;
-	static u32 prev_sector = 0;
-	static u8  tweak[SE_KEY_128_SIZE] __attribute__((aligned(4)));
-
 	int  res;
 	bool regen_tweak = true;
 	u32  tweak_exp = 0;
@@ -155,37 +180,34 @@ static int nx_emmc_bis_read_block_normal(u32 sector, u32 count, void *buff)
 	u32  sector_in_cluster = sector % BIS_CLUSTER_SECTORS;
 
 	// If not reading from cache, do a regular read and decrypt.
-	if (!emu_offset)
-		res = emmc_part_read(system_part, sector, count, bis_cache->dma_buff);
-	else
-		res = sdmmc_storage_read(&sd_storage, emu_offset + system_part->lba_start + sector, count, bis_cache->dma_buff);
+	res = _nx_emmc_bis_part_io(ctx, false, sector, count, bis_cache->dma_buff);
 	if (res)
 		return 1; // R/W error.
 
-	if (prev_cluster != cluster) // Sector in different cluster than last read.
+	if (ctx->prev_cluster != cluster) // Sector in different cluster than last read.
 	{
-		prev_cluster = cluster;
+		ctx->prev_cluster = cluster;
 		tweak_exp = sector_in_cluster;
 	}
-	else if (sector > prev_sector) // Sector in same cluster and past last sector.
+	else if (sector > ctx->prev_sector) // Sector in same cluster and past last sector.
 	{
 		// Calculates the new tweak using the saved one, reducing expensive _gf256_mul_x_le calls.
-		tweak_exp = sector - prev_sector - 1;
+		tweak_exp = sector - ctx->prev_sector - 1;
 		regen_tweak = false;
 	}
 	else // Sector in same cluster and before or same as last sector.
 		tweak_exp = sector_in_cluster;
 
 	// Maximum one cluster (1 XTS crypto block 16KB).
-	if (se_aes_crypt_xts_sec_nx(ks_tweak, ks_crypt, DECRYPT, prev_cluster, tweak, regen_tweak, tweak_exp, buff, bis_cache->dma_buff, count * EMMC_BLOCKSIZE))
+	if (se_aes_crypt_xts_sec_nx(ctx->ks_tweak, ctx->ks_crypt, DECRYPT, ctx->prev_cluster, ctx->tweak, regen_tweak, tweak_exp, buff, bis_cache->dma_buff, count * EMMC_BLOCKSIZE))
 		return 1; // R/W error.
 
-	prev_sector = sector + count - 1;
+	ctx->prev_sector = sector + count - 1;
 
 	return 0; // Success.
 }
 
-static int nx_emmc_bis_read_block_cached(u32 sector, u32 count, void *buff)
+static int nx_emmc_bis_read_block_cached(bis_ctx_t *ctx, u32 sector, u32 count, void *buff)
 {
 	int res;
 	u8  cache_tweak[SE_KEY_128_SIZE] __attribute__((aligned(4)));
@@ -212,15 +234,12 @@ static int nx_emmc_bis_read_block_cached(u32 sector, u32 count, void *buff)
 	cache_lookup_tbl[cluster] = bis_cache->top_idx;
 
 	// Read the whole cluster the sector resides in.
-	if (!emu_offset)
-		res = emmc_part_read(system_part, cluster_sector, BIS_CLUSTER_SECTORS, bis_cache->dma_buff);
-	else
-		res = sdmmc_storage_read(&sd_storage, emu_offset + system_part->lba_start + cluster_sector, BIS_CLUSTER_SECTORS, bis_cache->dma_buff);
+	res = _nx_emmc_bis_part_io(ctx, false, cluster_sector, BIS_CLUSTER_SECTORS, bis_cache->dma_buff);
 	if (res)
 		return 1; // R/W error.
 
 	// Decrypt cluster.
-	if (se_aes_crypt_xts_sec_nx(ks_tweak, ks_crypt, DECRYPT, cluster, cache_tweak, true, 0, bis_cache->dma_buff, bis_cache->dma_buff, BIS_CLUSTER_SIZE))
+	if (se_aes_crypt_xts_sec_nx(ctx->ks_tweak, ctx->ks_crypt, DECRYPT, cluster, cache_tweak, true, 0, bis_cache->dma_buff, bis_cache->dma_buff, BIS_CLUSTER_SIZE))
 		return 1; // Decryption error.
 
 	// Copy to cluster cache.
@@ -233,19 +252,20 @@ static int nx_emmc_bis_read_block_cached(u32 sector, u32 count, void *buff)
 	return 0; // Success.
 }
 
-static int nx_emmc_bis_read_block(u32 sector, u32 count, void *buff)
+static int nx_emmc_bis_read_block(bis_ctx_t *ctx, u32 sector, u32 count, void *buff)
 {
-	if (!system_part)
+	if (!ctx->part)
 		return 3; // Not ready.
 
-	if (bis_cache->enabled)
-		return nx_emmc_bis_read_block_cached(sector, count, buff);
+	if (ctx == bis_ctxs && bis_cache->enabled)
+		return nx_emmc_bis_read_block_cached(ctx, sector, count, buff);
 	else
-		return nx_emmc_bis_read_block_normal(sector, count, buff);
+		return nx_emmc_bis_read_block_normal(ctx, sector, count, buff);
 }
 
-int nx_emmc_bis_read(u32 sector, u32 count, void *buff)
+int nx_emmc_bis_read_ex(u32 ctx_idx, u32 sector, u32 count, void *buff)
 {
+	bis_ctx_t *ctx = &bis_ctxs[ctx_idx];
 	u8 *buf = (u8 *)buff;
 	u32 curr_sct = sector;
 
@@ -257,7 +277,7 @@ int nx_emmc_bis_read(u32 sector, u32 count, void *buff)
 
 		u32 sct_cnt = MIN(count, cnt_max); // Only allow cluster sized access.
 
-		if (nx_emmc_bis_read_block(curr_sct, sct_cnt, buf))
+		if (nx_emmc_bis_read_block(ctx, curr_sct, sct_cnt, buf))
 			return 1;
 
 		count    -= sct_cnt;
@@ -268,8 +288,9 @@ int nx_emmc_bis_read(u32 sector, u32 count, void *buff)
 	return 0;
 }
 
-int nx_emmc_bis_write(u32 sector, u32 count, void *buff)
+int nx_emmc_bis_write_ex(u32 ctx_idx, u32 sector, u32 count, void *buff)
 {
+	bis_ctx_t *ctx = &bis_ctxs[ctx_idx];
 	u8 *buf = (u8 *)buff;
 	u32 curr_sct = sector;
 
@@ -281,7 +302,7 @@ int nx_emmc_bis_write(u32 sector, u32 count, void *buff)
 
 		u32 sct_cnt = MIN(count, cnt_max); // Only allow cluster sized access.
 
-		if (nx_emmc_bis_write_block(curr_sct, sct_cnt, buf, false))
+		if (nx_emmc_bis_write_block(ctx, curr_sct, sct_cnt, buf, false))
 			return 1;
 
 		count    -= sct_cnt;
@@ -292,34 +313,68 @@ int nx_emmc_bis_write(u32 sector, u32 count, void *buff)
 	return 0;
 }
 
-void nx_emmc_bis_init(emmc_part_t *part, bool enable_cache, u32 emummc_offset)
+int nx_emmc_bis_read(u32 sector, u32 count, void *buff)
 {
-	system_part = part;
-	emu_offset = emummc_offset;
+	return nx_emmc_bis_read_ex(0, sector, count, buff);
+}
 
-	_nx_emmc_bis_cluster_cache_init(enable_cache);
+int nx_emmc_bis_write(u32 sector, u32 count, void *buff)
+{
+	return nx_emmc_bis_write_ex(0, sector, count, buff);
+}
+
+void nx_emmc_bis_init_ex(u32 ctx_idx, emmc_part_t *part, bool enable_cache, u32 emummc_offset, bool sysmmc)
+{
+	bis_ctx_t *ctx = &bis_ctxs[ctx_idx];
+
+	ctx->part = part;
+	ctx->emu_offset = emummc_offset;
+	ctx->sysmmc = sysmmc;
+	ctx->prev_cluster = -1;
+	ctx->prev_sector = 0;
+
+	if (ctx == bis_ctxs)
+		_nx_emmc_bis_cluster_cache_init(enable_cache);
 
 	if (!strcmp(part->name, "PRODINFO") || !strcmp(part->name, "PRODINFOF"))
 	{
-		ks_crypt = 0;
-		ks_tweak = 1;
+		ctx->ks_crypt = 0;
+		ctx->ks_tweak = 1;
 	}
 	else if (!strcmp(part->name, "SAFE"))
 	{
-		ks_crypt = 2;
-		ks_tweak = 3;
+		ctx->ks_crypt = 2;
+		ctx->ks_tweak = 3;
 	}
 	else if (!strcmp(part->name, "SYSTEM") || !strcmp(part->name, "USER"))
 	{
-		ks_crypt = 4;
-		ks_tweak = 5;
+		ctx->ks_crypt = 4;
+		ctx->ks_tweak = 5;
 	}
 	else
-		system_part = NULL;
+		ctx->part = NULL;
+}
+
+void nx_emmc_bis_init(emmc_part_t *part, bool enable_cache, u32 emummc_offset)
+{
+	nx_emmc_bis_init_ex(0, part, enable_cache, emummc_offset, false);
+}
+
+u32 nx_emmc_bis_sectors_ex(u32 ctx_idx)
+{
+	emmc_part_t *part = bis_ctxs[ctx_idx].part;
+
+	return part ? part->lba_end - part->lba_start + 1 : 0;
+}
+
+void nx_emmc_bis_end_ex(u32 ctx_idx)
+{
+	if (!ctx_idx)
+		_nx_emmc_bis_flush_cache();
+	bis_ctxs[ctx_idx].part = NULL;
 }
 
 void nx_emmc_bis_end()
 {
-	_nx_emmc_bis_flush_cache();
-	system_part = NULL;
+	nx_emmc_bis_end_ex(0);
 }
@@ -245,8 +245,16 @@ typedef struct _nx_emmc_cal0_t
 #define NX_EMMC_CALIBRATION_SIZE   0x8000
 #define XTS_CLUSTER_SIZE           0x4000
 
+// Context 0 backs "bis:" and the calls without a context. Context 1 backs "bis2:".
+#define NX_EMMC_BIS_CTX_MAX 2
+
 int  nx_emmc_bis_read(u32 sector, u32 count, void *buff);
 int  nx_emmc_bis_write(u32 sector, u32 count, void *buff);
 void nx_emmc_bis_init(emmc_part_t *part, bool enable_cache, u32 emummc_offset);
 void nx_emmc_bis_end();
+int  nx_emmc_bis_read_ex(u32 ctx_idx, u32 sector, u32 count, void *buff);
+int  nx_emmc_bis_write_ex(u32 ctx_idx, u32 sector, u32 count, void *buff);
+void nx_emmc_bis_init_ex(u32 ctx_idx, emmc_part_t *part, bool enable_cache, u32 emummc_offset, bool sysmmc);
+void nx_emmc_bis_end_ex(u32 ctx_idx);
+u32  nx_emmc_bis_sectors_ex(u32 ctx_idx);
 #endif
@@ -0,0 +1,165 @@
+#include <string.h>
+
+#include "ums_bis.h"
+#include <mem/heap.h>
+
+#define UMS_BIS_RA_SECTORS (UMS_BIS_RA_CLUSTERS * UMS_BIS_CLUSTER_SECTORS)
+
+int ums_bis_init(ums_bis_t *lun, u32 sectors, ums_bis_io_t read, ums_bis_io_t write)
+{
+	memset(lun, 0, sizeof(*lun));
+	lun->read    = read;
+	lun->write   = write;
+	lun->sectors = sectors;
+	lun->ra_next = 0xFFFFFFFF;
+
+	lun->ra_buf = malloc(UMS_BIS_RA_SECTORS * UMS_BIS_SECTOR_SIZE);
+	lun->wr_buf = malloc(UMS_BIS_CLUSTER_SIZE);
+
+	if (!lun->ra_buf || !lun->wr_buf)
+	{
+		ums_bis_end(lun);
+		return 1;
+	}
+
+	return 0;
+}
+
+int ums_bis_end(ums_bis_t *lun)
+{
+	int res = ums_bis_flush(lun);
+
+	free(lun->ra_buf);
+	free(lun->wr_buf);
+
+	return res;
+}
+
+// Mask of a complete cluster. The last one of a partition can be short.
+static u32 _ums_bis_full_mask(ums_bis_t *lun, u32 cluster)
+{
+	u32 count = MIN(UMS_BIS_CLUSTER_SECTORS, lun->sectors - cluster * UMS_BIS_CLUSTER_SECTORS);
+
+	return count == 32 ? 0xFFFFFFFF : BIT(count) - 1;
+}
+
+int ums_bis_flush(void *priv)
+{
+	ums_bis_t *lun = (ums_bis_t *)priv;
+
+	if (!lun->wr_mask)
+		return 0;
+
+	u32 sector = lun->wr_cluster * UMS_BIS_CLUSTER_SECTORS;
+	u32 count  = MIN(UMS_BIS_CLUSTER_SECTORS, lun->sectors - sector);
+
+	// Fill the holes the host left from storage, so the cluster goes down in one write.
+	if (lun->wr_mask != _ums_bis_full_mask(lun, lun->wr_cluster))
+	{
+		lun->ra_count = 0;
+		if (lun->read(sector, count, lun->ra_buf))
+			return 1;
+
+		for (u32 i = 0; i < count; i++)
+		{
+			if (!(lun->wr_mask & BIT(i)))
+				memcpy(lun->wr_buf + i * UMS_BIS_SECTOR_SIZE, lun->ra_buf + i * UMS_BIS_SECTOR_SIZE, UMS_BIS_SECTOR_SIZE);
+		}
+	}
+
+	lun->wr_mask = 0;
+
+	return lun->write(sector, count, lun->wr_buf);
+}
+
+int ums_bis_read(void *priv, u32 sector, u32 count, void *buf)
+{
+	ums_bis_t *lun = (ums_bis_t *)priv;
+	u8 *dst = (u8 *)buf;
+
+	// Pending writes must be visible.
+	u32 wr_sector = lun->wr_cluster * UMS_BIS_CLUSTER_SECTORS;
+	if (lun->wr_mask && sector < wr_sector + UMS_BIS_CLUSTER_SECTORS && sector + count > wr_sector)
+	{
+		if (ums_bis_flush(lun))
+			return 1;
+	}
+
+	bool sequential = sector == lun->ra_next;
+	lun->ra_next = sector + count;
+
+	while (count)
+	{
+		if (!lun->ra_count || sector < lun->ra_start || sector >= lun->ra_start + lun->ra_count)
+		{
+			// Random reads only pull the clusters they touch. Sequential ones fill the whole window.
+			u32 start = ALIGN_DOWN(sector, UMS_BIS_CLUSTER_SECTORS);
+			u32 want  = sequential ? UMS_BIS_RA_SECTORS : ALIGN(sector + count, UMS_BIS_CLUSTER_SECTORS) - start;
+
+			lun->ra_start = start;
+			lun->ra_count = MIN(MIN(want, UMS_BIS_RA_SECTORS), lun->sectors - start);
+			if (lun->read(lun->ra_start, lun->ra_count, lun->ra_buf))
+			{
+				lun->ra_count = 0;
+				return 1;
+			}
+		}
+
+		u32 offset = sector - lun->ra_start;
+		u32 num = MIN(count, lun->ra_count - offset);
+		memcpy(dst, lun->ra_buf + offset * UMS_BIS_SECTOR_SIZE, num * UMS_BIS_SECTOR_SIZE);
+
+		dst    += num * UMS_BIS_SECTOR_SIZE;
+		sector += num;
+		count  -= num;
+	}
+
+	return 0;
+}
+
+int ums_bis_write(void *priv, u32 sector, u32 count, void *buf)
+{
+	ums_bis_t *lun = (ums_bis_t *)priv;
+	u8 *src = (u8 *)buf;
+
+	// Drop read-ahead data this write makes stale.
+	if (lun->ra_count && sector < lun->ra_start + lun->ra_count && sector + count > lun->ra_start)
+		lun->ra_count = 0;
+
+	while (count)
+	{
+		u32 cluster = sector / UMS_BIS_CLUSTER_SECTORS;
+		u32 index   = sector % UMS_BIS_CLUSTER_SECTORS;
+		u32 num     = MIN(count, UMS_BIS_CLUSTER_SECTORS - index);
+
+		if (!index && num == UMS_BIS_CLUSTER_SECTORS)
+		{
+			// Whole clusters go straight down in one call.
+			num = ALIGN_DOWN(count, UMS_BIS_CLUSTER_SECTORS);
+			if (lun->wr_mask && lun->wr_cluster >= cluster && lun->wr_cluster < cluster + num / UMS_BIS_CLUSTER_SECTORS)
+				lun->wr_mask = 0;
+
+			if (lun->write(sector, num, src))
+				return 1;
+		}
+		else
+		{
+			// Partial clusters are gathered until complete or until the host moves to another one.
+			if (lun->wr_mask && lun->wr_cluster != cluster && ums_bis_flush(lun))
+				return 1;
+
+			lun->wr_cluster = cluster;
+			memcpy(lun->wr_buf + index * UMS_BIS_SECTOR_SIZE, src, num * UMS_BIS_SECTOR_SIZE);
+			lun->wr_mask |= (BIT(num) - 1) << index;
+
+			if (lun->wr_mask == _ums_bis_full_mask(lun, cluster) && ums_bis_flush(lun))
+				return 1;
+		}
+
+		src    += num * UMS_BIS_SECTOR_SIZE;
+		sector += num;
+		count  -= num;
+	}
+
+	return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef UMS_BIS_H
+#define UMS_BIS_H
+
+#include <utils/types.h>
+
+#define UMS_BIS_SECTOR_SIZE     512
+#define UMS_BIS_CLUSTER_SECTORS 32 // One XTS cluster, same as the BIS layer.
+#define UMS_BIS_CLUSTER_SIZE    (UMS_BIS_CLUSTER_SECTORS * UMS_BIS_SECTOR_SIZE)
+#define UMS_BIS_RA_CLUSTERS     16
+
+// Decrypted partition access. 0 on success, like nx_emmc_bis_read/write.
+typedef int (*ums_bis_io_t)(u32 sector, u32 count, void *buf);
+
+typedef struct _ums_bis_t
+{
+	ums_bis_io_t read;
+	ums_bis_io_t write;
+	u32 sectors;
+
+	u8 *ra_buf;
+	u32 ra_start;
+	u32 ra_count;
+	u32 ra_next; // Sector following the last host read, to spot sequential access.
+
+	u8 *wr_buf;
+	u32 wr_cluster;
+	u32 wr_mask; // Sectors of wr_cluster already filled by the host.
+} ums_bis_t;
+
+int  ums_bis_init(ums_bis_t *lun, u32 sectors, ums_bis_io_t read, ums_bis_io_t write);
+int  ums_bis_end(ums_bis_t *lun);
+int  ums_bis_read(void *priv, u32 sector, u32 count, void *buf);
+int  ums_bis_write(void *priv, u32 sector, u32 count, void *buf);
+int  ums_bis_flush(void *priv);
+
+#endif
@@ -3,19 +3,25 @@
 
 #include "tools.h"
 #include "config.h"
+#include "dump/dump_fmt.h"
 #include <gfx_utils.h>
 #include "gfx/tui.h"
 #include "keys/keys.h"
+#include <libs/fatfs/diskio.h>
 #include <libs/fatfs/ff.h>
 #include <mem/heap.h>
 #include <sec/se.h>
 #include <soc/hw_init.h>
 #include <soc/timer.h>
 #include "storage/emummc.h"
+#include "perf/perf_mode.h"
+#include "storage/fastseek.h"
 #include <storage/emmc.h>
 #include "storage/nx_emmc_bis.h"
+#include "storage/ums_bis.h"
 #include <storage/sd.h>
 #include <storage/sdmmc.h>
+#include <usb/usbd.h>
 #include <utils/btn.h>
 #include <utils/ini.h>
 #include <utils/list.h>
@@ -311,26 +317,62 @@ void emunand_list_free() {
 	emunand_count = 0;
 }
 
+#define DEBUG_LOG_PATH     "sd:/locksmith-rcm.log"
+#define DEBUG_LOG_LINE_MAX 4096
+#define DEBUG_LOG_BUF_SIZE SZ_32K
+
+// The log file stays open between flushes and lines are gathered in a heap buffer.
+static FIL debug_log_file;
+static bool debug_log_opened = false;
+static char *debug_log_buf = NULL;
+static u32 debug_log_len = 0;
+
+static void _debug_log_put(const char *data, u32 size) {
+	UINT bw;
+
+	// The handle goes stale when the SD is remounted, reopen it then.
+	if (!debug_log_opened || f_write(&debug_log_file, data, size, &bw) != FR_OK) {
+		debug_log_opened = !f_open(&debug_log_file, DEBUG_LOG_PATH, FA_OPEN_APPEND | FA_WRITE);
+		if (!debug_log_opened || f_write(&debug_log_file, data, size, &bw) != FR_OK)
+			return;
+	}
+	f_sync(&debug_log_file);
+}
+
 void debug_log_start_impl() {
-	FIL debug_log_file;
-	f_open(&debug_log_file, "sd:/locksmith-rcm.log", FA_CREATE_ALWAYS | FA_WRITE);
-	f_close(&debug_log_file);
+	debug_log_opened = !f_open(&debug_log_file, DEBUG_LOG_PATH, FA_CREATE_ALWAYS | FA_WRITE);
+	// Allocated once at boot, outside of any action arena.
+	if (!debug_log_buf)
+		debug_log_buf = malloc(DEBUG_LOG_BUF_SIZE);
+	debug_log_len = 0;
 }
 
-void debug_log_write_impl(const char *text, ...) {
-	FIL debug_log_file;
-	UINT bw;
+void debug_log_flush_impl() {
+	if (!debug_log_len)
+		return;
+
+	// Dropped if the SD is not there, the buffer must not block logging.
+	_debug_log_put(debug_log_buf, debug_log_len);
+	debug_log_len = 0;
+}
 
-	char buffer[4096];
+void debug_log_write_impl(const char *text, ...) {
+	char buffer[DEBUG_LOG_LINE_MAX];
 	va_list args;
 	va_start(args, text);
 	s_vprintf(buffer, text, args);
 	va_end(args);
 
-	f_open(&debug_log_file, "sd:/locksmith-rcm.log", FA_OPEN_APPEND | FA_WRITE);
-	f_write(&debug_log_file, buffer, strlen(buffer), &bw);
-	// f_sync(&debug_log_file);
-	f_close(&debug_log_file);
+	u32 len = strlen(buffer);
+	if (!debug_log_buf) {
+		_debug_log_put(buffer, len);
+		return;
+	}
+
+	if (debug_log_len + len > DEBUG_LOG_BUF_SIZE)
+		debug_log_flush_impl();
+	memcpy(debug_log_buf + debug_log_len, buffer, len);
+	debug_log_len += len;
 }
 
 static bool part_is_encrypted(emmc_part_t *part) {
@@ -529,6 +571,7 @@ void ui_spinner_draw() {
 	if (get_tmr_ms() < spinner_timer_count) {
 		return;
 	}
+	perf_mode_tick();
 	const char spin_chars[] = "-----";
 
 	gfx_con_setpos(spinner_pos.x, spinner_pos.y);
@@ -581,10 +624,56 @@ static bool sd_has_enough_space(u64 required_bytes) {
 }
 */
 
-bool flash_or_dump_part(bool flash, const char *sd_filepath, const char *part_name, bool bis_read_or_write_enable) {
+int part_io(bool write, bool bis, u32 lba, u32 num, void *buf) {
+	if (bis)
+		return write ? nx_emmc_bis_write(lba, num, buf) : nx_emmc_bis_read(lba, num, buf);
+	return write ? emummc_storage_write(lba, num, buf) : emummc_storage_read(lba, num, buf);
+}
+
+typedef enum {
+	DUMP_FMT_RAW,
+	DUMP_FMT_SPARSE,
+#ifdef LS_LZ4_DUMPS
+	DUMP_FMT_LZ4
+#endif
+} dump_fmt_t;
+
+// Reads what the partition already holds and only writes the sector runs that differ from src.
+static int _flash_diff(bool bis, u32 lba, u32 num, u8 *src, u8 *cur, u32 *written, u32 *skipped) {
+	// Unreadable range, just write it all.
+	if (part_io(false, bis, lba, num, cur)) {
+		*written += num;
+		return part_io(true, bis, lba, num, src);
+	}
+
+	for (u32 i = 0; i < num;) {
+		if (!memcmp(src + i * EMMC_BLOCKSIZE, cur + i * EMMC_BLOCKSIZE, EMMC_BLOCKSIZE)) {
+			(*skipped)++;
+			i++;
+			continue;
+		}
+		u32 end = i + 1;
+		while (end < num && memcmp(src + end * EMMC_BLOCKSIZE, cur + end * EMMC_BLOCKSIZE, EMMC_BLOCKSIZE))
+			end++;
+		if (part_io(true, bis, lba + i, end - i, src + i * EMMC_BLOCKSIZE))
+			return 1;
+		*written += end - i;
+		i = end;
+	}
+	return 0;
+}
+
+static bool _flash_or_dump_part_io(bool flash, const char *sd_filepath, const char *part_name, bool bis_read_or_write_enable, dump_fmt_t fmt, const char *base_path, bool compare) {
 	if (bis_read_or_write_enable && !bis_loaded) {
 		return false;
 	}
+	bool sparse = fmt == DUMP_FMT_SPARSE;
+#ifdef LS_LZ4_DUMPS
+	bool lz4 = fmt == DUMP_FMT_LZ4;
+#else
+	bool lz4 = false;
+#endif
+	lz4c_t lz = {0};
 	bool is_boot = false;
 	bool use_bis = false;
 	u64 part_size_bytes = 0;
@@ -593,9 +682,16 @@ bool flash_or_dump_part(bool flash, const char *sd_filepath, const char *part_na
 	emmc_part_t part;
 	u64 filesize = 0;
 	u8 *buff = NULL;
+	u8 *cmp_buff = NULL;
+	u32 sectors_written = 0, sectors_skipped = 0;
+	u32 direct_sector = 0;
+	FIL mf;
+	char mpath[256];
+	sha_stream_t sha = {0};
 
 bool return_value = false;
 bool file_is_closed = true;
+bool manifest_is_closed = true;
 
 	sd_mount();
 
@@ -614,10 +710,40 @@ bool file_is_closed = true;
 			f_close(&fp);
 			return return_value;
 		}
+		u32 magic = 0;
+		UINT br;
+		if (!f_read(&fp, &magic, sizeof(magic), &br) && br == sizeof(magic)) {
+			sparse = magic == SPARSE_MAGIC;
+			lz4 = magic == LZ4C_MAGIC;
+		}
+		f_lseek(&fp, 0);
+		if (lz4) {
+#ifdef LS_LZ4_DUMPS
+			if (!lz4c_open(&lz, &fp)) {
+				log_printf(true, LOG_ERR, LOG_MSG_DUMP_BAD_FILE, sd_filepath);
+				lz4c_free(&lz);
+				f_close(&fp);
+				return return_value;
+			}
+			filesize = lz.hdr.raw_size;
+#else
+			log_printf(true, LOG_ERR, LOG_MSG_LZ4_NOT_BUILT, sd_filepath);
+			f_close(&fp);
+			return return_value;
+#endif
+		}
 	} else {
 	log_printf(true, LOG_INFO, LOG_MSG_DUMP_PARTITION_BEGIN, part_name, sd_filepath);
 	}
 
+	// cal0_read and verifyProdinfo read the file on the SD card as a raw image.
+	if ((sparse || lz4) && strcmp(part_name, "PRODINFO") == 0) {
+		log_printf(true, LOG_ERR, LOG_MSG_PRODINFO_RAW_ONLY, sd_filepath);
+		if (flash) f_close(&fp);
+		lz4c_free(&lz);
+		return return_value;
+	}
+
 	LIST_INIT(gpt);
 	bool test_part;
 	if (!bis_read_or_write_enable) {
@@ -627,12 +753,15 @@ bool file_is_closed = true;
 	}
 	if (!test_part) {
 		if (flash) f_close(&fp);
+		lz4c_free(&lz);
 		return return_value;
 	}
 
-	buff = (BYTE*)malloc(COPY_BUF_SIZE);
+	buff = (BYTE*)sdmmc_dma_alloc(COPY_BUF_SIZE);
+	if (flash && compare)
+		cmp_buff = (BYTE*)sdmmc_dma_alloc(COPY_BUF_SIZE);
 	bool file_is_created = false;
-	if (!buff) {
+	if (!buff || (flash && compare && !cmp_buff)) {
 		log_printf(true, LOG_ERR, LOG_MSG_MALLOC_ERROR);
 		goto cleanup;
 	}
@@ -667,7 +796,11 @@ bool file_is_closed = true;
 			}
 		}
 	}
-	if (flash) {
+	if (sparse && (part_size_bytes % SPARSE_CLUSTER_SIZE) != 0) {
+		log_printf(true, LOG_ERR, LOG_MSG_DUMP_PARTITION_NOT_ALLIGNED);
+		goto cleanup;
+	}
+	if (flash && !sparse) {
 		if (filesize > part_size_bytes) {
 			log_printf(true, LOG_ERR, LOG_MSG_FLASH_PARTITION_FILE_TO_BIG);
 			goto cleanup;
@@ -677,7 +810,7 @@ bool file_is_closed = true;
 			log_printf(true, LOG_ERR, LOG_MSG_FLASH_PARTITION_FILE_NOT_ALLIGNED);
 			goto cleanup;
 		}
-	} else {
+	} else if (!flash) {
 		if ((part_size_bytes % EMMC_BLOCKSIZE) != 0) {
 			log_printf(true, LOG_ERR, LOG_MSG_DUMP_PARTITION_NOT_ALLIGNED);
 			goto cleanup;
@@ -701,9 +834,39 @@ bool file_is_closed = true;
 			file_is_closed = false;
 		}
 		file_is_created = true;
+		// Deleted files may have left their clusters to this one, forget their maps.
+		fastseek_reset();
+		// A raw dump has a known size. Reserve it in one contiguous run and write the SD sectors directly,
+		// so FatFs doesn't allocate and link clusters chunk after chunk. Fragmented SD keeps the f_write path.
+		if (fmt == DUMP_FMT_RAW && fp.obj.fs->pdrv == DRIVE_SD && !f_expand(&fp, part_size_bytes, 1)) {
+			direct_sector = fp.obj.fs->database + (fp.obj.sclust - 2) * fp.obj.fs->csize;
+			debug_log_write("Dump reserved at SD sector 0x%x\n", direct_sector);
+		}
+		// Named before any failure below so cleanup never unlinks a stale path.
+		s_printf(mpath, "%s%s", sd_filepath, sparse ? SPARSE_HASH_EXT : SHA_MANIFEST_EXT);
+#ifdef LS_LZ4_DUMPS
+		if (lz4 && !lz4c_create(&lz, &fp, part_size_bytes)) {
+			log_printf(true, LOG_ERR, LOG_MSG_DUMP_PARTITION_ERR_PARTITION_WRITE);
+			goto cleanup;
+		}
+#endif
+
+		fr = f_open(&mf, mpath, FA_WRITE | FA_CREATE_ALWAYS);
+		if (fr != FR_OK) {
+			log_printf(true, LOG_ERR, LOG_MSG_ERR_OPEN_FILE, mpath);
+			goto cleanup;
+		} else {
+			manifest_is_closed = false;
+		}
+		// Placeholder for the whole-file line, rewritten once the last block is hashed.
+		memset(sha.hash, 0, SE_SHA_256_SIZE);
+		if (!sparse && !sha_manifest_head(&mf, sha.hash, sd_filepath)) {
+			log_printf(true, LOG_ERR, LOG_MSG_DUMP_PARTITION_ERR_PARTITION_WRITE);
+			goto cleanup;
+		}
 	}
 
-	// bool do_bis_io = (use_bis && bis_read_or_write_enable);
+	bool do_bis_io = (use_bis && bis_read_or_write_enable);
 	u32 lba_start;
 	if (is_boot) {
 		lba_start = 0;
@@ -715,26 +878,50 @@ bool file_is_closed = true;
 	u32 curLba = lba_start;
 	u64 totalSectorsSrc;
 	if (flash) {
-		totalSectorsSrc = f_size(&fp) / EMMC_BLOCKSIZE;
+		totalSectorsSrc = filesize / EMMC_BLOCKSIZE;
 	} else {
 		totalSectorsSrc = part_size_bytes / EMMC_BLOCKSIZE;;
 	}
+	sha.total = totalSectorsSrc * EMMC_BLOCKSIZE;
+
+	// Whatever the flash outcome, the cached CAL0 can't be trusted anymore.
+	if (flash && strcmp(part_name, "PRODINFO") == 0)
+		cal0_cache_invalidate();
 
+	// The source is read for its manifest and then again to flash, or seeked around when sparse or LZ4.
+	if (flash && !fastseek_attach(&fp))
+		debug_log_write("No cluster map for %s\n", sd_filepath);
+
+	u32 start_ms = get_tmr_ms();
 	ui_spinner_begin();
+	if (sparse) {
+		u32 clusters = part_size_bytes / SPARSE_CLUSTER_SIZE;
+		bool sparse_ok = flash ? sparse_restore(&fp, sd_filepath, lba_start, clusters, do_bis_io, buff) :
+			sparse_dump(&fp, &mf, sd_filepath, base_path, lba_start, clusters, do_bis_io, buff);
+		if (!sparse_ok) {
+			ui_spinner_clear();
+			goto cleanup;
+		}
+		totalSectorsSrc = 0;
+	} else if (flash && !sha_manifest_verify(&fp, sd_filepath, buff, lz4 ? &lz : NULL)) {
+		ui_spinner_clear();
+		goto cleanup;
+	}
 	while (totalSectorsSrc > 0){
 		ui_spinner_draw();
 		int Res = 0;
 		u32 num = MIN(totalSectorsSrc, COPY_BUF_SIZE / EMMC_BLOCKSIZE);
 
 		if (flash) {
-			UINT br;
-			if ((f_read(&fp, buff, num * EMMC_BLOCKSIZE, &br))){
+			if (!dump_get(&fp, lz4 ? &lz : NULL, buff, num * EMMC_BLOCKSIZE)) {
 				log_printf(true, LOG_ERR, LOG_MSG_ERR_FILE_READ);
 				ui_spinner_clear();
 				goto cleanup;
 				break;
 			}
-			if (use_bis && bis_read_or_write_enable) {
+			if (compare) {
+				Res = _flash_diff(do_bis_io, curLba, num, buff, cmp_buff, &sectors_written, &sectors_skipped);
+			} else if (use_bis && bis_read_or_write_enable) {
 				Res = nx_emmc_bis_write(curLba, num, buff);
 			} else  {
 				Res = emummc_storage_write(curLba, num, buff);
@@ -756,9 +943,26 @@ bool file_is_closed = true;
 				ui_spinner_clear();
 				goto cleanup;
 			}
-			UINT bw;
-			fr = f_write(&fp, buff, num * EMMC_BLOCKSIZE, &bw);
-			if (fr != FR_OK || bw != num * EMMC_BLOCKSIZE) {
+			int sha_res = sha_stream_start(&sha, buff, num * EMMC_BLOCKSIZE);
+			bool written;
+#ifdef LS_LZ4_DUMPS
+			if (lz4) {
+				written = lz4c_write(&lz, buff, num * EMMC_BLOCKSIZE);
+			} else
+#endif
+			if (direct_sector) {
+				written = !sdmmc_storage_write(&sd_storage, direct_sector, num, buff);
+				direct_sector += num;
+			} else {
+				written = dump_put(&fp, buff, num * EMMC_BLOCKSIZE);
+			}
+			sha_res |= sha_stream_wait(&sha);
+			if (!written || sha_res) {
+				log_printf(true, LOG_ERR, LOG_MSG_DUMP_PARTITION_ERR_PARTITION_WRITE);
+				ui_spinner_clear();
+				goto cleanup;
+			}
+			if (!sha_manifest_mark(&mf, &sha)) {
 				log_printf(true, LOG_ERR, LOG_MSG_DUMP_PARTITION_ERR_PARTITION_WRITE);
 				ui_spinner_clear();
 				goto cleanup;
@@ -769,6 +973,34 @@ bool file_is_closed = true;
 		totalSectorsSrc -= num;
 	}
 
+	if (!flash && !sparse && !lz4) {
+		u32 elapsed_ms = MAX(get_tmr_ms() - start_ms, 1);
+		log_printf(true, LOG_INFO, LOG_MSG_DUMP_PARTITION_SPEED, (u32)(part_size_bytes >> 20), elapsed_ms / 1000,
+			(u32)((part_size_bytes * 1000 / elapsed_ms) >> 20), direct_sector ? "direct SD writes" : "FatFs writes");
+	}
+
+	if (flash && compare && !sparse) {
+		log_printf(true, LOG_INFO, LOG_MSG_FLASH_PARTITION_DIFF_DONE, sectors_written / 2, sectors_skipped / 2);
+	}
+
+	if (!flash) {
+		if ((!sparse && (f_lseek(&mf, 0) || !sha_manifest_head(&mf, sha.hash, sd_filepath))) || f_close(&mf)) {
+			log_printf(true, LOG_ERR, LOG_MSG_DUMP_PARTITION_ERR_PARTITION_WRITE);
+			goto cleanup;
+		}
+		manifest_is_closed = true;
+#ifdef LS_LZ4_DUMPS
+		if (lz4) {
+			u32 packed_mb = f_tell(&fp) >> 20;
+			if (!lz4c_finish(&lz)) {
+				log_printf(true, LOG_ERR, LOG_MSG_DUMP_PARTITION_ERR_PARTITION_WRITE);
+				goto cleanup;
+			}
+			log_printf(true, LOG_INFO, LOG_MSG_LZ4_DUMP_DONE, (u32)(part_size_bytes >> 20), packed_mb);
+		}
+#endif
+	}
+
 	if (strcmp(part_name, "PRODINFO") == 0) {
 		f_close(&fp);
 		file_is_closed = true;
@@ -803,15 +1035,111 @@ bool file_is_closed = true;
 	}
 
 cleanup:
+	if (buff) sdmmc_dma_free(buff);
+	if (cmp_buff) sdmmc_dma_free(cmp_buff);
+	lz4c_free(&lz);
+	if (!file_is_closed) f_close(&fp);
+	if (!manifest_is_closed) f_close(&mf);
 	if (!return_value && file_is_created) {
 		f_unlink(sd_filepath);
+		f_unlink(mpath);
 	}
-	if (buff) free(buff);
-	if (!file_is_closed) f_close(&fp);
 	unmount_nand_part(&gpt, is_boot, use_bis, true, false);
 	return return_value;
 }
 
+static bool _flash_or_dump_part(bool flash, const char *sd_filepath, const char *part_name, bool bis_read_or_write_enable, dump_fmt_t fmt, const char *base_path, bool compare) {
+	perf_mode_enter(part_name);
+	bool res = _flash_or_dump_part_io(flash, sd_filepath, part_name, bis_read_or_write_enable, fmt, base_path, compare);
+	perf_mode_exit();
+	return res;
+}
+
+bool flash_or_dump_part(bool flash, const char *sd_filepath, const char *part_name, bool bis_read_or_write_enable) {
+	return _flash_or_dump_part(flash, sd_filepath, part_name, bis_read_or_write_enable, DUMP_FMT_RAW, NULL, false);
+}
+
+bool flash_part_diff(const char *sd_filepath, const char *part_name, bool bis_read_or_write_enable) {
+	return _flash_or_dump_part(true, sd_filepath, part_name, bis_read_or_write_enable, DUMP_FMT_RAW, NULL, true);
+}
+
+bool dump_part_sparse(const char *sd_filepath, const char *part_name, const char *base_path, bool bis_read_or_write_enable) {
+	return _flash_or_dump_part(false, sd_filepath, part_name, bis_read_or_write_enable, DUMP_FMT_SPARSE, base_path, false);
+}
+
+#ifdef LS_LZ4_DUMPS
+bool dump_part_lz4(const char *sd_filepath, const char *part_name, bool bis_read_or_write_enable) {
+	return _flash_or_dump_part(false, sd_filepath, part_name, bis_read_or_write_enable, DUMP_FMT_LZ4, NULL, false);
+}
+#endif
+
+#ifdef LS_USB_UMS
+static void _usb_ums_set_text(void *label, const char *text) {
+	char line[64];
+	u32 len = 0;
+
+	// Drop the "#RRGGBB " color tags the gadget puts in its status strings.
+	while (*text && len < sizeof(line) - 1) {
+		if (*text == '#') {
+			text++;
+			if (strlen(text) > 7 && text[6] == ' ')
+				text += 7;
+			continue;
+		}
+		line[len++] = *text++;
+	}
+	line[len] = 0;
+
+	u32 *pos = (u32 *)label;
+	gfx_con_setpos(pos[0], pos[1]);
+	gfx_printf("%-48s", line);
+}
+
+static void _usb_ums_maintenance(bool refresh) {
+}
+
+bool usb_mount_bis_part(const char *part_name) {
+	LIST_INIT(gpt);
+	u64 part_size = 0;
+	bool is_boot = false, is_bis = false;
+	bool res = false;
+
+	if (!mount_nand_part(&gpt, part_name, true, true, false, true, &part_size, &is_boot, &is_bis, NULL))
+		return false;
+
+	ums_bis_t lun;
+	usb_ums_backend_t backend = { ums_bis_read, ums_bis_write, ums_bis_flush, &lun };
+	if (!is_bis || ums_bis_init(&lun, part_size / EMMC_BLOCKSIZE, nx_emmc_bis_read, nx_emmc_bis_write)) {
+		log_printf(true, LOG_ERR, LOG_MSG_USB_UMS_ERROR);
+		goto cleanup;
+	}
+
+	log_printf(true, LOG_INFO, LOG_MSG_USB_UMS_BEGIN, part_name);
+	u32 pos[2];
+	gfx_con_getpos(&pos[0], &pos[1]);
+
+	usb_ctxt_t usbs = {0};
+	usbs.type = MMC_EMMC;
+	usbs.partition = EMMC_GPP + 1;
+	usbs.sectors = lun.sectors;
+	usbs.backend = &backend;
+	usbs.label = pos;
+	usbs.set_text = _usb_ums_set_text;
+	usbs.system_maintenance = _usb_ums_maintenance;
+
+	res = !usb_device_gadget_ums(&usbs);
+	gfx_printf("\n");
+	if (ums_bis_end(&lun) || !res) {
+		log_printf(true, LOG_ERR, LOG_MSG_USB_UMS_ERROR);
+		res = false;
+	}
+
+cleanup:
+	unmount_nand_part(&gpt, is_boot, is_bis, true, false);
+	return res;
+}
+#endif
+
 u8 *load_file_to_mem(const char *path, UINT *out_size) {
     FIL fp;
     FRESULT fr = f_open(&fp, path, FA_READ);
@@ -836,22 +1164,11 @@ u8 *load_file_to_mem(const char *path, UINT *out_size) {
     return buf;
 }
 
-/*
-bool f_transfer_from_nands(const char *file_path, bool on_system_part) {
-	if (menu_on_sysnand) {
-		if (on_system_part) {
-			log_printf(true, LOG_INFO, LOG_MSG_FILE_TRANSFERT_FROM_NANDS_SYS_TO_EMU_SYSTEM, file_path);
-		} else {
-			log_printf(true, LOG_INFO, LOG_MSG_FILE_TRANSFERT_FROM_NANDS_SYS_TO_EMU_USER, file_path);
-		}
-	} else {
-		if (on_system_part) {
-			log_printf(true, LOG_INFO, LOG_MSG_FILE_TRANSFERT_FROM_NANDS_EMU_TO_SYS_SYSTEM, file_path);
-		} else {
-			log_printf(true, LOG_INFO, LOG_MSG_FILE_TRANSFERT_FROM_NANDS_EMU_TO_SYS_USER, file_path);
-		}
-	}
+static FATFS bis2_fs;
+static int dual_emu_enabled;
+static bool dual_emummc_force_disable;
 
+bool mount_nands_part_dual(link_t *gpt_sys, link_t *gpt_emu, const char *part_name) {
 	if (!sysmmc_available) {
 		log_printf(true, LOG_ERR, LOG_MSG_ERR_SYSMMC_NOT_AVAILABLE);
 		return false;
@@ -860,131 +1177,86 @@ bool f_transfer_from_nands(const char *file_path, bool on_system_part) {
 		log_printf(true, LOG_ERR, LOG_MSG_ERR_EMUMMC_NOT_AVAILABLE);
 		return false;
 	}
-
 	if (!bis_loaded) {
 		return false;
 	}
 
-	LIST_INIT(gpt);
+	// The emuMMC side goes through the emuMMC driver, the sysnand side straight to the eMMC.
+	dual_emu_enabled = emu_cfg.enabled;
+	dual_emummc_force_disable = h_cfg.emummc_force_disable;
+	emu_cfg.enabled = true;
+	h_cfg.emummc_force_disable = false;
 
-	FIL fs, fd;
-	FRESULT res = FR_OK;
-	char full_file_path[256];
-	s_printf(full_file_path, "bis:/%s", file_path);
+	sd_mount();
+	if (emummc_storage_init_mmc() || emummc_storage_set_mmc_partition(EMMC_GPP)) {
+		log_printf(true, LOG_ERR, LOG_MSG_ERR_INIT_EMMC);
+		goto error;
+	}
+	emmc_gpt_parse(gpt_emu);
+	emu_cfg.enabled = false;
+	emmc_gpt_parse(gpt_sys);
+	emu_cfg.enabled = true;
 
-	uint64_t off = 0;
-	bool first = true;
-	while (1) {
-		if (menu_on_sysnand) {
-			h_cfg.emummc_force_disable = true;
-			emu_cfg.enabled = false;
-		} else {
-			h_cfg.emummc_force_disable = false;
-			emu_cfg.enabled = true;
-		}
-		if (on_system_part) {
-			if (!mount_nand_part(&gpt, "SYSTEM", true, true, true, true, NULL, NULL, NULL, NULL)) {
-				return false;
-			}
-		} else {
-			if (!mount_nand_part(&gpt, "USER", true, true, true, true, NULL, NULL, NULL, NULL)) {
-				return false;
-			}
-		}
-		res = f_open(&fs, full_file_path, FA_READ);
-		if (res != FR_OK) {
-			log_printf(true, LOG_ERR, LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR_OPEN_SRC);
-			unmount_nand_part(&gpt, false, true, true, true);
-			return false;
-		}
-		res = f_lseek(&fs, off);
-		if (res != FR_OK) {
-			log_printf(true, LOG_ERR, LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR_READ_SRC);
-			f_close(&fs);
-			unmount_nand_part(&gpt, false, true, true, true);
-			return false;
-		}
-		UINT br;
-		res = f_read(&fs, copy_buf, COPY_BUF_SIZE, &br);
-		if (res != FR_OK) {
-			log_printf(true, LOG_ERR, LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR_READ_SRC);
-			f_close(&fs);
-			unmount_nand_part(&gpt, false, true, true, true);
-			return false;
-		}
-		f_close(&fs);
-		unmount_nand_part(&gpt, false, true, true, true);
-		if (br == 0) {
-			res = FR_OK;
-			break;
-		}
-		if (menu_on_sysnand) {
-			h_cfg.emummc_force_disable = false;
-			emu_cfg.enabled = true;
-		} else {
-			h_cfg.emummc_force_disable = true;
-			emu_cfg.enabled = false;
-		}
-		if (on_system_part) {
-			if (!mount_nand_part(&gpt, "SYSTEM", true, true, true, true, NULL, NULL, NULL, NULL)) {
-				res = FR_DISK_ERR;
-				break;
-			}
-		} else {
-			if (!mount_nand_part(&gpt, "USER", true, true, true, true, NULL, NULL, NULL, NULL)) {
-				res = FR_DISK_ERR;
-				break;
-			}
-		}
-		if (first) {
-			res = f_open(&fd, full_file_path, FA_WRITE | FA_CREATE_ALWAYS);
-			first = false;
-		} else {
-			res = f_open(&fd, full_file_path, FA_WRITE);
-		}
-		if (res != FR_OK) {
-			log_printf(true, LOG_ERR, LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR_OPEN_DST);
-			unmount_nand_part(&gpt, false, true, true, true);
-			break;
-		}
-		res = f_lseek(&fd, off);
-		if (res != FR_OK) {
-			log_printf(true, LOG_ERR, LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR_WRITE_DST);
-			f_close(&fd);
-			unmount_nand_part(&gpt, false, true, true, true);
-			break;
-		}
-		UINT bw;
-		res = f_write(&fd, copy_buf, br, &bw);
-		if (res != FR_OK || bw != br) {
-			res = FR_DISK_ERR;
-			log_printf(true, LOG_ERR, LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR_WRITE_DST);
-			f_close(&fd);
-			unmount_nand_part(&gpt, false, true, true, true);
-			break;
-		}
-		f_sync(&fd);
-		f_close(&fd);
-		unmount_nand_part(&gpt, false, true, true, true);
-		off += br;
+	emmc_part_t *sys_part = emmc_part_find(gpt_sys, part_name);
+	emmc_part_t *emu_part = emmc_part_find(gpt_emu, part_name);
+	if (!sys_part || !emu_part) {
+		log_printf(true, LOG_ERR, LOG_MSG_ERR_FOUND_PARTITION, part_name);
+		goto error;
 	}
 
-		if (menu_on_sysnand) {
-			h_cfg.emummc_force_disable = true;
-			emu_cfg.enabled = false;
-		} else {
-			h_cfg.emummc_force_disable = false;
-			emu_cfg.enabled = true;
-		}
+	// "bis:" stays on the nand the menu works on, "bis2:" gets the other one.
+	nx_emmc_bis_init_ex(0, menu_on_sysnand ? sys_part : emu_part, false, 0, menu_on_sysnand);
+	nx_emmc_bis_init_ex(1, menu_on_sysnand ? emu_part : sys_part, false, 0, !menu_on_sysnand);
+	if (f_mount(&emmc_fs, "bis:", 1) || f_mount(&bis2_fs, "bis2:", 1)) {
+		log_printf(true, LOG_ERR, LOG_MSG_ERR_MOUNT_PARTITION, part_name);
+		unmount_nands_part_dual(gpt_sys, gpt_emu);
+		return false;
+	}
+	return true;
 
-	if (!res) {
-		log_printf(true, LOG_OK, LOG_MSG_FILE_TRANSFERT_FROM_NANDS_SUCCESS);
-		return true;
-	} else {
+error:
+	unmount_nands_part_dual(gpt_sys, gpt_emu);
+	return false;
+}
+
+void unmount_nands_part_dual(link_t *gpt_sys, link_t *gpt_emu) {
+	f_mount(NULL, "bis:", 1);
+	f_mount(NULL, "bis2:", 1);
+	nx_emmc_bis_end_ex(0);
+	nx_emmc_bis_end_ex(1);
+	emmc_gpt_free(gpt_sys);
+	list_init(gpt_sys);
+	emmc_gpt_free(gpt_emu);
+	list_init(gpt_emu);
+	emmc_end();
+	emu_cfg.enabled = dual_emu_enabled;
+	h_cfg.emummc_force_disable = dual_emummc_force_disable;
+	sd_mount();
+}
+
+bool f_transfer_from_nands(const char *file_path, bool on_system_part) {
+	const char *part_name = on_system_part ? "SYSTEM" : "USER";
+	log_printf(true, LOG_INFO, LOG_MSG_FILE_TRANSFERT_FROM_NANDS, file_path, menu_on_sysnand ? "sysnand" : "emunand", menu_on_sysnand ? "emunand" : "sysnand", part_name);
+
+	LIST_INIT(gpt_sys);
+	LIST_INIT(gpt_emu);
+	if (!mount_nands_part_dual(&gpt_sys, &gpt_emu, part_name)) {
 		return false;
 	}
+
+	char src[256], dst[256];
+	s_printf(src, "bis:/%s", file_path);
+	s_printf(dst, "bis2:/%s", file_path);
+	FRESULT res = f_copy(src, dst);
+	unmount_nands_part_dual(&gpt_sys, &gpt_emu);
+
+	if (res != FR_OK) {
+		log_printf(true, LOG_ERR, LOG_MSG_FILE_TRANSFERT_FROM_NANDS_ERR, (u32)res);
+		return false;
+	}
+	log_printf(true, LOG_OK, LOG_MSG_FILE_TRANSFERT_FROM_NANDS_SUCCESS);
+	return true;
 }
-*/
 
 bool is_autorcm_enabled() {
 	if (!physical_emmc_ok) {
@@ -1017,7 +1289,7 @@ void save_screenshot_and_go_back(const char* filename) {
 	}
 	log_printf(false, LOG_INFO, LOG_MSG_PROPOSE_TAKE_SCREENSHOT);
 	if (wait_vol_plus()) {
-		int res = save_fb_to_bmp(filename);
+		int res = save_fb_to_qoi(filename);
 		if (!res) {
 			log_printf(false, LOG_OK, LOG_MSG_TAKE_SCREENSHOT_SUCCESS, filename);
 		} else {
@@ -1141,6 +1413,7 @@ FRESULT f_cp_or_rm_rf(const char *src_root, const char *dst_root)
 	*/
 
 	int sp = 0;
+	perf_mode_enter(src_root);
 
 	s_printf(ctx->src_stack[0], "%s", src_root);
 
@@ -1158,13 +1431,22 @@ FRESULT f_cp_or_rm_rf(const char *src_root, const char *dst_root)
 		goto out;
 	}
 
+	// Deleting walks the open directories inside FatFs, no path is resolved per entry.
+	if (!do_copy) {
+		res = f_rmdir_contents(ctx->dir, MAX_STACK_DEPTH);
+		if (res != FR_OK)
+			debug_log_write("Delete %s incomplete, error %d\n", src_root, res);
+		f_closedir(&ctx->dir[0]);
+		log_printf(true, LOG_INFO, LOG_MSG_FOLDER_DELETE_END);
+		f_unlink(src_root);
+		goto out;
+	}
+
 	while (sp >= 0) {
 		char name[256 + 1];
 		res = f_readdir(&ctx->dir[sp], &ctx->fno[sp]);
 		if (res != FR_OK || ctx->fno[sp].fname[0] == 0) {
 			f_closedir(&ctx->dir[sp]);
-			if (!do_copy && sp > 0)
-				f_unlink(ctx->src_stack[sp]);
 			sp--;
 			continue;
 		}
@@ -1175,140 +1457,201 @@ FRESULT f_cp_or_rm_rf(const char *src_root, const char *dst_root)
 			continue;
 
 		s_printf(ctx->src, "%s/%s", ctx->src_stack[sp], name);
-		if (do_copy)
-			s_printf(ctx->dst, "%s/%s", ctx->dst_stack[sp], name);
+		s_printf(ctx->dst, "%s/%s", ctx->dst_stack[sp], name);
 
 		if (ctx->fno[sp].fattrib & AM_DIR) {
 			if (sp + 1 >= MAX_STACK_DEPTH)
 				continue;
 
-			if (do_copy)
-				f_mkdir(ctx->dst);
+			f_mkdir(ctx->dst);
 
 			s_printf(ctx->src_stack[sp + 1], "%s", ctx->src);
-			if (do_copy)
-				s_printf(ctx->dst_stack[sp + 1], "%s", ctx->dst);
+			s_printf(ctx->dst_stack[sp + 1], "%s", ctx->dst);
 
 			if (f_opendir(&ctx->dir[sp + 1], ctx->src) == FR_OK)
 				sp++;
 			continue;
 		}
 
-		if (do_copy) {
-			res = f_copy(ctx->src, ctx->dst);
-			if (res != FR_OK) {
-				log_printf(true, LOG_ERR, LOG_MSG_FOLDER_COPY_ERROR, ctx->src, res);
-				goto out;
-			}
-		} else {
-			debug_log_write("Delete %s\n", ctx->src);
-			f_unlink(ctx->src);
+		res = f_copy(ctx->src, ctx->dst);
+		if (res != FR_OK) {
+			log_printf(true, LOG_ERR, LOG_MSG_FOLDER_COPY_ERROR, ctx->src, res);
+			goto out;
 		}
 	}
 
-	if (!do_copy) {
-		log_printf(true, LOG_INFO, LOG_MSG_FOLDER_DELETE_END);
-		f_unlink(src_root);
-	} else {
-		log_printf(true, LOG_INFO, LOG_MSG_FOLDER_COPY_END);
-	}
+	log_printf(true, LOG_INFO, LOG_MSG_FOLDER_COPY_END);
 
 out:
+	perf_mode_exit();
 	// free((BYTE*)ctx->copy_buf);
 	free(ctx);
 	return res;
 }
 
-int save_fb_to_bmp(const char* filename)
+#define SCREENSHOT_DIR      "sd:/LockSmith-RCM/screenshots"
+#define SCREENSHOT_BUF_SIZE SZ_64K
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xC0
+#define QOI_OP_RGB   0xFE
+
+static void _put_be32(u8 *dst, u32 val) {
+	dst[0] = val >> 24;
+	dst[1] = val >> 16;
+	dst[2] = val >> 8;
+	dst[3] = val;
+}
+
+// Next free index for a screenshot name, kept in a counter file so nothing has to be probed.
+static u32 _screenshot_index(const char *filename) {
+	char path[256];
+	FIL fp;
+	u32 idx = 0;
+
+	s_printf(path, SCREENSHOT_DIR "/%s.idx", filename);
+	if (!f_open(&fp, path, FA_READ)) {
+		f_read(&fp, &idx, sizeof(idx), NULL);
+		f_close(&fp);
+		return idx;
+	}
+
+	// No counter yet, scan the folder once for the highest index already used.
+	DIR dir;
+	FILINFO fno;
+	u32 len = strlen(filename);
+	s_printf(path, "%s*.qoi", filename);
+	if (!f_findfirst(&dir, &fno, SCREENSHOT_DIR, path)) {
+		while (fno.fname[0]) {
+			char *p = &fno.fname[len];
+			u32 n = 0;
+			if (*p == '_') {
+				while (*++p >= '0' && *p <= '9')
+					n = n * 10 + (*p - '0');
+			}
+			if (!strcmp(p, ".qoi"))
+				idx = MAX(idx, n + 1);
+			if (f_findnext(&dir, &fno))
+				break;
+		}
+		f_closedir(&dir);
+	}
+	return idx;
+}
+
+int save_fb_to_qoi(const char* filename)
 {
 	// Disallow screenshots if less than 2s passed.
 	static u32 timer = 0;
 	if (get_tmr_ms() < timer)
 		return 1;
 
-	const u32 file_size = 0x384000 + 0x36;
-	u8 *bitmap = malloc(file_size);
-	u32 *fb = malloc(0x384000);
-	u32 *fb_ptr = gfx_ctxt.fb;
+	if (sd_mount())
+		return -1;
+
+	char path[256];
+	s_printf(path, SCREENSHOT_DIR "/%s.qoi", filename);
+	mkdir_recursive(path);
+	u32 idx = _screenshot_index(filename);
+	if (idx)
+		s_printf(path, SCREENSHOT_DIR "/%s_%d.qoi", filename, idx);
 
-	// Reconstruct FB for bottom-top, portrait bmp.
-	for (int y = 1279; y > -1; y--)
-	{
-		for (u32 x = 0; x < 720; x++)
-			fb[y * 720 + x] = *fb_ptr++;
+	FIL fp;
+	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE))
+		return -1;
+
+	u8 *buf = sdmmc_dma_alloc(SCREENSHOT_BUF_SIZE);
+	if (!buf) {
+		f_close(&fp);
+		return -1;
 	}
 
-	memcpy(bitmap + 0x36, fb, 0x384000);
+	// QOI header: magic, size, 3 channels, sRGB.
+	memcpy(buf, "qoif", 4);
+	_put_be32(buf + 4, 720);
+	_put_be32(buf + 8, 1280);
+	buf[12] = 3;
+	buf[13] = 0;
+	u32 pos = 14;
+
+	// Framebuffer rows are already portrait and top-down, encode them in place.
+	u32 index[64] = {0};
+	u32 prev = 0xFF000000;
+	u32 run = 0;
+	const u32 *fb = gfx_ctxt.fb;
+	const u32 *fb_end = fb + 720 * 1280;
+	int res = 0;
 
-	typedef struct _bmp_t
-	{
-		u16 magic;
-		u32 size;
-		u32 rsvd;
-		u32 data_off;
-		u32 hdr_size;
-		u32 width;
-		u32 height;
-		u16 planes;
-		u16 pxl_bits;
-		u32 comp;
-		u32 img_size;
-		u32 res_h;
-		u32 res_v;
-		u64 rsvd2;
-	} __attribute__((packed)) bmp_t;
-
-	bmp_t *bmp = (bmp_t *)bitmap;
-
-	bmp->magic    = 0x4D42;
-	bmp->size     = file_size;
-	bmp->rsvd     = 0;
-	bmp->data_off = 0x36;
-	bmp->hdr_size = 40;
-	bmp->width    = 720;
-	bmp->height   = 1280;
-	bmp->planes   = 1;
-	bmp->pxl_bits = 32;
-	bmp->comp     = 0;
-	bmp->img_size = 0x384000;
-	bmp->res_h    = 2834;
-	bmp->res_v    = 2834;
-	bmp->rsvd2    = 0;
+	for (; fb < fb_end; fb++) {
+		u32 px = *fb | 0xFF000000;
+		if (px == prev) {
+			run++;
+			if (run == 62 || fb + 1 == fb_end) {
+				buf[pos++] = QOI_OP_RUN | (run - 1);
+				run = 0;
+			}
+		} else {
+			if (run) {
+				buf[pos++] = QOI_OP_RUN | (run - 1);
+				run = 0;
+			}
 
-	sd_mount();
+			u8 r = px >> 16, g = px >> 8, b = px;
+			u32 hash = (r * 3 + g * 5 + b * 7 + 0xFF * 11) & 63;
+			if (index[hash] == px) {
+				buf[pos++] = QOI_OP_INDEX | hash;
+			} else {
+				index[hash] = px;
+				s8 dr = r - (u8)(prev >> 16);
+				s8 dg = g - (u8)(prev >> 8);
+				s8 db = b - (u8)prev;
+				s8 dr_dg = dr - dg;
+				s8 db_dg = db - dg;
+				if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+					buf[pos++] = QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+				} else if (dg > -33 && dg < 32 && dr_dg > -9 && dr_dg < 8 && db_dg > -9 && db_dg < 8) {
+					buf[pos++] = QOI_OP_LUMA | (dg + 32);
+					buf[pos++] = (dr_dg + 8) << 4 | (db_dg + 8);
+				} else {
+					buf[pos++] = QOI_OP_RGB;
+					buf[pos++] = r;
+					buf[pos++] = g;
+					buf[pos++] = b;
+				}
+			}
+			prev = px;
+		}
 
-	// f_mkdir("sd:/LockSmith-RCM");
-	// f_mkdir("sd:/LockSmith-RCM/screenshots");
-	char path[256];
-	s_printf(path, "sd:/LockSmith-RCM/screenshots/%s.bmp", filename);
-	mkdir_recursive(path);
-	int i = 0;
-	if (f_stat(path, NULL) == FR_OK) {
-		for (i = 1; i <= 99999; i++) {
-			// int v = i;
-			// char num[6];
-			// num[5] = 0;
-			// num[4] = '0' + (v % 10); v /= 10;
-			// num[3] = '0' + (v % 10); v /= 10;
-			// num[2] = '0' + (v % 10); v /= 10;
-			// num[1] = '0' + (v % 10); v /= 10;
-			// num[0] = '0' + (v % 10);
-			// s_printf(path, "sd:/LockSmith-RCM/screenshots/%s_%s.bmp", filename, num);
-			s_printf(path, "sd:/LockSmith-RCM/screenshots/%s_%d.bmp", filename, i);
-			if (f_stat(path, NULL) != FR_OK) {
+		// Worst case per pixel is 4 bytes, plus the end marker.
+		if (pos > SCREENSHOT_BUF_SIZE - 16) {
+			if (f_write(&fp, buf, pos, NULL)) {
+				res = -1;
 				break;
 			}
+			pos = 0;
 		}
 	}
 
-	// Save screenshot and log.
-	int res = -1;
-	if (i <= 100000) res = sd_save_to_file(bitmap, file_size, path);
+	if (!res) {
+		static const u8 qoi_end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+		memcpy(buf + pos, qoi_end, sizeof(qoi_end));
+		pos += sizeof(qoi_end);
+		if (f_write(&fp, buf, pos, NULL))
+			res = -1;
+	}
 
-	// sd_unmount();
+	f_close(&fp);
+	sdmmc_dma_free(buf);
 
-	free(bitmap);
-	free(fb);
+	if (!res) {
+		idx++;
+		s_printf(path, SCREENSHOT_DIR "/%s.idx", filename);
+		sd_save_to_file(&idx, sizeof(idx), path);
+	} else {
+		f_unlink(path);
+	}
 
 	// Set timer to 2s.
 	timer = get_tmr_ms() + 2000;
@@ -1330,6 +1673,7 @@ static void _reloc_append(u32 payload_dst, u32 payload_src, u32 payload_size)
 
 void launch_payload(char *path, bool clear_screen)
 {
+	debug_log_flush();
 	if (clear_screen)
 		gfx_clear_grey(0x1B);
 	gfx_con_setpos(0, 0);
@@ -1380,6 +1724,7 @@ out:
 
 void auto_reboot() {
 	sd_mount();
+	debug_log_flush();
 	// If the console is a patched or Mariko unit
 	if (h_cfg.t210b01 || h_cfg.rcm_patched) {
 		free((BYTE*)copy_buf);
@@ -1471,6 +1816,7 @@ void DumpFw() {
 	char baseSdPath[256];
 
 	log_printf(true, LOG_INFO, LOG_MSG_DUMP_FW_BEGIN);
+	perf_mode_enter("dump_fw");
 
 	u32 timer = get_tmr_s();
 
@@ -1527,6 +1873,7 @@ void DumpFw() {
 	if (f_stat(baseSdPath, &fno) == FR_OK) {
 		log_printf(true, LOG_WARN, LOG_MSG_DUMP_FW_DIR_REPLACE_ASK);
 		if (!wait_vol_plus()) {
+			perf_mode_exit();
 			return;
 		}
 		RESETCOLOR;
@@ -1541,6 +1888,7 @@ void DumpFw() {
 
 	LIST_INIT(gpt);
 	if (!mount_nand_part(&gpt, "SYSTEM", true, true, true, true, NULL, NULL, NULL, NULL)) {
+		perf_mode_exit();
 		save_screenshot_and_go_back("fw_dump");
 		return;
 	}
@@ -1551,6 +1899,7 @@ void DumpFw() {
 	if (readRes){
 		log_printf(true, LOG_ERR, LOG_MSG_ERR_OPEN_FOLDER, bis_fw_dir_path);
 		unmount_nand_part(&gpt, false, true, true, true);
+		perf_mode_exit();
 		save_screenshot_and_go_back("fw_dump");
 		return;
 	}
@@ -1615,6 +1964,7 @@ void DumpFw() {
 	// free((BYTE*)copy_buf);
 
 out:
+	perf_mode_exit();
 	if (res) {
 		gfx_printf("\n");
 		log_printf(true, LOG_ERR, LOG_MSG_DUMP_FW_ERROR);
@@ -103,9 +103,11 @@ extern emunand_entry_t *emunands;
 #if DEBUG
 #define debug_log_start() debug_log_start_impl()
 #define debug_log_write(...) debug_log_write_impl(__VA_ARGS__)
+#define debug_log_flush() debug_log_flush_impl()
 #else
 #define debug_log_start() do {} while (0)
 #define debug_log_write(...) do {} while (0)
+#define debug_log_flush() do {} while (0)
 #endif
 
 char *bdk_strdup(const char *s);
@@ -113,18 +115,36 @@ FRESULT mkdir_recursive(const char *path);
 bool verifyProdinfo(u8 *blob);
 void debug_log_start_impl();
 void debug_log_write_impl(const char *text, ...);
+void debug_log_flush_impl();
 bool get_emmc_id(char *emmc_id_out);
 bool mount_nand_part(link_t *gpt, const char *part_name, bool nand_open, bool set_partition, bool fatfs_mount, bool test_loaded_keys, u64 *part_size_bytes_buf, bool *is_boot_buf, bool *is_bis_buf, emmc_part_t *part_buf);
 void unmount_nand_part(link_t *gpt, bool is_boot_part, bool is_bis, bool nand_close, bool fatfs_unmount);
+// Mounts part_name of the active nand on "bis:" and of the other nand on "bis2:".
+bool mount_nands_part_dual(link_t *gpt_sys, link_t *gpt_emu, const char *part_name);
+void unmount_nands_part_dual(link_t *gpt_sys, link_t *gpt_emu);
 bool wait_vol_plus();
 bool delete_save_from_nand(const char* savename, bool on_system_part);
 void ui_spinner_begin();
 void ui_spinner_draw();
 void ui_spinner_clear();
+// Raw sectors of the mounted partition, decrypted through BIS when bis is set. Returns 0 on success.
+int part_io(bool write, bool bis, u32 lba, u32 num, void *buf);
 bool flash_or_dump_part(bool flash, const char *sd_filepath, const char *part_name, bool bis_read_or_write_enable);
+bool flash_part_diff(const char *sd_filepath, const char *part_name, bool bis_read_or_write_enable);
+// Sparse dump in 16KB clusters. With base_path only clusters changed since that dump are stored. flash_or_dump_part restores both.
+bool dump_part_sparse(const char *sd_filepath, const char *part_name, const char *base_path, bool bis_read_or_write_enable);
+#ifdef LS_LZ4_DUMPS
+// LZ4 dump in independent 64KB blocks. flash_or_dump_part restores it too.
+bool dump_part_lz4(const char *sd_filepath, const char *part_name, bool bis_read_or_write_enable);
+#endif
+#ifdef LS_USB_UMS
+// Exports a decrypted BIS partition as a USB mass storage disk until the host ejects it.
+bool usb_mount_bis_part(const char *part_name);
+#endif
 FRESULT easy_rename(const char* old, const char* new);
 FRESULT f_copy(const char *src, const char *dst);
-// bool f_transfer_from_nands(const char *file_path, bool on_system_part);
+// Copies a file from "bis:" (the nand the menu works on) to "bis2:" (the other nand), both mounted at once.
+bool f_transfer_from_nands(const char *file_path, bool on_system_part);
 void save_screenshot_and_go_back(const char* filename);
 void display_title();
 void cls();
@@ -133,7 +153,7 @@ bool is_autorcm_enabled();
 void build_emunand_list();
 void select_and_apply_emunand();
 void emunand_list_free();
-int save_fb_to_bmp(const char* filename);
+int save_fb_to_qoi(const char* filename);
 void launch_payload(char *path, bool clear_screen);
 void auto_reboot();
 void DumpFw();
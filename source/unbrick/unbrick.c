@@ -1,6 +1,7 @@
 #include <string.h>
 #include "unbrick.h"
 #include "../keys/keys.h"
+#include "../perf/perf_mode.h"
 #include <mem/minerva.h>
 #include "../prodinfogen/build_prodinfo.h"
 #include "../storage/emummc.h"
@@ -27,8 +28,52 @@ static int is_file_in_keep_list(const char *name)
 	return 0;
 }
 
+static const char *const user_dirs[] = {
+	"bis:/Album",
+	"bis:/Contents",
+	"bis:/Contents/placehld",
+	"bis:/Contents/registered",
+	"bis:/save",
+	"bis:/saveMeta",
+	"bis:/temp"
+};
+
+static const char *const system_dirs[] = {
+	"bis:/Contents",
+	"bis:/Contents/placehld",
+	"bis:/Contents/registered",
+	"bis:/save",
+	"bis:/saveMeta"
+};
+
+// Empties the partition mounted on "bis:" and recreates its folders.
+// The FATs and the root folder are cleared in place. The boot sector is kept, so the partition keeps the
+// reserved area, FAT count and cluster size it was made with. If the volume can't be cleared that way
+// nothing was written yet, and the files are deleted one by one instead.
+static bool wipe_bis_part(const char *part_name, const char *const *dirs, u32 dirs_count) {
+	FRESULT res = f_clearfs("bis:", copy_buf, COPY_BUF_SIZE);
+	if (res != FR_OK && res != FR_INVALID_PARAMETER && res != FR_NOT_ENOUGH_CORE) {
+		log_printf(true, LOG_ERR, LOG_MSG_ERR_CLEAR_PARTITION, part_name, res);
+		return false;
+	}
+	if (f_mount(&emmc_fs, "bis:", 1)) {
+		log_printf(true, LOG_ERR, LOG_MSG_ERR_MOUNT_PARTITION, part_name);
+		return false;
+	}
+	if (res) {
+		log_printf(true, LOG_WARN, LOG_MSG_ERR_FORMAT_PARTITION, part_name, res);
+		for (u32 i = 0; i < dirs_count; i++) {
+			f_cp_or_rm_rf(dirs[i], NULL);
+		}
+		f_unlink("bis:/PRF2SAFE.RCV");
+	}
+	for (u32 i = 0; i < dirs_count; i++) {
+		f_mkdir(dirs[i]);
+	}
+	return true;
+}
+
 void unbrick(const char *sd_folder_path, bool reset) {
-	// minerva_change_freq(FREQ_1600);
 	char screenshot_name[20];
 	if (reset) {
 		s_printf(screenshot_name, "unbrick_and_wip");
@@ -43,63 +88,56 @@ void unbrick(const char *sd_folder_path, bool reset) {
 	if (!bis_loaded) {
 		return;
 	}
+	perf_mode_enter(screenshot_name);
 	LIST_INIT(gpt);
 	if (!mount_nand_part(&gpt, "SYSTEM", true, true, true, true, NULL, NULL, NULL, NULL)) {
-		save_screenshot_and_go_back(screenshot_name);
-		return;
+		goto out;
 	}
 	unmount_nand_part(&gpt, false, true, true, true);
 	if (reset) {
 		if (!mount_nand_part(&gpt, "USER", true, true, true, true, NULL, NULL, NULL, NULL)) {
-			save_screenshot_and_go_back(screenshot_name);
-			return;
+			goto out;
 		} else {
 			unmount_nand_part(&gpt, false, true, true, true);
 		}
 	}
 	char temp_path[MAX_PATH_LEN];
 	s_printf(temp_path, "%s/BOOT0.bin", sd_folder_path);
-	if (!flash_or_dump_part(true, temp_path, "BOOT0", false)) {
-		save_screenshot_and_go_back(screenshot_name);
-		return;
+	if (!flash_part_diff(temp_path, "BOOT0", false)) {
+		goto out;
 	}
 			s_printf(temp_path, "%s/BOOT1.bin", sd_folder_path);
-			if (!flash_or_dump_part(true, temp_path, "BOOT1", false)) {
-				save_screenshot_and_go_back(screenshot_name);
-				return;
+			if (!flash_part_diff(temp_path, "BOOT1", false)) {
+				goto out;
 			}
 	s_printf(temp_path, "%s/BCPKG2-1-Normal-Main.bin", sd_folder_path);
-	if (!flash_or_dump_part(true, temp_path, "BCPKG2-1-Normal-Main", false)) {
-		save_screenshot_and_go_back(screenshot_name);
-		return;
+	if (!flash_part_diff(temp_path, "BCPKG2-1-Normal-Main", false)) {
+		goto out;
 	}
 	s_printf(temp_path, "%s/BCPKG2-2-Normal-Sub.bin", sd_folder_path);
-	if (!flash_or_dump_part(true, temp_path, "BCPKG2-2-Normal-Sub", false)) {
-		save_screenshot_and_go_back(screenshot_name);
-		return;
+	if (!flash_part_diff(temp_path, "BCPKG2-2-Normal-Sub", false)) {
+		goto out;
 	}
 	s_printf(temp_path, "%s/BCPKG2-3-SafeMode-Main.bin", sd_folder_path);
-	if (!flash_or_dump_part(true, temp_path, "BCPKG2-3-SafeMode-Main", false)) {
-		save_screenshot_and_go_back(screenshot_name);
-		return;
+	if (!flash_part_diff(temp_path, "BCPKG2-3-SafeMode-Main", false)) {
+		goto out;
 	}
 	s_printf(temp_path, "%s/BCPKG2-4-SafeMode-Sub.bin", sd_folder_path);
-	if (!flash_or_dump_part(true, temp_path, "BCPKG2-4-SafeMode-Sub", false)) {
-		save_screenshot_and_go_back(screenshot_name);
-		return;
+	if (!flash_part_diff(temp_path, "BCPKG2-4-SafeMode-Sub", false)) {
+		goto out;
 	}
 
 	if (!mount_nand_part(&gpt, "SYSTEM", true, true, true, true, NULL, NULL, NULL, NULL)) {
-		save_screenshot_and_go_back(screenshot_name);
-		return;
+		goto out;
 	}
 
-f_cp_or_rm_rf("bis:/Contents/registered", NULL);
 	if (reset) {
-		f_cp_or_rm_rf("bis:/Contents", NULL);
-		f_cp_or_rm_rf("bis:/save", NULL);
-		f_cp_or_rm_rf("bis:/saveMeta", NULL);
-		f_unlink("bis:/PRF2SAFE.RCV");
+		if (!wipe_bis_part("SYSTEM", system_dirs, ARRAY_SIZE(system_dirs))) {
+			unmount_nand_part(&gpt, false, true, true, true);
+			goto out;
+		}
+	} else {
+		f_cp_or_rm_rf("bis:/Contents/registered", NULL);
 	}
 	s_printf(temp_path, "%s/SYSTEM/Contents", sd_folder_path);
 	f_cp_or_rm_rf(temp_path, "bis:/Contents");
@@ -116,33 +154,24 @@ f_cp_or_rm_rf("bis:/Contents/registered", NULL);
 	if (reset) {
 		unmount_nand_part(&gpt, false, true, false, true);
 		if (!mount_nand_part(&gpt, "USER", false, false, true, true, NULL, NULL, NULL, NULL)) {
-			save_screenshot_and_go_back(screenshot_name);
-			return;
+			goto out;
+		}
+		if (!wipe_bis_part("USER", user_dirs, ARRAY_SIZE(user_dirs))) {
+			unmount_nand_part(&gpt, false, true, true, true);
+			goto out;
 		}
-		f_cp_or_rm_rf("bis:/Album", NULL);
-		f_cp_or_rm_rf("bis:/Contents", NULL);
-		f_cp_or_rm_rf("bis:/save", NULL);
-		f_cp_or_rm_rf("bis:/saveMeta", NULL);
-		f_cp_or_rm_rf("bis:/temp", NULL);
-		f_unlink("bis:/PRF2SAFE.RCV");
-		f_mkdir("bis:/Album");
-		f_mkdir("bis:/Contents");
-		f_mkdir("bis:/Contents/placehld");
-		f_mkdir("bis:/Contents/registered");
-		f_mkdir("bis:/save");
-		f_mkdir("bis:/saveMeta");
-		f_mkdir("bis:/temp");
 	}
 unmount_nand_part(&gpt, false, true, true, true);
 
-	// minerva_change_freq(FREQ_800);
 	if (!reset) {
 	log_printf(true, LOG_OK, LOG_MSG_UNBRICK_SUCCESS);
 	} else {
 		log_printf(true, LOG_OK, LOG_MSG_UNBRICK_AND_WIP_SUCCESS);
 	}
+
+out:
+	perf_mode_exit();
 	save_screenshot_and_go_back(screenshot_name);
-	return;
 }
 
 void wip_nand() {
@@ -151,11 +180,11 @@ void wip_nand() {
 	if (!bis_loaded || !wait_vol_plus()) {
 		return;
 	}
+	perf_mode_enter("wip_nand");
 
 	LIST_INIT(gpt);
 	if (!mount_nand_part(&gpt, "SYSTEM", true, true, true, true, NULL, NULL, NULL, NULL)) {
-		save_screenshot_and_go_back("wip_nand");
-		return;
+		goto out;
 	}
 
 	DIR dir;
@@ -196,23 +225,13 @@ void wip_nand() {
 	unmount_nand_part(&gpt, false, true, false, true);
 
 	if (!mount_nand_part(&gpt, "USER", false, false, true, true, NULL, NULL, NULL, NULL)) {
-		save_screenshot_and_go_back("wip_nand");
-		return;
+		goto out;
 	}
-	f_cp_or_rm_rf("bis:/Album", NULL);
-	f_cp_or_rm_rf("bis:/Contents", NULL);
-	f_cp_or_rm_rf("bis:/save", NULL);
-	f_cp_or_rm_rf("bis:/saveMeta", NULL);
-	f_cp_or_rm_rf("bis:/temp", NULL);
-	f_unlink("bis:/PRF2SAFE.RCV");
-	f_mkdir("bis:/Album");
-	f_mkdir("bis:/Contents");
-	f_mkdir("bis:/Contents/placehld");
-	f_mkdir("bis:/Contents/registered");
-	f_mkdir("bis:/save");
-	f_mkdir("bis:/saveMeta");
-	f_mkdir("bis:/temp");
+	bool wiped = wipe_bis_part("USER", user_dirs, ARRAY_SIZE(user_dirs));
 unmount_nand_part(&	gpt, false, true, true, true);
+	if (!wiped) {
+		goto out;
+	}
 	if (menu_on_sysnand) {
 		f_cp_or_rm_rf("sd:/Nintendo", NULL);
 	} else {
@@ -221,6 +240,9 @@ unmount_nand_part(&	gpt, false, true, true, true);
 		}
 	}
 	log_printf(true, LOG_OK, LOG_MSG_WIP_SUCCESS);
+
+out:
+	perf_mode_exit();
 	save_screenshot_and_go_back("wip_nand");
 }
 
@@ -287,7 +309,7 @@ void build_prodinfo_and_flash(bool from_scratch) {
 	}
 
 	if (f_stat(generated_prodinfo_path, NULL) == FR_OK) {
-		if (!flash_or_dump_part(true, generated_prodinfo_path, "PRODINFO", true)) {
+		if (!flash_part_diff(generated_prodinfo_path, "PRODINFO", true)) {
 			save_screenshot_and_go_back("PRODINFO_build_and_flash");
 			return;
 		}
@@ -0,0 +1,19 @@
+/*
+ * Host replacement for the BDK heap header, so bdk/libs/compr/lz4.c
+ * can be built into the native packer.
+ */
+
+#ifndef _HOST_HEAP_H_
+#define _HOST_HEAP_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef uint8_t BYTE;
+
+#define likely(x)   (__builtin_expect((x) != 0, 1))
+#define unlikely(x) (__builtin_expect((x) != 0, 0))
+
+#define zalloc(size) calloc(1, size)
+
+#endif
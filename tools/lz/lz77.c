@@ -19,10 +19,66 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include "lz.h"
+#include "lz4.h"
 
 char filename[1024];
 
+#define RCM_PAYLOAD_MAX 126296
+#define BENCH_ROUNDS    200
+
+// Packs both halves with each codec, checks the round trip and times the loader's decode.
+static int bench(uint8_t *in_buf, uint32_t in_size, uint8_t *out_buf, uint32_t out_size, uint32_t *work)
+{
+	uint8_t *dec_buf = (uint8_t *)malloc(in_size);
+	if (!dec_buf || !work)
+		return 1;
+
+	printf("Input:  %u Bytes\n", in_size);
+	for (int use_lz4 = 0; use_lz4 < 2; use_lz4++)
+	{
+		uint32_t packed = 0;
+		double dec_s = 0;
+		for (int i = 0; i < 2; i++)
+		{
+			uint8_t *src = in_buf + (in_size / 2) * i;
+			uint32_t in_size_tmp = i ? in_size - (in_size / 2) : in_size / 2;
+			int nbytes, dbytes = 0;
+
+			if (use_lz4)
+				nbytes = LZ4_compress_default((const char *)src, (char *)out_buf, in_size_tmp, out_size);
+			else
+				nbytes = LZ_CompressFast(src, out_buf, in_size_tmp, work);
+			if (nbytes <= 0)
+				return 1;
+
+			clock_t start = clock();
+			for (int r = 0; r < BENCH_ROUNDS; r++)
+			{
+				if (use_lz4)
+					dbytes = LZ4_decompress_safe((const char *)out_buf, (char *)dec_buf, nbytes, in_size_tmp);
+				else
+					dbytes = LZ_Uncompress(out_buf, dec_buf, nbytes);
+			}
+			dec_s += (double)(clock() - start) / CLOCKS_PER_SEC / BENCH_ROUNDS;
+
+			if (dbytes != (int)in_size_tmp || memcmp(src, dec_buf, in_size_tmp))
+			{
+				fprintf(stderr, "%s round trip mismatch in half %d\n", use_lz4 ? "lz4" : "lz", i);
+				return 1;
+			}
+			packed += nbytes;
+		}
+
+		printf("%-4s %6u Bytes (%5.1f%%), %6.1f us host decode, %s %u Bytes\n", use_lz4 ? "lz4:" : "lz:",
+			packed, packed * 100.0 / in_size, dec_s * 1000000, packed > RCM_PAYLOAD_MAX ? "over" : "under", RCM_PAYLOAD_MAX);
+	}
+
+	free(dec_buf);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	int nbytes;
@@ -30,19 +86,25 @@ int main(int argc, char *argv[])
 	struct stat statbuf;
 	FILE *in_file, *out_file;
 
-	if(stat(argv[1], &statbuf))
+	// -lz4: pack with LZ4 blocks instead of LZ77, for a faster decode in the loader.
+	// -b: compare both codecs on the input and write nothing.
+	int use_lz4 = argc > 2 && !strcmp(argv[1], "-lz4");
+	int use_bench = argc > 2 && !strcmp(argv[1], "-b");
+	char *in_name = argv[argc - 1];
+
+	if(argc < 2 || stat(in_name, &statbuf))
 		goto error;
 
-	if((in_file=fopen(argv[1], "rb")) == NULL)
+	if((in_file=fopen(in_name, "rb")) == NULL)
 		goto error;
 
-	strcpy(filename, argv[1]);
+	strcpy(filename, in_name);
 	filename_len = strlen(filename);
 
 	uint32_t in_size = statbuf.st_size;
 	uint8_t *in_buf  = (uint8_t *)malloc(in_size);
 
-	uint32_t out_size = statbuf.st_size + 257;
+	uint32_t out_size = LZ4_compressBound(statbuf.st_size) + 257;
 	uint8_t *out_buf = (uint8_t *)malloc(out_size);
 
 	if(!(in_buf && out_buf))
@@ -54,6 +116,13 @@ int main(int argc, char *argv[])
 	fclose(in_file);
 
 	uint32_t *work = (uint32_t*)malloc(sizeof(uint32_t) * (in_size + 65536));
+	if (use_bench)
+	{
+		if (bench(in_buf, in_size, out_buf, out_size, work))
+			goto error;
+		return 0;
+	}
+
 	for (int i = 0; i < 2; i++)
 	{
 		uint32_t in_size_tmp;
@@ -68,11 +137,16 @@ int main(int argc, char *argv[])
 			strcpy(filename + filename_len, ".01.lz");
 		}
 
-		if (work)
+		if (use_lz4)
+			nbytes = LZ4_compress_default((const char *)in_buf + (in_size / 2) * i, (char *)out_buf, in_size_tmp, out_size);
+		else if (work)
 			nbytes = LZ_CompressFast(in_buf + (in_size / 2) * i, out_buf, in_size_tmp, work);
 		else
 			goto error;
 
+		if (nbytes <= 0)
+			goto error;
+
 		if (nbytes > out_size)
 			goto error;
 
@@ -88,6 +162,6 @@ int main(int argc, char *argv[])
 	return 0;
 
 error:
-	fprintf(stderr, "Failed to compress: %s\n", argv[1]);
+	fprintf(stderr, "Failed to compress: %s\n", argc > 1 ? argv[argc - 1] : "");
 	exit(1);
 }
@@ -4,8 +4,15 @@
 #include <stdint.h>
 #include <ctype.h>
 
+#include "../lz/lz.h"
+
 // Usage:
-//   pack_assets <repo_source_root> <out_dir>
+//   pack_assets [-z] <repo_source_root> <out_dir>
+//   -z: LZ compress the messages pool, unpacked on first use by log_msg_get.
+//   pack_assets -d <repo_source_root> <log.bin>
+//   Prints a binary log saved by the payload as text.
+//   pack_assets -t <repo_source_root>
+//   Checks that every message decodes from the folded pool, plain and LZ packed.
 // Generates:
 //   <out_dir>/messages_packed.h
 //   <out_dir>/fuse_nca_packed.h
@@ -195,7 +202,75 @@ static void write_byte_array(FILE *o, const char *sym, const unsigned char *buf,
 	fprintf(o, "};\n");
 }
 
-static void gen_messages(const char *src_root, const char *out_dir)
+typedef struct {
+	unsigned char *str;
+	size_t len;
+} msg_str_t;
+
+static const msg_str_t *g_sort_strs;
+
+static int cmp_len_desc(const void *a, const void *b)
+{
+	size_t la = g_sort_strs[*(const size_t*)a].len;
+	size_t lb = g_sort_strs[*(const size_t*)b].len;
+	if (la != lb) return la < lb ? 1 : -1;
+	return *(const size_t*)a < *(const size_t*)b ? -1 : 1;
+}
+
+static unsigned char *build_pool(const msg_str_t *strs, size_t count, uint32_t *offs, size_t *out_sz)
+{
+	// Place strings longest first. A string equal to, or a suffix of, one already
+	// placed reuses its tail since both end on the same NUL.
+	size_t *order = (size_t*)malloc(count * sizeof(size_t));
+	size_t total = 1;
+	if (!order) die("oom");
+	for (size_t i = 0; i < count; i++) {
+		order[i] = i;
+		total += strs[i].len + 1;
+	}
+	g_sort_strs = strs;
+	qsort(order, count, sizeof(size_t), cmp_len_desc);
+
+	unsigned char *pool = (unsigned char*)malloc(total);
+	size_t *placed = (size_t*)malloc(count * sizeof(size_t));
+	size_t pool_sz = 0, placed_cnt = 0;
+	if (!pool || !placed) die("oom");
+
+	for (size_t k = 0; k < count; k++) {
+		size_t i = order[k];
+		const unsigned char *str = strs[i].str ? strs[i].str : (const unsigned char*)"";
+		size_t len = strs[i].len;
+		int found = 0;
+
+		for (size_t j = 0; j < placed_cnt && !found; j++) {
+			const msg_str_t *host = &strs[placed[j]];
+			if (!len) {
+				offs[i] = offs[placed[j]] + (uint32_t)host->len;
+				found = 1;
+				break;
+			}
+			if (host->len < len) continue;
+			if (!memcmp(host->str + host->len - len, str, len)) {
+				offs[i] = offs[placed[j]] + (uint32_t)(host->len - len);
+				found = 1;
+			}
+		}
+		if (found) continue;
+
+		offs[i] = (uint32_t)pool_sz;
+		memcpy(pool + pool_sz, str, len);
+		pool[pool_sz + len] = 0;
+		pool_sz += len + 1;
+		placed[placed_cnt++] = i;
+	}
+
+	free(order);
+	free(placed);
+	*out_sz = pool_sz;
+	return pool;
+}
+
+static msg_str_t *load_messages(const char *src_root, size_t *out_count)
 {
 	char path_h[1024];
 	char path_c[1024];
@@ -213,12 +288,9 @@ static void gen_messages(const char *src_root, const char *out_dir)
 		die("failed to parse log_msg_id_t enum from messages.h");
 	}
 
-	// Offsets (u32 during build), pool as bytes.
-	uint32_t *offs = (uint32_t*)calloc(msg_count, sizeof(uint32_t));
-	uint8_t *present = (uint8_t*)calloc(msg_count, 1);
-	unsigned char *pool = (unsigned char*)malloc(1);
-	size_t pool_sz = 0;
-	if (!offs || !present || !pool) die("oom");
+	// Strings are collected first and pooled after.
+	msg_str_t *strs = (msg_str_t*)calloc(msg_count, sizeof(msg_str_t));
+	if (!strs) die("oom");
 
 	// Parse lines like: [LOG_MSG_xxx] = "...",
 	const char *p = (const char*)src;
@@ -263,27 +335,83 @@ static void gen_messages(const char *src_root, const char *out_dir)
 		if (lit_len >= sizeof(tmp)) { p = s1; continue; }
 		if (!c_unescape(s0, lit_len, tmp, sizeof(tmp), &out_len)) { p = s1; continue; }
 
-		offs[idx] = (uint32_t)pool_sz;
-		present[idx] = 1;
-		pool = (unsigned char*)realloc(pool, pool_sz + out_len + 1);
-		if (!pool) die("oom");
-		memcpy(pool + pool_sz, tmp, out_len);
-		pool[pool_sz + out_len] = 0;
-		pool_sz += out_len + 1;
+		free(strs[idx].str);
+		strs[idx].str = (unsigned char*)malloc(out_len + 1);
+		if (!strs[idx].str) die("oom");
+		memcpy(strs[idx].str, tmp, out_len);
+		strs[idx].str[out_len] = 0;
+		strs[idx].len = out_len;
 
 		p = s1;
 	}
 
-	// Fill missing entries with empty strings.
-	for (size_t i = 0; i < msg_count; i++) {
-		if (!present[i]) {
-			offs[i] = (uint32_t)pool_sz;
-			pool = (unsigned char*)realloc(pool, pool_sz + 1);
-			if (!pool) die("oom");
-			pool[pool_sz++] = 0;
-			present[i] = 1;
+	free(hdr); free(src);
+	for (size_t i = 0; i < msg_count; i++) free(names[i]);
+	free(names);
+
+	*out_count = msg_count;
+	return strs;
+}
+
+static int check_pool(const msg_str_t *strs, size_t count, const uint32_t *offs, const unsigned char *pool, size_t pool_sz, const char *what)
+{
+	int bad = 0;
+	for (size_t i = 0; i < count; i++) {
+		const unsigned char *str = strs[i].str ? strs[i].str : (const unsigned char*)"";
+		size_t len = strs[i].len;
+		if (offs[i] + len >= pool_sz || memcmp(pool + offs[i], str, len) || pool[offs[i] + len]) {
+			fprintf(stderr, "%s pool: message %zu does not match its source string\n", what, i);
+			bad = 1;
 		}
 	}
+	return bad;
+}
+
+static int test_messages(const char *src_root)
+{
+	size_t msg_count = 0;
+	msg_str_t *strs = load_messages(src_root, &msg_count);
+	uint32_t *offs = (uint32_t*)calloc(msg_count, sizeof(uint32_t));
+	if (!offs) die("oom");
+
+	size_t pool_sz = 0, raw_sz = 0;
+	unsigned char *pool = build_pool(strs, msg_count, offs, &pool_sz);
+	int bad = check_pool(strs, msg_count, offs, pool, pool_sz, "folded");
+
+	// Same packing as -z, unpacked the way log_msg_get does it.
+	unsigned char *lz = (unsigned char*)malloc(pool_sz + pool_sz / 256 + 512);
+	unsigned char *unlz = (unsigned char*)malloc(pool_sz);
+	unsigned int *work = (unsigned int*)malloc(sizeof(unsigned int) * (pool_sz + 65536));
+	if (!lz || !unlz || !work) die("oom");
+	int lz_sz = LZ_CompressFast(pool, lz, pool_sz, work);
+	if (lz_sz <= 0 || LZ_Uncompress(lz, unlz, lz_sz) != (int)pool_sz) {
+		fprintf(stderr, "LZ pool: bad round trip\n");
+		bad = 1;
+	} else
+		bad |= check_pool(strs, msg_count, offs, unlz, pool_sz, "LZ");
+
+	for (size_t i = 0; i < msg_count; i++)
+		raw_sz += strs[i].len + 1;
+	printf("%zu messages, %zu Bytes unfolded, %zu Bytes folded, %d Bytes LZ: %s\n",
+		msg_count, raw_sz, pool_sz, lz_sz, bad ? "FAILED" : "OK");
+
+	free(lz); free(unlz); free(work);
+	for (size_t i = 0; i < msg_count; i++) free(strs[i].str);
+	free(strs);
+	free(offs); free(pool);
+	return bad;
+}
+
+static void gen_messages(const char *src_root, const char *out_dir, int compress)
+{
+	size_t msg_count = 0;
+	msg_str_t *strs = load_messages(src_root, &msg_count);
+	uint32_t *offs = (uint32_t*)calloc(msg_count, sizeof(uint32_t));
+	if (!offs) die("oom");
+
+	// Missing entries stay empty strings.
+	size_t pool_sz = 0;
+	unsigned char *pool = build_pool(strs, msg_count, offs, &pool_sz);
 
 	// Emit messages pool uncompressed + adaptive offsets.
 	char out_path[1024];
@@ -322,17 +450,27 @@ static void gen_messages(const char *src_root, const char *out_dir)
 		fprintf(o, "};\n\n");
 	}
 
-	write_byte_array(o, "g_logmsg_pool", pool, pool_sz);
+	if (compress) {
+		// Worst case LZ output is a bit larger than its input.
+		unsigned char *lz = (unsigned char*)malloc(pool_sz + pool_sz / 256 + 512);
+		unsigned int *work = (unsigned int*)malloc(sizeof(unsigned int) * (pool_sz + 65536));
+		if (!lz || !work) die("oom");
+		int lz_sz = LZ_CompressFast(pool, lz, pool_sz, work);
+		if (lz_sz <= 0) die("messages pool compression failed");
+
+		fprintf(o, "#define LOGMSG_POOL_COMPRESSED\n");
+		write_byte_array(o, "g_logmsg_pool_lz", lz, (size_t)lz_sz);
+		free(lz); free(work);
+	} else
+		write_byte_array(o, "g_logmsg_pool", pool, pool_sz);
 
 fprintf(o, "\n#endif\n");
 
 	fclose(o);
 
 	// cleanup
-	free(hdr); free(src);
-	for (size_t i = 0; i < msg_count; i++) free(names[i]);
-	free(names);
-	free(present);
+	for (size_t i = 0; i < msg_count; i++) free(strs[i].str);
+	free(strs);
 	free(offs); free(pool);
 }
 
@@ -415,16 +553,99 @@ static void gen_fuse_nca(const char *src_root, const char *out_dir)
 	free(recs);
 }
 
+// Must match log_bin_hdr_t and log_entry_t in source/gfx/messages.h.
+#define LOG_BIN_MAGIC 0x474C534C // "LSLG"
+#define LOG_ARG_STR   2
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t entry_size;
+	uint32_t count;
+	uint32_t str_pool_size;
+} log_bin_hdr_t;
+
+typedef struct {
+	uint8_t  level;
+	uint8_t  msg_id;
+	uint8_t  argc;
+	uint8_t  arg_type[4];
+	uint32_t argv[4];
+	uint32_t time_ms;
+} log_bin_entry_t;
+
+static void decode_log(const char *src_root, const char *bin_path)
+{
+	size_t msg_count = 0, bin_sz = 0;
+	msg_str_t *strs = load_messages(src_root, &msg_count);
+	unsigned char *bin = read_file(bin_path, &bin_sz);
+	if (!bin) die("cannot read binary log");
+
+	log_bin_hdr_t *hdr = (log_bin_hdr_t*)bin;
+	if (bin_sz < sizeof(*hdr) || hdr->magic != LOG_BIN_MAGIC || hdr->entry_size != sizeof(log_bin_entry_t) ||
+		sizeof(*hdr) + (size_t)hdr->count * hdr->entry_size + hdr->str_pool_size > bin_sz)
+		die("invalid binary log");
+
+	log_bin_entry_t *entries = (log_bin_entry_t*)(bin + sizeof(*hdr));
+	const char *str_pool = (const char*)(entries + hdr->count);
+
+	for (uint32_t i = 0; i < hdr->count; i++) {
+		log_bin_entry_t *e = &entries[i];
+		const char *fmt = e->msg_id < msg_count && strs[e->msg_id].str ? (const char*)strs[e->msg_id].str : "";
+		uint32_t argi = 0;
+
+		// Same line layout as log_export_txt, prefixed with the timestamp.
+		printf("[%u.%03u] %u - ", e->time_ms / 1000, e->time_ms % 1000, e->level);
+		for (const char *f = fmt; *f; f++) {
+			if (*f != '%') { putchar(*f); continue; }
+
+			// Width and zero fill, as in the payload s_printf.
+			char spec[16] = "%";
+			size_t sl = 1;
+			while ((f[1] >= '0' && f[1] <= '9') && sl < 8) spec[sl++] = *++f;
+			char conv = *++f;
+			if (!conv) break;
+			if (conv == '%') { putchar('%'); continue; }
+
+			uint32_t v = argi < e->argc && argi < 4 ? e->argv[argi] : 0;
+			int is_str = argi < e->argc && argi < 4 && e->arg_type[argi] == LOG_ARG_STR;
+			argi++;
+			if (conv == 's') {
+				spec[sl++] = 's';
+				spec[sl] = 0;
+				printf(spec, is_str && v < hdr->str_pool_size ? str_pool + v : "<invalid str>");
+			} else {
+				spec[sl++] = conv == 'd' ? 'u' : 'x';
+				spec[sl] = 0;
+				printf(spec, v);
+			}
+		}
+		putchar('\n');
+	}
+
+	free(bin);
+	for (size_t i = 0; i < msg_count; i++) free(strs[i].str);
+	free(strs);
+}
+
 int main(int argc, char **argv)
 {
-	if (argc != 3) {
-		fprintf(stderr, "Usage: %s <source_root> <out_dir>\n", argv[0]);
+	if (argc == 4 && !strcmp(argv[1], "-d")) {
+		decode_log(argv[2], argv[3]);
+		return 0;
+	}
+	if (argc == 3 && !strcmp(argv[1], "-t"))
+		return test_messages(argv[2]);
+
+	int compress = argc == 4 && !strcmp(argv[1], "-z");
+	if (argc != 3 + compress) {
+		fprintf(stderr, "Usage: %s [-z] <source_root> <out_dir>\n", argv[0]);
 		return 2;
 	}
-	const char *src_root = argv[1];
-	const char *out_dir = argv[2];
+	const char *src_root = argv[1 + compress];
+	const char *out_dir = argv[2 + compress];
 
-	gen_messages(src_root, out_dir);
+	gen_messages(src_root, out_dir, compress);
 	gen_fuse_nca(src_root, out_dir);
 
 	return 0;
@@ -0,0 +1,132 @@
+/*
+ * Host check of the benchmark core against a memory-backed device and a fake clock.
+ * Every access advances the clock by a fixed time, so counts, offsets and rates are exact.
+ */
+
+#include "../../source/bench/bench.c"
+
+#include <stdio.h>
+
+#define DEV_UNITS 4096
+#define UNIT      512
+#define IO_US     100
+
+static u8 dev[DEV_UNITS * UNIT];
+static u8 buf[64 * UNIT];
+static u32 clock_us, bounce_count;
+static u32 offsets[DEV_UNITS], accesses, fail_at;
+static int failed;
+
+static u32 _now_us() { return clock_us; }
+static u32 _bounces() { return bounce_count; }
+
+static int _dev_read(void *ctx, u32 offset, u32 count, void *out)
+{
+	clock_us += IO_US;
+	if (fail_at && accesses + 1 == fail_at)
+		return 7;
+	if (offset + count > DEV_UNITS)
+		return 1;
+	if (accesses < DEV_UNITS)
+		offsets[accesses] = offset;
+	accesses++;
+	bounce_count += count / 8; // One bounce per 4KB, like an unaligned DMA buffer.
+	memcpy(out, dev + (size_t)offset * UNIT, count * UNIT);
+	return 0;
+}
+
+static void _check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		printf("bench: FAIL %s\n", what);
+		failed = 1;
+	}
+}
+
+static void _run(bench_test_t *test, u32 budget_us, bench_result_t *res)
+{
+	bench_env_t env = { _now_us, _bounces, budget_us, buf };
+	accesses = 0;
+	bench_run(&env, test, res);
+}
+
+int main()
+{
+	bench_result_t res;
+	char out[256];
+
+	// A sequential pass stops at the last whole chunk of the span. The counters start mid-run.
+	bounce_count = 1000;
+	bench_test_t seq = { "seq", _dev_read, NULL, UNIT, 64, 1000, false };
+	_run(&seq, 1000000, &res);
+	_check(res.calls == 1000 / 64 && accesses == res.calls, "sequential calls");
+	bool in_order = true;
+	for (u32 i = 0; i < accesses; i++)
+		in_order &= offsets[i] == i * 64;
+	_check(in_order, "sequential offsets");
+	_check(res.bytes == (u64)15 * 64 * UNIT && res.elapsed_us == 15 * IO_US && !res.err, "sequential totals");
+	_check(res.bounces == 15 * 8, "bounces counted over the test");
+	seq.span = 1024;
+	_run(&seq, 1000000, &res);
+	_check(res.calls == 16, "span ending on a chunk");
+
+	// The time budget ends the test after the access that crosses it.
+	seq.span = 0;
+	_run(&seq, 10 * IO_US - 1, &res);
+	_check(res.calls == 10 && res.elapsed_us == 10 * IO_US, "time budget");
+
+	// Random offsets are chunk aligned, inside the span, spread out and the same on every run.
+	bench_test_t rnd = { "rnd", _dev_read, NULL, UNIT, 8, DEV_UNITS, true };
+	_run(&rnd, 500 * IO_US, &res);
+	u32 first[500], distinct = 0;
+	bool aligned = res.calls == 500;
+	for (u32 i = 0; i < accesses; i++)
+	{
+		first[i] = offsets[i];
+		aligned &= !(offsets[i] % 8) && offsets[i] + 8 <= DEV_UNITS;
+		bool seen = false;
+		for (u32 j = 0; j < i && !seen; j++)
+			seen = offsets[j] == offsets[i];
+		distinct += !seen;
+	}
+	_check(aligned, "random offsets aligned and in span");
+	_check(distinct > 300, "random offsets spread");
+	_run(&rnd, 500 * IO_US, &res);
+	_check(!memcmp(first, offsets, sizeof(first)), "random offsets repeat");
+
+	// A span shorter than a chunk has nowhere to go.
+	rnd.span = 7;
+	_run(&rnd, 500 * IO_US, &res);
+	_check(!res.calls && !accesses && !res.bytes, "random span below a chunk");
+
+	// An error stops the test and is reported, the failed access is not counted.
+	fail_at = 4;
+	seq.span = 1000;
+	_run(&seq, 1000000, &res);
+	_check(res.err == 7 && res.calls == 3 && res.bytes == (u64)3 * 64 * UNIT && res.elapsed_us == 4 * IO_US, "error");
+	fail_at = 0;
+
+	// Rates keep 64-bit byte counts and survive a zero time.
+	res.bytes = (u64)8 << 30;
+	res.calls = 250000;
+	res.elapsed_us = 10000000;
+	_check(bench_kb_per_s(&res) == 838860 && bench_ops_per_s(&res) == 25000, "rates");
+	res.elapsed_us = 0;
+	_check(!bench_kb_per_s(&res) && !bench_ops_per_s(&res), "rates over no time");
+
+	// CSV.
+	u32 len = bench_csv_header(out);
+	_check(len == strlen(out) && !strcmp(out, "test,chunk_bytes,calls,kb,us,kb_per_s,ops_per_s,bounces,error\n"), "csv header");
+	res.bytes = 2 << 20;
+	res.calls = 64;
+	res.elapsed_us = 500000;
+	res.bounces = 5;
+	res.err = 0;
+	len = bench_csv_line(out, &seq, &res);
+	_check(len == strlen(out) && !strcmp(out, "seq,32768,64,2048,500000,4096,128,5,0\n"), "csv line");
+
+	if (!failed)
+		printf("bench: OK\n");
+	return failed;
+}
@@ -0,0 +1,333 @@
+/*
+ * Host check of two BIS volumes mounted side by side, the way mount_nands_part_dual does it.
+ * The real BIS driver and disk I/O glue run over two RAM eMMCs and a stand-in for the SE:
+ * "bis:" on the emuMMC side, "bis2:" on the physical eMMC. Files copied between them must
+ * read back the same on both, with reads on one volume interleaved with the other.
+ */
+
+// The BDK heap API is declared with u32 sizes, rename it next to the host one.
+#define malloc heap_malloc
+#define calloc heap_calloc
+#define free heap_free
+#include "../../source/storage/nx_emmc_bis.c"
+#include "../../source/libs/fatfs/diskio.c"
+#undef malloc
+#undef calloc
+#undef free
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <utils/sprintf.h>
+
+#define PART_SECTORS (64 * 1024 * 2) // 64MB, FAT32 with 512 byte clusters still fits after the 16MB data alignment.
+#define SYS_LBA      0x800
+#define EMU_LBA      0x1800
+#define EMMC_SECTORS (EMU_LBA + PART_SECTORS)
+#define COPY_SIZE    (SZ_32K + 3 * 512) // Not a whole cluster, so reads and writes land mid-cluster.
+
+sdmmc_storage_t emmc_storage, sd_storage;
+
+static u8 *sys_emmc, *emu_emmc, *sd_image;
+static u8 data[SZ_1M];
+static int failed;
+
+void *ff_memalloc(UINT size) { return malloc(size); }
+void ff_memfree(void *p) { free(p); }
+DWORD get_fattime() { return 0; }
+
+// FatFs reports mount errors on screen.
+void gfx_printf(const char *fmt, ...) {}
+
+// The plain FAT32 image is made on "sd:", the physical eMMC side is reached through emmc_storage.
+int sdmmc_storage_read(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf)
+{
+	u8 *disk = storage == &sd_storage ? sd_image : sys_emmc;
+	u32 sectors = storage == &sd_storage ? PART_SECTORS : EMMC_SECTORS;
+	if (sector + num_sectors > sectors)
+		return 1;
+	memcpy(buf, disk + (size_t)sector * 512, num_sectors * 512);
+	return 0;
+}
+
+int sdmmc_storage_write(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf)
+{
+	u8 *disk = storage == &sd_storage ? sd_image : sys_emmc;
+	u32 sectors = storage == &sd_storage ? PART_SECTORS : EMMC_SECTORS;
+	if (sector + num_sectors > sectors)
+		return 1;
+	memcpy(disk + (size_t)sector * 512, buf, num_sectors * 512);
+	return 0;
+}
+
+// Without sysmmc set a context goes through the partition API, which is the emuMMC here.
+int emmc_part_read(emmc_part_t *part, u32 sector_off, u32 num_sectors, void *buf)
+{
+	if (part->lba_start + sector_off + num_sectors > part->lba_end + 1)
+		return 1;
+	memcpy(buf, emu_emmc + (size_t)(part->lba_start + sector_off) * 512, num_sectors * 512);
+	return 0;
+}
+
+int emmc_part_write(emmc_part_t *part, u32 sector_off, u32 num_sectors, void *buf)
+{
+	if (part->lba_start + sector_off + num_sectors > part->lba_end + 1)
+		return 1;
+	memcpy(emu_emmc + (size_t)(part->lba_start + sector_off) * 512, buf, num_sectors * 512);
+	return 0;
+}
+
+// SE stand-in: a byte cipher keyed by the keyslot that does not commute with XOR, under the same
+// tweak handling as se_aes_crypt_xts_sec_nx. A tweak taken from the wrong sector garbles the data.
+static void _ecb(u32 ks, int enc, u8 *buf, u32 size)
+{
+	for (u32 i = 0; i < size; i++)
+	{
+		u8 key = ks * 0x35 + (i & 0xF) * 0x0B;
+		if (enc)
+			buf[i] = (u8)((buf[i] ^ key) * 167 + 13);
+		else
+			buf[i] = (u8)((u8)(buf[i] - 13) * 23) ^ key; // 23 is 167's inverse mod 256.
+	}
+}
+
+static void _ls_1bit_le(u8 *buf)
+{
+	u32 *block = (u32 *)buf;
+	u32 carry = 0;
+	for (u32 i = 0; i < 4; i++)
+	{
+		u32 b = block[i];
+		block[i] = (b << 1) | carry;
+		carry = b >> 31;
+	}
+	if (carry)
+		block[0] ^= 0x87;
+}
+
+int se_aes_crypt_xts_sec_nx(u32 tweak_ks, u32 crypt_ks, int enc, u64 sec, u8 *tweak, bool regen_tweak, u32 tweak_exp,
+	void *dst, void *src, u32 sec_size)
+{
+	u8 *pdst = dst, *psrc = src, orig[16];
+
+	if (regen_tweak)
+	{
+		for (int i = 15; i >= 0; i--, sec >>= 8)
+			tweak[i] = sec & 0xFF;
+		_ecb(tweak_ks, ENCRYPT, tweak, 16);
+	}
+	for (u32 i = 0; i < (tweak_exp << 5); i++)
+		_ls_1bit_le(tweak);
+
+	memcpy(orig, tweak, 16);
+	for (u32 i = 0; i < sec_size; i += 16, _ls_1bit_le(tweak))
+		for (u32 j = 0; j < 16; j++)
+			pdst[i + j] = psrc[i + j] ^ tweak[j];
+	_ecb(crypt_ks, enc, pdst, sec_size);
+	for (u32 i = 0; i < sec_size; i += 16, _ls_1bit_le(orig))
+		for (u32 j = 0; j < 16; j++)
+			pdst[i + j] ^= orig[j];
+	return 0;
+}
+
+static void _check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		printf("bis_dual: FAIL %s\n", what);
+		failed = 1;
+	}
+}
+
+static void _pattern(u32 seed)
+{
+	for (u32 i = 0; i < sizeof(data); i++)
+		data[i] = (i * 131 + seed) >> 3;
+}
+
+static bool _file(const char *path, u32 size, u32 seed)
+{
+	FIL fp;
+	UINT bw;
+	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE))
+		return false;
+	_pattern(seed);
+	bool ok = true;
+	for (u32 done = 0; ok && done < size; done += bw)
+		ok = !f_write(&fp, data, MIN(size - done, sizeof(data)), &bw) && bw;
+	return !f_close(&fp) && ok;
+}
+
+// Same loop as f_copy, with a buffer that is not a whole cluster.
+static FRESULT _copy(const char *src, const char *dst)
+{
+	static u8 buf[COPY_SIZE];
+	FIL fs, fd;
+	UINT r, w;
+	FRESULT fr = f_open(&fs, src, FA_READ);
+	if (fr)
+		return fr;
+	fr = f_open(&fd, dst, FA_WRITE | FA_CREATE_ALWAYS);
+	if (fr)
+	{
+		f_close(&fs);
+		return fr;
+	}
+	while (!(fr = f_read(&fs, buf, sizeof(buf), &r)) && r)
+	{
+		fr = f_write(&fd, buf, r, &w);
+		if (fr || w != r)
+			break;
+	}
+	f_close(&fs);
+	f_close(&fd);
+	return fr;
+}
+
+static bool _holds(const char *path, u32 size, u32 seed)
+{
+	static u8 buf[sizeof(data)];
+	FIL fp;
+	UINT br;
+	if (f_open(&fp, path, FA_READ))
+		return false;
+	_pattern(seed);
+	bool same = f_size(&fp) == size;
+	for (u32 done = 0; same && done < size; done += br)
+		same = !f_read(&fp, buf, sizeof(buf), &br) && br && !memcmp(buf, data, br);
+	f_close(&fp);
+	return same;
+}
+
+static bool _same(const char *a, const char *b)
+{
+	static u8 buf_a[COPY_SIZE], buf_b[COPY_SIZE];
+	FIL fa, fb;
+	UINT ra, rb;
+	if (f_open(&fa, a, FA_READ))
+		return false;
+	if (f_open(&fb, b, FA_READ))
+	{
+		f_close(&fa);
+		return false;
+	}
+	bool same = f_size(&fa) == f_size(&fb);
+	// Both files are read a buffer at a time in turn, so the two BIS contexts interleave.
+	while (same && !f_read(&fa, buf_a, sizeof(buf_a), &ra) && !f_read(&fb, buf_b, sizeof(buf_b), &rb) && ra)
+		same = ra == rb && !memcmp(buf_a, buf_b, ra);
+	f_close(&fa);
+	f_close(&fb);
+	return same;
+}
+
+int main()
+{
+	static FATFS sd_fs, fs, fs2;
+	static u8 work[SZ_64K];
+	static const u32 sizes[] = { 0, 1, 511, 16384, 16384 * 3 + 700, 3 * SZ_1M + 12345 };
+	char src[64], dst[64];
+
+	// A broken driver can leave FatFs walking a looped cluster chain.
+	alarm(60);
+
+	sys_emmc = calloc(EMMC_SECTORS, 512);
+	emu_emmc = calloc(EMMC_SECTORS, 512);
+	sd_image = calloc(PART_SECTORS, 512);
+	bis_cache = calloc(1, sizeof(bis_cache_t));
+	cache_lookup_tbl = calloc(PART_SECTORS / BIS_CLUSTER_SECTORS, sizeof(u32));
+
+	// One plain FAT32 image, written through each BIS context so both sides hold it encrypted.
+	sd_storage.sec_cnt = PART_SECTORS;
+	if (f_mkfs("sd:", FM_FAT32 | FM_SFD, 512, work, sizeof(work)) || f_mount(&sd_fs, "sd:", 1))
+	{
+		printf("bis_dual: FAIL ram disk\n");
+		return 1;
+	}
+	f_mount(NULL, "sd:", 1);
+
+	emmc_part_t sys_part = { 0, SYS_LBA, SYS_LBA + PART_SECTORS - 1, 0, "SYSTEM" };
+	emmc_part_t emu_part = { 0, EMU_LBA, EMU_LBA + PART_SECTORS - 1, 0, "SYSTEM" };
+	nx_emmc_bis_init_ex(0, &emu_part, false, 0, false);
+	nx_emmc_bis_init_ex(1, &sys_part, false, 0, true);
+	_check(nx_emmc_bis_sectors_ex(0) == PART_SECTORS && nx_emmc_bis_sectors_ex(1) == PART_SECTORS, "partition sizes");
+	for (u32 sct = 0; sct < PART_SECTORS; sct += BIS_CLUSTER_SECTORS)
+	{
+		nx_emmc_bis_write_ex(0, sct, BIS_CLUSTER_SECTORS, sd_image + (size_t)sct * 512);
+		nx_emmc_bis_write_ex(1, sct, BIS_CLUSTER_SECTORS, sd_image + (size_t)sct * 512);
+	}
+	_check(memcmp(sys_emmc + SYS_LBA * 512, sd_image, SZ_64K) && memcmp(emu_emmc + EMU_LBA * 512, sd_image, SZ_64K),
+		"stored encrypted");
+	bool outside = true;
+	for (u32 i = 0; i < EMU_LBA * 512; i++)
+		outside &= !emu_emmc[i];
+	for (size_t i = (size_t)SYS_LBA * 512 - 512; i < (size_t)SYS_LBA * 512; i++)
+		outside &= !sys_emmc[i] && !sys_emmc[i + (size_t)PART_SECTORS * 512 + 512];
+	_check(outside, "each side in its own eMMC and partition");
+
+	if (f_mount(&fs, "bis:", 1) || f_mount(&fs2, "bis2:", 1))
+	{
+		printf("bis_dual: FAIL mount both volumes\n");
+		return 1;
+	}
+
+	// Files on the emuMMC side go over to the physical eMMC, then come back under new names.
+	f_mkdir("bis:/save");
+	f_mkdir("bis2:/save");
+	for (u32 i = 0; i < ARRAY_SIZE(sizes); i++)
+	{
+		s_printf(src, "bis:/save/800000000000005%d", i);
+		_check(_file(src, sizes[i], i), "source file");
+	}
+	for (u32 i = 0; i < ARRAY_SIZE(sizes); i++)
+	{
+		s_printf(src, "bis:/save/800000000000005%d", i);
+		s_printf(dst, "bis2:/save/800000000000005%d", i);
+		_check(_copy(src, dst) == FR_OK, "copy to bis2");
+		_check(_same(src, dst), "copy matches");
+		s_printf(dst, "bis:/save/back%d", i);
+		s_printf(src, "bis2:/save/800000000000005%d", i);
+		_check(_copy(src, dst) == FR_OK && _same(src, dst), "copy back matches");
+	}
+
+	// A fresh mount decrypts both sides from the eMMCs again.
+	f_mount(NULL, "bis:", 1);
+	f_mount(NULL, "bis2:", 1);
+	nx_emmc_bis_init_ex(0, &emu_part, false, 0, false);
+	nx_emmc_bis_init_ex(1, &sys_part, false, 0, true);
+	_check(!f_mount(&fs, "bis:", 1) && !f_mount(&fs2, "bis2:", 1), "remount both volumes");
+	for (u32 i = 0; i < ARRAY_SIZE(sizes); i++)
+	{
+		s_printf(src, "bis:/save/800000000000005%d", i);
+		s_printf(dst, "bis2:/save/800000000000005%d", i);
+		_check(_same(src, dst), "copy survives remount");
+		FILINFO fno;
+		_check(!f_stat(dst, &fno) && fno.fsize == sizes[i], "copy size");
+	}
+	f_mount(NULL, "bis:", 1);
+	f_mount(NULL, "bis2:", 1);
+
+	// With the contexts swapped each eMMC is read through the other volume, and must hold every file.
+	nx_emmc_bis_init_ex(0, &sys_part, false, 0, true);
+	nx_emmc_bis_init_ex(1, &emu_part, false, 0, false);
+	_check(!f_mount(&fs, "bis:", 1) && !f_mount(&fs2, "bis2:", 1), "mount swapped");
+	for (u32 i = 0; i < ARRAY_SIZE(sizes); i++)
+	{
+		s_printf(src, "bis:/save/800000000000005%d", i);
+		_check(_holds(src, sizes[i], i), "eMMC holds the copy");
+		s_printf(src, "bis:/save/back%d", i);
+		_check(f_stat(src, NULL) == FR_NO_FILE, "eMMC holds only the copies");
+		s_printf(dst, "bis2:/save/800000000000005%d", i);
+		_check(_holds(dst, sizes[i], i), "emuMMC holds the source");
+		s_printf(dst, "bis2:/save/back%d", i);
+		_check(_holds(dst, sizes[i], i), "emuMMC holds the copy back");
+	}
+	f_mount(NULL, "bis:", 1);
+	f_mount(NULL, "bis2:", 1);
+	nx_emmc_bis_end_ex(0);
+	nx_emmc_bis_end_ex(1);
+	_check(!nx_emmc_bis_sectors_ex(0) && !nx_emmc_bis_sectors_ex(1), "contexts ended");
+
+	if (!failed)
+		printf("bis_dual: OK\n");
+	return failed;
+}
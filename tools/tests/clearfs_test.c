@@ -0,0 +1,176 @@
+/*
+ * Host check of f_clearfs on the real FatFs over a RAM disk.
+ * A cleared FAT32 must keep its boot sector, give back every cluster but the root,
+ * hold an empty root and take new files. Volumes it can't clear must not be written.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libs/fatfs/ff.h>
+#include <libs/fatfs/diskio.h>
+
+#include "ramdisk.h"
+
+#define DISK_SECTORS (128 * 1024 * 2) // 128MB.
+
+static u8 data[SZ_64K];
+static int failed;
+
+
+
+static void _check(bool cond, const char *fs_name, const char *what)
+{
+	if (!cond)
+	{
+		printf("clearfs: FAIL %s %s\n", fs_name, what);
+		failed = 1;
+	}
+}
+
+// Remounts so the free count comes from a full FAT scan.
+static DWORD _free_clusters(FATFS *fs)
+{
+	FATFS *pfs;
+	DWORD fre = 0;
+	f_mount(NULL, "sd:", 1);
+	f_mount(fs, "sd:", 1);
+	f_getfree("sd:", &fre, &pfs);
+	return fre;
+}
+
+static void _file(const char *path, u32 size)
+{
+	FIL fp;
+	UINT bw;
+	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE))
+	{
+		printf("clearfs: cannot create %s\n", path);
+		exit(1);
+	}
+	for (u32 done = 0; done < size; done += bw)
+		f_write(&fp, data, MIN(size - done, sizeof(data)), &bw);
+	f_close(&fp);
+}
+
+static u32 _entries(const char *path)
+{
+	DIR dir;
+	FILINFO fno;
+	u32 count = 0;
+	if (f_opendir(&dir, path))
+		return 0;
+	while (!f_readdir(&dir, &fno) && fno.fname[0])
+		count++;
+	f_closedir(&dir);
+	return count;
+}
+
+static void _fill()
+{
+	char path[64];
+	f_mkdir("sd:/Contents");
+	f_mkdir("sd:/Contents/registered");
+	for (u32 i = 0; i < 200; i++)
+	{
+		sprintf(path, "sd:/Contents/registered/file number %u.nca", i);
+		_file(path, 100 + (i % 9) * 7000);
+	}
+	_file("sd:/PRF2SAFE.RCV", 2000);
+}
+
+static bool _mkfs(FATFS *fs, BYTE opt, UINT cluster)
+{
+	static u8 work[SZ_64K];
+	ramdisk_init(DRIVE_SD, DISK_SECTORS);
+	return !f_mkfs("sd:", opt | FM_SFD, cluster, work, sizeof(work)) && !f_mount(fs, "sd:", 1);
+}
+
+static void _run(BYTE opt, UINT cluster, UINT work_size, const char *fs_name)
+{
+	static FATFS fs;
+	static u8 vbr[512], work[SZ_64K];
+	ramdisk_t *sd = &ramdisk[DRIVE_SD];
+
+	if (!_mkfs(&fs, opt, cluster))
+	{
+		_check(false, fs_name, "ram disk");
+		return;
+	}
+	DWORD clusters = fs.n_fatent - 2;
+	_fill();
+	memcpy(vbr, sd->data, sizeof(vbr));
+	_check(_free_clusters(&fs) < clusters - 1000, fs_name, "files use clusters");
+
+	// A file is still open with its FAT sector dirty when clearing starts, it must not come back.
+	// PrFILE2 keeps its own state after the FSINFO sector.
+	FIL fp;
+	UINT bw;
+	f_open(&fp, "sd:/open.bin", FA_CREATE_ALWAYS | FA_WRITE);
+	f_write(&fp, data, 3000, &bw);
+	u8 *fsinfo = sd->data + 512, *prf2 = sd->data + 3 * 512;
+	memset(prf2, 0x5A, 512);
+	*(u32 *)(fsinfo + 488) = 5;
+	*(u32 *)(fsinfo + 492) = 5;
+	_check(f_clearfs("sd:", work, work_size) == FR_OK, fs_name, "clear");
+	_check(!memcmp(vbr, sd->data, sizeof(vbr)), fs_name, "boot sector kept");
+	bool zero = true;
+	for (u32 i = 0; i < 512; i++)
+		zero &= !prf2[i];
+	_check(zero, fs_name, "PrFILE2 safe info cleared");
+	_check(*(u32 *)(fsinfo + 488) == 0xFFFFFFFF && *(u32 *)(fsinfo + 492) == 0xFFFFFFFF, fs_name, "FSINFO counts unknown");
+	_check(_free_clusters(&fs) == clusters - 1, fs_name, "every cluster but the root free");
+	_check(!_entries("sd:/"), fs_name, "root empty");
+
+	// The volume takes new files and gives them back intact.
+	_check(f_mkdir("sd:/Contents") == FR_OK, fs_name, "new folder");
+	for (u32 i = 0; i < sizeof(data); i++)
+		data[i] = i * 7;
+	_file("sd:/Contents/a.bin", 200000);
+	u8 back[SZ_64K];
+	UINT br;
+	_check(!f_open(&fp, "sd:/Contents/a.bin", FA_READ) && !f_read(&fp, back, sizeof(back), &br) &&
+		br == sizeof(back) && !memcmp(back, data, sizeof(back)), fs_name, "new file reads back");
+	f_close(&fp);
+	_check(_free_clusters(&fs) == clusters - 1 - 1 - (200000 + fs.csize * 512 - 1) / (fs.csize * 512),
+		fs_name, "new files counted");
+
+	// Too small a buffer writes nothing.
+	ramdisk_reset_counts(DRIVE_SD);
+	_check(f_clearfs("sd:", work, 511) == FR_NOT_ENOUGH_CORE && !sd->writes, fs_name, "small buffer not written");
+
+	// A failed write is reported.
+	for (u32 at = 1; at <= 4; at++)
+	{
+		_check(!f_mount(&fs, "sd:", 1), fs_name, "remount");
+		ramdisk_reset_counts(DRIVE_SD);
+		sd->fail_write = at;
+		_check(f_clearfs("sd:", work, sizeof(work)) == FR_DISK_ERR, fs_name, "disk error reported");
+	}
+	sd->fail_write = 0;
+	f_mount(NULL, "sd:", 1);
+}
+
+int main()
+{
+	// A PrFILE2 style volume like USER and SYSTEM, scaled down so FAT32 still fits the disk, and a plain one
+	// cleared through a buffer smaller than a FAT.
+	_run(FM_FAT32 | FM_PRF2, 2 * 512, SZ_64K, "prf2");
+	_run(FM_FAT32, 0, 4 * 512, "fat32");
+
+	// Anything but FAT32 is refused untouched.
+	static FATFS fs;
+	static u8 work[SZ_64K];
+	if (_mkfs(&fs, FM_EXFAT, 0))
+	{
+		ramdisk_reset_counts(DRIVE_SD);
+		_check(f_clearfs("sd:", work, sizeof(work)) == FR_INVALID_PARAMETER && !ramdisk[DRIVE_SD].writes,
+			"exfat", "refused unwritten");
+	}
+	else
+		_check(false, "exfat", "ram disk");
+
+	if (!failed)
+		printf("clearfs: OK\n");
+	return failed;
+}
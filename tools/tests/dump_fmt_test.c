@@ -0,0 +1,642 @@
+/*
+ * Host check of the dump formats: a dump must restore or verify as made, a corrupted one must not.
+ * Runs the real FatFs over a RAM disk and a software SHA-256 standing in for the SE.
+ */
+
+// The BDK heap API is declared with u32 sizes, rename it next to the host one.
+#define malloc heap_malloc
+#define calloc heap_calloc
+#define free heap_free
+#include "../../source/dump/dump_fmt.c"
+#include "../../bdk/libs/compr/lz4.c"
+#undef malloc
+#undef calloc
+#undef free
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <time.h>
+#include <libs/fatfs/diskio.h>
+
+#include "ramdisk.h"
+
+#define DISK_SECTORS (64 * 1024 * 2) // 64MB.
+#define IMAGE_SIZE   (SZ_4M * 2 + SZ_1M + 3 * 512)
+
+u32 COPY_BUF_SIZE = 0x80000;
+
+static log_msg_id_t last_log;
+
+void *heap_malloc(u32 size) { return malloc(size); }
+void *zalloc(u32 size) { return calloc(1, size); }
+void heap_free(void *p) { free(p); }
+
+void ui_spinner_draw() {}
+static u32 last_chunk;
+
+void log_printf(bool record_message, log_level_t lvl, log_msg_id_t id, ...)
+{
+	va_list ap;
+	va_start(ap, id);
+	last_log = id;
+	if (id == LOG_MSG_FLASH_PARTITION_HASH_MISMATCH)
+		last_chunk = va_arg(ap, u32);
+	va_end(ap);
+}
+
+// SE SHA-256 model. finalize hands back the chaining value until the stream is padded, like the engine.
+static const u32 K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static u32 sha_state[8];
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void _sha_block(const u8 *p)
+{
+	u32 w[64], s[8];
+	for (int i = 0; i < 16; i++)
+		w[i] = (u32)p[i * 4] << 24 | (u32)p[i * 4 + 1] << 16 | (u32)p[i * 4 + 2] << 8 | p[i * 4 + 3];
+	for (int i = 16; i < 64; i++)
+		w[i] = w[i - 16] + (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+			w[i - 7] + (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10));
+	memcpy(s, sha_state, sizeof(s));
+	for (int i = 0; i < 64; i++)
+	{
+		u32 t1 = s[7] + (ROR(s[4], 6) ^ ROR(s[4], 11) ^ ROR(s[4], 25)) + ((s[4] & s[5]) ^ (~s[4] & s[6])) + K[i] + w[i];
+		u32 t2 = (ROR(s[0], 2) ^ ROR(s[0], 13) ^ ROR(s[0], 22)) + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+		memmove(s + 1, s, 7 * sizeof(u32));
+		s[4] += t1;
+		s[0] = t1 + t2;
+	}
+	for (int i = 0; i < 8; i++)
+		sha_state[i] += s[i];
+}
+
+int se_sha_hash_256_partial_start(void *hash, const void *src, u32 size, bool is_oneshot)
+{
+	static const u32 iv[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+	memcpy(sha_state, iv, sizeof(iv));
+	for (u32 i = 0; i < size; i += 64)
+		_sha_block((const u8 *)src + i);
+	return size & 63;
+}
+
+int se_sha_hash_256_partial_update(void *hash, const void *src, u32 size, bool is_oneshot)
+{
+	for (u32 i = 0; i < size; i += 64)
+		_sha_block((const u8 *)src + i);
+	return size & 63;
+}
+
+int se_sha_hash_256_partial_end(void *hash, u64 total_size, const void *src, u32 src_size, bool is_oneshot)
+{
+	u8 tail[128] = {0};
+	u32 full = src_size & ~63;
+	u32 rest = src_size - full;
+	for (u32 i = 0; i < full; i += 64)
+		_sha_block((const u8 *)src + i);
+	memcpy(tail, (const u8 *)src + full, rest);
+	tail[rest] = 0x80;
+	u32 len = rest < 56 ? 64 : 128;
+	for (int i = 0; i < 8; i++)
+		tail[len - 1 - i] = (u8)((total_size * 8) >> (i * 8));
+	for (u32 i = 0; i < len; i += 64)
+		_sha_block(tail + i);
+	return 0;
+}
+
+int se_sha_hash_256_finalize(void *hash)
+{
+	u8 *out = hash;
+	for (int i = 0; i < 8; i++)
+	{
+		out[i * 4]     = sha_state[i] >> 24;
+		out[i * 4 + 1] = sha_state[i] >> 16;
+		out[i * 4 + 2] = sha_state[i] >> 8;
+		out[i * 4 + 3] = sha_state[i];
+	}
+	return 0;
+}
+
+int se_sha_hash_256_async(void *hash, const void *src, u32 size)
+{
+	se_sha_hash_256_partial_start(hash, src, 0, false);
+	return se_sha_hash_256_partial_end(hash, size, src, size, false);
+}
+
+int se_sha_hash_256_oneshot(void *hash, const void *src, u32 size)
+{
+	se_sha_hash_256_async(hash, src, size);
+	return se_sha_hash_256_finalize(hash);
+}
+
+static int failed;
+
+static void _check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		printf("dump_fmt: FAIL %s\n", what);
+		failed = 1;
+	}
+}
+
+// Same loop as _flash_or_dump_part_io when dumping to a plain file.
+static bool _dump(const char *path, const u8 *image, u32 size)
+{
+	FIL fp, mf;
+	char mpath[256];
+	sha_stream_t sha = { .total = size };
+	u8 *buff = malloc(COPY_BUF_SIZE);
+
+	s_printf(mpath, "%s%s", path, SHA_MANIFEST_EXT);
+	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE) || f_open(&mf, mpath, FA_CREATE_ALWAYS | FA_WRITE))
+		return false;
+
+	bool ok = sha_manifest_head(&mf, sha.hash, path);
+	for (u32 pos = 0; ok && pos < size; pos += COPY_BUF_SIZE)
+	{
+		u32 num = MIN(size - pos, COPY_BUF_SIZE);
+		memcpy(buff, image + pos, num);
+		ok = !sha_stream_start(&sha, buff, num) && dump_put(&fp, buff, num) && !sha_stream_wait(&sha) &&
+			sha_manifest_mark(&mf, &sha);
+	}
+	ok = ok && !f_lseek(&mf, 0) && sha_manifest_head(&mf, sha.hash, path);
+	ok = !f_close(&mf) && !f_close(&fp) && ok;
+
+	free(buff);
+	return ok;
+}
+
+static bool _verify(const char *path)
+{
+	FIL fp;
+	u8 *buff = malloc(COPY_BUF_SIZE);
+	if (f_open(&fp, path, FA_READ))
+		return false;
+
+	bool ok = sha_manifest_verify(&fp, path, buff, NULL);
+	_check(!ok || f_tell(&fp) == 0, "image rewound after verify");
+	f_close(&fp);
+	free(buff);
+	return ok;
+}
+
+// Checks the sha256sum compatible first line and returns how many chunk lines follow it.
+static u32 _manifest_chunks(const char *mpath, const char *hex, const char *name)
+{
+	FIL mf;
+	char line[128];
+	u32 chunks = 0;
+
+	if (f_open(&mf, mpath, FA_READ))
+		return 0;
+	f_gets(line, sizeof(line), &mf);
+	_check(!memcmp(line, hex, SHA_HEX_LEN) && !strncmp(line + SHA_HEX_LEN, "  ", 2) &&
+		!strncmp(line + SHA_HEX_LEN + 2, name, strlen(name)) && line[SHA_HEX_LEN + 2 + strlen(name)] == '\n', "whole-file line");
+	while (f_gets(line, sizeof(line), &mf))
+		_check(line[0] == '#' && atoi(line + 2) == (int)++chunks && strlen(line) == SHA_HEX_LEN + 5, "chunk line");
+	f_close(&mf);
+	return chunks;
+}
+
+static void _patch(const char *path, u32 offset, u8 value)
+{
+	FIL fp;
+	UINT bw;
+	f_open(&fp, path, FA_WRITE);
+	f_lseek(&fp, offset);
+	f_write(&fp, &value, 1, &bw);
+	f_close(&fp);
+}
+
+static void _test_manifest(const u8 *image)
+{
+	char hex[SHA_HEX_LEN + 1];
+	u8 hash[SE_SHA_256_SIZE];
+
+	// Reference digest, and the SHA-256 of "abc" to pin the model itself.
+	se_sha_hash_256_oneshot(hash, "abc", 3);
+	sha_hex(hex, hash);
+	_check(!strcmp(hex, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"), "sha model");
+	se_sha_hash_256_oneshot(hash, image, IMAGE_SIZE);
+	sha_hex(hex, hash);
+
+	_check(_dump("sd:/part.bin", image, IMAGE_SIZE), "dump");
+
+	_check(_manifest_chunks("sd:/part.bin" SHA_MANIFEST_EXT, hex, "part.bin") == IMAGE_SIZE / SHA_MANIFEST_CHUNK, "chunk count");
+
+	_check(_verify("sd:/part.bin"), "verify clean dump");
+	_check(last_log == LOG_MSG_FLASH_PARTITION_HASH_OK, "hash ok message");
+
+	// A flipped byte in the second chunk is caught at that chunk.
+	_patch("sd:/part.bin", SHA_MANIFEST_CHUNK + 1234, image[SHA_MANIFEST_CHUNK + 1234] ^ 1);
+	_check(!_verify("sd:/part.bin"), "verify corrupted chunk");
+	_check(last_log == LOG_MSG_FLASH_PARTITION_HASH_MISMATCH && last_chunk == 2, "mismatch at chunk 2");
+	_patch("sd:/part.bin", SHA_MANIFEST_CHUNK + 1234, image[SHA_MANIFEST_CHUNK + 1234]);
+
+	// Past the last mark, only the whole-file line can catch it.
+	_patch("sd:/part.bin", IMAGE_SIZE - 1, image[IMAGE_SIZE - 1] ^ 0x80);
+	_check(!_verify("sd:/part.bin"), "verify corrupted tail");
+	_patch("sd:/part.bin", IMAGE_SIZE - 1, image[IMAGE_SIZE - 1]);
+	_check(_verify("sd:/part.bin"), "verify restored dump");
+
+	// A damaged manifest fails too, a missing one lets old dumps through.
+	_patch("sd:/part.bin" SHA_MANIFEST_EXT, SHA_HEX_LEN + 16, 'x');
+	_check(!_verify("sd:/part.bin"), "verify corrupted manifest");
+	f_unlink("sd:/part.bin" SHA_MANIFEST_EXT);
+	_check(_verify("sd:/part.bin"), "verify without manifest");
+
+	// A chunk-aligned size ends on the whole-file line, not on an extra chunk line.
+	_check(_dump("sd:/even.bin", image, SHA_MANIFEST_CHUNK * 2), "dump aligned");
+	se_sha_hash_256_oneshot(hash, image, SHA_MANIFEST_CHUNK * 2);
+	sha_hex(hex, hash);
+	_check(_manifest_chunks("sd:/even.bin" SHA_MANIFEST_EXT, hex, "even.bin") == 1, "aligned chunk count");
+	_check(_verify("sd:/even.bin"), "verify aligned");
+}
+
+static u8 *part;
+static u32 part_writes;
+
+// The partition sits past a few sectors, like a GPT entry on the eMMC.
+#define PART_LBA      64
+#define PART_SIZE     SZ_4M
+#define PART_CLUSTERS (PART_SIZE / SPARSE_CLUSTER_SIZE)
+#define CL(n)         ((n) * SPARSE_CLUSTER_SIZE)
+
+int part_io(bool write, bool bis, u32 lba, u32 num, void *buf)
+{
+	if (lba < PART_LBA || lba + num > PART_LBA + PART_SIZE / 512)
+		return 1;
+	if (write)
+	{
+		memcpy(part + (lba - PART_LBA) * 512, buf, num * 512);
+		part_writes += num;
+	}
+	else
+		memcpy(buf, part + (lba - PART_LBA) * 512, num * 512);
+	return 0;
+}
+
+// Same files dump_part_sparse opens around sparse_dump.
+static bool _sparse(const char *path, const char *base_path)
+{
+	FIL fp, hf;
+	char hpath[256];
+	u8 *buff = malloc(COPY_BUF_SIZE);
+
+	s_printf(hpath, "%s%s", path, SPARSE_HASH_EXT);
+	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE) || f_open(&hf, hpath, FA_CREATE_ALWAYS | FA_WRITE))
+		return false;
+
+	bool ok = sparse_dump(&fp, &hf, path, base_path, PART_LBA, PART_CLUSTERS, false, buff);
+	ok = !f_close(&hf) && !f_close(&fp) && ok;
+
+	free(buff);
+	return ok;
+}
+
+static bool _sparse_load(const char *path)
+{
+	FIL fp;
+	u8 *buff = malloc(COPY_BUF_SIZE);
+	if (f_open(&fp, path, FA_READ))
+		return false;
+
+	memset(part, 0xA5, PART_SIZE);
+	part_writes = 0;
+	bool ok = sparse_restore(&fp, path, PART_LBA, PART_CLUSTERS, false, buff);
+	f_close(&fp);
+	free(buff);
+	return ok;
+}
+
+static void _sparse_hdr(const char *path, sparse_hdr_t *hdr, u64 *size)
+{
+	FIL fp;
+	UINT br;
+	memset(hdr, 0, sizeof(*hdr));
+	if (f_open(&fp, path, FA_READ))
+		return;
+	f_read(&fp, hdr, sizeof(*hdr), &br);
+	*size = f_size(&fp);
+	f_close(&fp);
+}
+
+static void _test_sparse(const u8 *image)
+{
+	u8 *full = malloc(PART_SIZE), *cur = malloc(PART_SIZE);
+	sparse_hdr_t hdr;
+	u64 size;
+
+	// Data with a zero run across a chunk edge and a short one.
+	part = malloc(PART_SIZE);
+	memcpy(full, image, PART_SIZE);
+	memset(full + CL(3), 0, CL(40));
+	memset(full + CL(100), 0, CL(5));
+	memcpy(part, full, PART_SIZE);
+
+	f_mkdir("sd:/bk");
+	_check(_sparse("sd:/bk/SYS.lssp", NULL), "sparse dump");
+	_sparse_hdr("sd:/bk/SYS.lssp", &hdr, &size);
+	// Extents end at each 32 cluster chunk: 0-2, 43-63, 64-95, 96-99, 105-127, four whole chunks and the end marker.
+	_check(hdr.magic == SPARSE_MAGIC && !hdr.flags && size == sizeof(hdr) + 10 * sizeof(sparse_ext_t) + CL(PART_CLUSTERS - 45),
+		"sparse dump skips zero clusters");
+
+	// One changed cluster, one zero cluster filled and two data clusters zeroed.
+	memcpy(cur, full, PART_SIZE);
+	cur[CL(10) + 5] ^= 1;
+	memcpy(cur + CL(5), image + CL(200), CL(1));
+	memset(cur + CL(50), 0, CL(2));
+	memcpy(part, cur, PART_SIZE);
+
+	_check(_sparse("sd:/bk/SYS_diff.lssp", "sd:/bk/SYS.lssp"), "diff dump");
+	_sparse_hdr("sd:/bk/SYS_diff.lssp", &hdr, &size);
+	_check(hdr.flags == SPARSE_FLAG_DIFF && !strcmp(hdr.base, "SYS.lssp"), "diff base stored by name");
+	_check(size == sizeof(hdr) + 4 * sizeof(sparse_ext_t) + CL(2), "diff only stores changed clusters");
+
+	// The base is found next to the diff wherever the folder went.
+	f_rename("sd:/bk", "sd:/moved");
+	_check(_sparse_load("sd:/moved/SYS_diff.lssp") && !memcmp(part, cur, PART_SIZE), "restore moved diff chain");
+	_check(_sparse_load("sd:/moved/SYS.lssp") && !memcmp(part, full, PART_SIZE), "restore full dump");
+
+	// A base in another folder keeps its drive path.
+	memcpy(part, cur, PART_SIZE);
+	f_mkdir("sd:/other");
+	_check(_sparse("sd:/other/SYS_diff.lssp", "sd:/moved/SYS.lssp"), "diff dump across folders");
+	_sparse_hdr("sd:/other/SYS_diff.lssp", &hdr, &size);
+	_check(!strcmp(hdr.base, "sd:/moved/SYS.lssp"), "diff base stored with drive");
+	_check(_sparse_load("sd:/other/SYS_diff.lssp") && !memcmp(part, cur, PART_SIZE), "restore diff across folders");
+
+	// A bad cluster in the base is caught before the first sector is written.
+	_patch("sd:/moved/SYS.lssp", sizeof(hdr) + sizeof(sparse_ext_t) + 7, full[7] ^ 1);
+	_check(!_sparse_load("sd:/moved/SYS_diff.lssp") && !part_writes, "corrupted base rejected");
+	_check(last_log == LOG_MSG_FLASH_PARTITION_HASH_MISMATCH && last_chunk == 0, "mismatch at cluster 0");
+
+	// So is a missing base.
+	f_unlink("sd:/moved/SYS.lssp");
+	_check(!_sparse_load("sd:/moved/SYS_diff.lssp") && !part_writes, "missing base rejected");
+
+	free(part);
+	free(cur);
+	free(full);
+}
+
+// Same loop as _flash_or_dump_part_io for an LZ4 dump, manifest included.
+static bool _lz4_dump(const char *path, const u8 *image, u32 size)
+{
+	FIL fp, mf;
+	char mpath[256];
+	lz4c_t lz = {0};
+	sha_stream_t sha = { .total = size };
+	u8 *buff = malloc(COPY_BUF_SIZE);
+
+	s_printf(mpath, "%s%s", path, SHA_MANIFEST_EXT);
+	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE) || f_open(&mf, mpath, FA_CREATE_ALWAYS | FA_WRITE))
+		return false;
+
+	bool ok = lz4c_create(&lz, &fp, size) && sha_manifest_head(&mf, sha.hash, path);
+	for (u32 pos = 0; ok && pos < size; pos += COPY_BUF_SIZE)
+	{
+		u32 num = MIN(size - pos, COPY_BUF_SIZE);
+		memcpy(buff, image + pos, num);
+		ok = !sha_stream_start(&sha, buff, num) && lz4c_write(&lz, buff, num) && !sha_stream_wait(&sha) &&
+			sha_manifest_mark(&mf, &sha);
+	}
+	ok = ok && !f_lseek(&mf, 0) && sha_manifest_head(&mf, sha.hash, path) && lz4c_finish(&lz);
+	ok = !f_close(&mf) && !f_close(&fp) && ok;
+
+	lz4c_free(&lz);
+	free(buff);
+	return ok;
+}
+
+// Verifies against the manifest, then expands the whole image like a flash would.
+static bool _lz4_load(const char *path, const u8 *image, u32 size, bool manifest)
+{
+	FIL fp;
+	lz4c_t lz = {0};
+	u8 *buff = malloc(COPY_BUF_SIZE);
+	if (f_open(&fp, path, FA_READ))
+		return false;
+
+	bool ok = lz4c_open(&lz, &fp) && lz.hdr.raw_size == size;
+	if (ok && manifest)
+		ok = sha_manifest_verify(&fp, path, buff, &lz);
+	for (u32 pos = 0; ok && pos < size; pos += COPY_BUF_SIZE)
+	{
+		u32 num = MIN(size - pos, COPY_BUF_SIZE);
+		ok = lz4c_read(&lz, buff, num) && !memcmp(buff, image + pos, num);
+	}
+	f_close(&fp);
+	lz4c_free(&lz);
+	free(buff);
+	return ok;
+}
+
+static void _copy(const char *src, const char *dst)
+{
+	FIL in, out;
+	UINT br, bw;
+	u8 *buff = malloc(COPY_BUF_SIZE);
+	f_open(&in, src, FA_READ);
+	f_open(&out, dst, FA_CREATE_ALWAYS | FA_WRITE);
+	while (!f_read(&in, buff, COPY_BUF_SIZE, &br) && br)
+		f_write(&out, buff, br, &bw);
+	f_close(&out);
+	f_close(&in);
+	free(buff);
+}
+
+static bool _lz4_opens(const char *path)
+{
+	FIL fp;
+	lz4c_t lz = {0};
+	if (f_open(&fp, path, FA_READ))
+		return false;
+	bool ok = lz4c_open(&lz, &fp);
+	f_close(&fp);
+	lz4c_free(&lz);
+	return ok;
+}
+
+static void _lz4_patch_hdr(const char *src, const char *dst, u32 offset, u32 value)
+{
+	_copy(src, dst);
+	FIL fp;
+	UINT bw;
+	f_open(&fp, dst, FA_WRITE);
+	f_lseek(&fp, offset);
+	f_write(&fp, &value, sizeof(value), &bw);
+	f_close(&fp);
+}
+
+static void _test_lz4c(const u8 *image)
+{
+	// Compressible blocks up front, random ones after, and a tail that is not a whole block.
+	u32 size = IMAGE_SIZE - SZ_4M;
+	u8 *mixed = malloc(size);
+	memcpy(mixed, image, size);
+	for (u32 i = 0; i < SZ_2M; i++)
+		mixed[i] = (i / 512) & 0xF ? 0 : (u8)i;
+	memset(mixed + size - 3 * 512, 0, 512);
+
+	_check(_lz4_dump("sd:/part.lz4", mixed, size), "lz4 dump");
+	_check(_lz4_load("sd:/part.lz4", mixed, size, true), "lz4 verify and expand");
+
+	FIL fp;
+	lz4c_t lz = {0};
+	f_open(&fp, "sd:/part.lz4", FA_READ);
+	_check(lz4c_open(&lz, &fp), "lz4 open");
+	u32 raw = 0;
+	for (u32 i = 0; i < lz.hdr.blocks; i++)
+		raw += !!(lz.sizes[i] & LZ4C_RAW);
+	// The short tail block packs thanks to its zero sector.
+	_check(lz.hdr.blocks == DIV_ROUND_UP(size, LZ4C_BLOCK_SIZE) && !(lz.sizes[0] & LZ4C_RAW) &&
+		!(lz.sizes[lz.hdr.blocks - 1] & LZ4C_RAW) && raw == lz.hdr.blocks - SZ_2M / LZ4C_BLOCK_SIZE - 1, "random blocks stored raw");
+	_check(f_size(&fp) < size - SZ_2M + SZ_64K, "compressible blocks packed");
+	u32 csize0 = lz.sizes[0];
+	f_close(&fp);
+	lz4c_free(&lz);
+
+	// Any header or size table that does not add up to the file is refused at open.
+	u32 table = sizeof(lz4c_hdr_t);
+	_lz4_patch_hdr("sd:/part.lz4", "sd:/bad.lz4", 0, 0x12345678);
+	_check(!_lz4_opens("sd:/bad.lz4"), "bad magic");
+	_lz4_patch_hdr("sd:/part.lz4", "sd:/bad.lz4", offsetof(lz4c_hdr_t, block_size), SZ_128K);
+	_check(!_lz4_opens("sd:/bad.lz4"), "bad block size");
+	_lz4_patch_hdr("sd:/part.lz4", "sd:/bad.lz4", offsetof(lz4c_hdr_t, blocks), 0x40000000);
+	_check(!_lz4_opens("sd:/bad.lz4"), "bad block count");
+	_lz4_patch_hdr("sd:/part.lz4", "sd:/bad.lz4", table, csize0 + 1);
+	_check(!_lz4_opens("sd:/bad.lz4"), "size table past the file");
+	_lz4_patch_hdr("sd:/part.lz4", "sd:/bad.lz4", table, LZ4C_BLOCK_SIZE + 1);
+	_check(!_lz4_opens("sd:/bad.lz4"), "block over the block size");
+
+	_copy("sd:/part.lz4", "sd:/bad.lz4");
+	f_open(&fp, "sd:/bad.lz4", FA_WRITE);
+	f_lseek(&fp, f_size(&fp) - 100);
+	f_truncate(&fp);
+	f_close(&fp);
+	_check(!_lz4_opens("sd:/bad.lz4"), "truncated file");
+
+	// Damage inside a compressed block gets past LZ4 or not, the manifest catches it either way.
+	_patch("sd:/part.lz4", table + lz.hdr.blocks * sizeof(u32) + csize0 / 2, 0x5A);
+	_check(!_lz4_load("sd:/part.lz4", mixed, size, true), "corrupted lz4 block");
+	_check(last_log == LOG_MSG_FLASH_PARTITION_HASH_MISMATCH || last_log == LOG_MSG_ERR_FILE_READ, "lz4 mismatch message");
+
+	free(mixed);
+}
+
+static u64 _ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Prints the packed size and dump and restore speed for partitions with a set share of random 16KB clusters.
+// The rest is zero, like space that was never written. Dump and restore include the software SHA-256
+// standing in for the SE, so LZ4 is timed on its own as well.
+static void _lz4_rates(const u8 *image)
+{
+	static const u32 random_pct[] = { 0, 25, 50, 100 };
+	const u32 size = SZ_4M * 4;
+	u8 *part = malloc(size), *packed = malloc(size), *expanded = malloc(size);
+	int *csizes = malloc(size / LZ4C_BLOCK_SIZE * sizeof(int));
+	void *state = malloc(LZ4_sizeofState());
+
+	for (u32 t = 0; t < ARRAY_SIZE(random_pct); t++)
+	{
+		for (u32 pos = 0; pos < size; pos += SZ_16K)
+		{
+			if ((pos / SZ_16K * 37) % 100 < random_pct[t])
+				memcpy(part + pos, image + pos % (IMAGE_SIZE - SZ_16K), SZ_16K);
+			else
+				memset(part + pos, 0, SZ_16K);
+		}
+
+		u64 start = _ns();
+		bool ok = _lz4_dump("sd:/rate.lz4", part, size);
+		u64 dump_ns = _ns() - start;
+		start = _ns();
+		ok = ok && _lz4_load("sd:/rate.lz4", part, size, true);
+		u64 load_ns = _ns() - start;
+		FILINFO fno;
+		ok = ok && !f_stat("sd:/rate.lz4", &fno);
+
+		// LZ4 alone, block by block the way lz4c packs them. Blocks that don't pack are stored raw.
+		start = _ns();
+		for (u32 pos = 0; pos < size; pos += LZ4C_BLOCK_SIZE)
+			csizes[pos / LZ4C_BLOCK_SIZE] = LZ4_compress_fast_extState(state, (char *)part + pos,
+				(char *)packed + pos, LZ4C_BLOCK_SIZE, LZ4C_BLOCK_SIZE - 1, 1);
+		u64 pack_ns = _ns() - start;
+		start = _ns();
+		for (u32 pos = 0; pos < size; pos += LZ4C_BLOCK_SIZE)
+		{
+			int csize = csizes[pos / LZ4C_BLOCK_SIZE];
+			if (csize)
+				ok &= LZ4_decompress_safe((char *)packed + pos, (char *)expanded + pos, csize, LZ4C_BLOCK_SIZE) == LZ4C_BLOCK_SIZE;
+			else
+				memcpy(expanded + pos, part + pos, LZ4C_BLOCK_SIZE);
+		}
+		u64 expand_ns = _ns() - start;
+		ok = ok && !memcmp(expanded, part, size);
+
+		_check(ok, "lz4 rate partition");
+		if (ok)
+			printf("dump_fmt: lz4 %uMB, %3u%% random clusters: %3u.%u%% of raw, dump %u MB/s, verify and restore %u MB/s, "
+				"LZ4 alone %u MB/s packing, %u MB/s expanding\n",
+				size / SZ_1M, random_pct[t], (u32)(fno.fsize * 100 / size), (u32)(fno.fsize * 1000 / size % 10),
+				(u32)((u64)size * 1000 / dump_ns), (u32)((u64)size * 1000 / load_ns),
+				(u32)((u64)size * 1000 / pack_ns), (u32)((u64)size * 1000 / expand_ns));
+		f_unlink("sd:/rate.lz4");
+		f_unlink("sd:/rate.lz4" SHA_MANIFEST_EXT);
+	}
+	free(state);
+	free(csizes);
+	free(expanded);
+	free(packed);
+	free(part);
+}
+
+int main()
+{
+	static FATFS fs;
+	static u8 work[SZ_64K];
+
+	ramdisk_init(DRIVE_SD, DISK_SECTORS);
+	u8 *image = malloc(IMAGE_SIZE);
+	u32 rnd = 0x2545F491;
+	for (u32 i = 0; i < IMAGE_SIZE; i++)
+	{
+		rnd ^= rnd << 13;
+		rnd ^= rnd >> 17;
+		rnd ^= rnd << 5;
+		image[i] = rnd;
+	}
+
+	if (f_mkfs("sd:", FM_FAT32 | FM_SFD, 0, work, sizeof(work)) || f_mount(&fs, "sd:", 1))
+	{
+		printf("dump_fmt: FAIL ram disk\n");
+		return 1;
+	}
+
+	_test_manifest(image);
+	_test_sparse(image);
+	_test_lz4c(image);
+	_lz4_rates(image);
+
+	if (!failed)
+		printf("dump_fmt: OK\n");
+	return failed;
+}
@@ -0,0 +1,175 @@
+/*
+ * Host check of the fast-seek map cache on the real FatFs over a RAM disk.
+ * Mapped files must read the same as unmapped ones, maps are reused until a remount,
+ * and a full pool leaves files on the normal seek path.
+ */
+
+// The BDK heap API is declared with u32 sizes, rename it next to the host one.
+#define malloc heap_malloc
+#define calloc heap_calloc
+#define free heap_free
+#include "../../source/storage/fastseek.c"
+#undef malloc
+#undef calloc
+#undef free
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libs/fatfs/diskio.h>
+
+#include "ramdisk.h"
+
+#define DISK_SECTORS (64 * 1024 * 2) // 64MB.
+#define CLUSTER      512
+
+static int failed;
+
+void *heap_malloc(u32 size) { return malloc(size); }
+void heap_free(void *p) { free(p); }
+
+
+static void _check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		printf("fastseek: FAIL %s\n", what);
+		failed = 1;
+	}
+}
+
+static u8 _byte(u32 file, u32 pos)
+{
+	return (u8)(pos * 31 + file * 7 + (pos >> 9));
+}
+
+// Writes the files a cluster at a time in turn, so each one is split in clusters fragments.
+static void _interleave(const char **paths, u32 files, u32 clusters)
+{
+	FIL fp[4];
+	u8 buf[CLUSTER];
+	UINT bw;
+
+	for (u32 f = 0; f < files; f++)
+		f_open(&fp[f], paths[f], FA_CREATE_ALWAYS | FA_WRITE);
+	for (u32 c = 0; c < clusters; c++)
+	{
+		for (u32 f = 0; f < files; f++)
+		{
+			for (u32 i = 0; i < CLUSTER; i++)
+				buf[i] = _byte(f, c * CLUSTER + i);
+			f_write(&fp[f], buf, CLUSTER, &bw);
+		}
+	}
+	for (u32 f = 0; f < files; f++)
+		f_close(&fp[f]);
+}
+
+// Reads at scattered offsets and checks the bytes. Returns the disk reads it took.
+static u32 _scatter(FIL *fp, u32 file, u32 clusters)
+{
+	u8 buf[64];
+	UINT br;
+	u32 before = ramdisk[DRIVE_SD].reads;
+	bool ok = true;
+
+	for (u32 i = 0; i < 200; i++)
+	{
+		u32 pos = ((i * 7919) % clusters) * CLUSTER + (i % 400);
+		ok &= !f_lseek(fp, pos) && !f_read(fp, buf, sizeof(buf), &br) && br == sizeof(buf);
+		for (u32 j = 0; ok && j < sizeof(buf); j++)
+			ok = buf[j] == _byte(file, pos + j);
+	}
+	_check(ok, "mapped reads match the file");
+	return ramdisk[DRIVE_SD].reads - before;
+}
+
+int main()
+{
+	static FATFS fs;
+	static u8 work[SZ_64K];
+	FIL fp, fp2;
+
+	ramdisk_init(DRIVE_SD, DISK_SECTORS);
+	if (f_mkfs("sd:", FM_FAT32 | FM_SFD, CLUSTER, work, sizeof(work)) || f_mount(&fs, "sd:", 1))
+	{
+		printf("fastseek: FAIL ram disk\n");
+		return 1;
+	}
+
+	// Two files in 2000 fragments each.
+	const char *pair[] = { "sd:/a.bin", "sd:/b.bin" };
+	_interleave(pair, 2, 2000);
+
+	f_open(&fp, "sd:/a.bin", FA_READ);
+	_check(!fastseek_attach(&fp) && !fp.cltbl, "no map before init");
+	u32 slow = _scatter(&fp, 0, 2000);
+	f_close(&fp);
+
+	_check(fastseek_init(), "init");
+	f_open(&fp, "sd:/a.bin", FA_READ);
+	_check(fastseek_attach(&fp) && fp.cltbl, "map a fragmented file");
+	_check(fastseek_used == 2 * 2000 + 2, "one pair per fragment");
+	u32 fast = _scatter(&fp, 0, 2000);
+	_check(fast * 4 < slow, "mapped seeks skip the FAT chain");
+
+	// A second open of the same file gets the same map.
+	f_open(&fp2, "sd:/a.bin", FA_READ);
+	_check(fastseek_attach(&fp2) && fp2.cltbl == fp.cltbl && fastseek_count == 1, "map reused");
+	f_close(&fp2);
+	f_close(&fp);
+
+	// The second map still fits, a third one larger than what is left keeps the normal path.
+	f_open(&fp, "sd:/b.bin", FA_READ);
+	_check(fastseek_attach(&fp) && fastseek_used == 2 * (2 * 2000 + 2), "second map fits");
+	f_close(&fp);
+	const char *big[] = { "sd:/c.bin", "sd:/d.bin" };
+	_interleave(big, 2, 200);
+	f_open(&fp, "sd:/c.bin", FA_READ);
+	_check(!fastseek_attach(&fp) && !fp.cltbl, "pool full");
+	_scatter(&fp, 0, 200);
+	f_close(&fp);
+
+	// A contiguous file takes 4 DWORDs, and the table of files is bounded.
+	fastseek_reset();
+	char path[32];
+	FIL one;
+	UINT bw;
+	for (u32 i = 0; i <= FASTSEEK_MAX_FILES; i++)
+	{
+		sprintf(path, "sd:/small%u.bin", i);
+		f_open(&one, path, FA_CREATE_ALWAYS | FA_WRITE);
+		f_write(&one, work, 3 * CLUSTER, &bw);
+		f_close(&one);
+		f_open(&one, path, FA_READ);
+		bool mapped = fastseek_attach(&one);
+		f_close(&one);
+		_check(mapped == (i < FASTSEEK_MAX_FILES), "file table bound");
+	}
+	_check(fastseek_used == 4 * FASTSEEK_MAX_FILES, "contiguous map size");
+
+	// A file that grew gets a new map, the old one would stop short of its end.
+	fastseek_reset();
+	f_open(&one, "sd:/small0.bin", FA_READ);
+	fastseek_attach(&one);
+	f_close(&one);
+	f_open(&one, "sd:/small0.bin", FA_WRITE | FA_OPEN_APPEND);
+	f_write(&one, work, 2 * CLUSTER, &bw);
+	f_close(&one);
+	f_open(&one, "sd:/small0.bin", FA_READ);
+	_check(fastseek_attach(&one) && fastseek_count == 2, "new map after growth");
+	_check(!f_lseek(&one, 4 * CLUSTER + 10) && f_tell(&one) == 4 * CLUSTER + 10, "seek into the grown part");
+	f_close(&one);
+
+	// A remount drops every map.
+	f_mount(NULL, "sd:", 1);
+	f_mount(&fs, "sd:", 1);
+	f_open(&fp, "sd:/a.bin", FA_READ);
+	_check(fastseek_attach(&fp) && fastseek_count == 1 && fastseek_used == 2 * 2000 + 2, "maps dropped on remount");
+	_scatter(&fp, 0, 2000);
+	f_close(&fp);
+
+	if (!failed)
+		printf("fastseek: OK (%u disk reads unmapped, %u mapped)\n", slow, fast);
+	return failed;
+}
@@ -0,0 +1,239 @@
+/*
+ * Host check of the console glyph blitter and scroll against a per-pixel reference.
+ * Also times the per-pixel loops gfx_putc and gfx_con_scroll had before against the current ones.
+ */
+
+// gfx.c has its own static abs(), so it goes before stdlib.h.
+#include "../../source/gfx/gfx.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FB_W 720
+#define FB_H 1280
+#define TIME_SCREENS 20
+#define TIME_SCROLLS 500
+
+static u32 *ref;
+
+// One pixel at a time, the way gfx_putc drew before the row spans.
+static void ref_putc(u32 x, u32 y, char c)
+{
+	const u8 *cbuf = &_gfx_font[8 * (c - 32)];
+	u32 scale = gfx_con.fntsz == 16 ? 2 : 1;
+	for (u32 row = 0; row < 8 * scale; row++)
+		for (u32 col = 0; col < 8 * scale; col++)
+		{
+			u32 *px = &ref[x + col + (y + row) * FB_W];
+			if (cbuf[row / scale] & (1 << (col / scale)))
+				*px = gfx_con.fgcol;
+			else if (gfx_con.fillbg)
+				*px = gfx_con.bgcol;
+		}
+}
+
+static void ref_scroll(u32 lines_px)
+{
+	memmove(ref, ref + lines_px * FB_W, (FB_H - lines_px) * FB_W * sizeof(u32));
+	for (u32 i = (FB_H - lines_px) * FB_W; i < FB_H * FB_W; i++)
+		ref[i] = gfx_con.bgcol;
+}
+
+// The drawing loops of gfx_putc before the row spans, cursor handling left out.
+static void old_putc(u32 x, u32 y, char c)
+{
+	u8 *cbuf = (u8 *)&_gfx_font[8 * (c - 32)];
+	u32 *fb = gfx_ctxt.fb + x + y * gfx_ctxt.stride;
+
+	if (gfx_con.fntsz == 16)
+	{
+		for (u32 i = 0; i < 16; i+=2)
+		{
+			u8 v = *cbuf;
+			for (u32 k = 0; k < 2; k++)
+			{
+				for (u32 j = 0; j < 8; j++)
+				{
+					if (v & 1)
+					{
+						*fb = gfx_con.fgcol;
+						fb++;
+						*fb = gfx_con.fgcol;
+					}
+					else if (gfx_con.fillbg)
+					{
+						*fb = gfx_con.bgcol;
+						fb++;
+						*fb = gfx_con.bgcol;
+					}
+					else
+						fb++;
+					v >>= 1;
+					fb++;
+				}
+				fb += gfx_ctxt.stride - 16;
+				v = *cbuf;
+			}
+			cbuf++;
+		}
+	}
+	else
+	{
+		for (u32 i = 0; i < 8; i++)
+		{
+			u8 v = *cbuf++;
+			for (u32 j = 0; j < 8; j++)
+			{
+				if (v & 1)
+					*fb = gfx_con.fgcol;
+				else if (gfx_con.fillbg)
+					*fb = gfx_con.bgcol;
+				v >>= 1;
+				fb++;
+			}
+			fb += gfx_ctxt.stride - 8;
+		}
+	}
+}
+
+// gfx_con_scroll before the block fill.
+static void old_scroll(u32 lines_px)
+{
+	u32 *fb = gfx_ctxt.fb;
+	const u32 stride = gfx_ctxt.stride;
+	const u32 move_rows = gfx_ctxt.height - lines_px;
+
+	memmove(fb, fb + lines_px * stride, move_rows * stride * sizeof(u32));
+
+	const u32 fill_col = gfx_con.bgcol;
+	u32 *dst = fb + move_rows * stride;
+	const u32 count = lines_px * stride;
+	for (u32 i = 0; i < count; i++)
+		dst[i] = fill_col;
+}
+
+static u64 _ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Fills whole screens with glyphs, the old way or through gfx_putc. Returns ns per glyph.
+static u32 _time_glyphs(bool old)
+{
+	const u32 sz = gfx_con.fntsz;
+	u32 glyphs = 0;
+	char c = 32;
+	u64 start = _ns();
+	for (u32 screen = 0; screen < TIME_SCREENS; screen++)
+		for (u32 y = 0; y + sz <= FB_H; y += sz)
+			for (u32 x = 0; x + sz <= FB_W; x += sz, glyphs++)
+			{
+				if (old)
+					old_putc(x, y, c);
+				else
+				{
+					gfx_con.x = x;
+					gfx_con.y = y;
+					gfx_putc(c);
+				}
+				c = c == 126 ? 32 : c + 1;
+			}
+	return (_ns() - start) / glyphs;
+}
+
+static u32 _time_scrolls(bool old)
+{
+	u64 start = _ns();
+	for (u32 i = 0; i < TIME_SCROLLS; i++)
+	{
+		if (old)
+			old_scroll(16);
+		else
+			gfx_con_scroll(16);
+	}
+	return (_ns() - start) / TIME_SCROLLS;
+}
+
+// Times both ways in every glyph mode and checks they draw the same.
+static int _timing(u32 *fb)
+{
+	gfx_con.scroll_enabled = false;
+	for (u32 mode = 0; mode < 4; mode++)
+	{
+		gfx_con.fntsz = mode & 1 ? 8 : 16;
+		gfx_con.fillbg = !(mode & 2);
+		memset(fb, 0, FB_W * FB_H * sizeof(u32));
+		u32 old_ns = _time_glyphs(true);
+		memcpy(ref, fb, FB_W * FB_H * sizeof(u32));
+		memset(fb, 0, FB_W * FB_H * sizeof(u32));
+		u32 new_ns = _time_glyphs(false);
+		if (memcmp(fb, ref, FB_W * FB_H * sizeof(u32)))
+		{
+			printf("gfx: timed glyphs differ in mode %u\n", mode);
+			return 1;
+		}
+		printf("gfx: %upx %s glyph, per-pixel %u ns, row span %u ns\n",
+			gfx_con.fntsz, gfx_con.fillbg ? "filled" : "transparent", old_ns, new_ns);
+	}
+
+	u32 old_ns = _time_scrolls(true);
+	u32 new_ns = _time_scrolls(false);
+	printf("gfx: 16px scroll of %ux%u, per-pixel fill %u ns, block copy %u ns\n", FB_W, FB_H, old_ns, new_ns);
+	return 0;
+}
+
+int main()
+{
+	u32 *fb = malloc(FB_W * FB_H * sizeof(u32));
+	ref = malloc(FB_W * FB_H * sizeof(u32));
+	if (!fb || !ref)
+		return 1;
+
+	// Start from noise so transparent glyphs must keep what is under them.
+	srand(1);
+	for (u32 i = 0; i < FB_W * FB_H; i++)
+		fb[i] = ref[i] = rand();
+
+	gfx_init_ctxt(fb, FB_W, FB_H, FB_W);
+	gfx_con_init();
+	gfx_con.scroll_enabled = true;
+
+	// Enough lines in both sizes and fill modes to scroll many times.
+	for (u32 rep = 0; rep < 400; rep++)
+	{
+		gfx_con.fntsz = rep & 1 ? 8 : 16;
+		gfx_con.fillbg = !(rep & 2);
+		gfx_con.fgcol = 0xFF000000 | (rep * 7919);
+		gfx_con.bgcol = 0xFF1B1B1B + rep;
+		if (gfx_con.y > FB_H - gfx_con.fntsz)
+			gfx_con.y = FB_H - gfx_con.fntsz;
+
+		for (char c = 31; c < 127; c++)
+		{
+			u32 x = gfx_con.x, y = gfx_con.y;
+			if (c >= 32)
+				ref_putc(x, y, c);
+			gfx_putc(c);
+			if (c >= 32 && gfx_con.x == 0 && gfx_con.y == y)
+				ref_scroll(gfx_con.fntsz);
+		}
+		if (gfx_con.y + gfx_con.fntsz > FB_H - gfx_con.fntsz)
+			ref_scroll(gfx_con.fntsz);
+		gfx_putc('\n');
+
+		if (memcmp(fb, ref, FB_W * FB_H * sizeof(u32)))
+		{
+			printf("gfx: framebuffer differs after line %u\n", rep);
+			return 1;
+		}
+	}
+
+	if (_timing(fb))
+		return 1;
+
+	printf("gfx: OK\n");
+	return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Host check that scoped heap arenas always return to the same watermark.
+ */
+
+// The BDK heap replaces the libc allocator, rename it next to the host one.
+#define malloc heap_malloc
+#define calloc heap_calloc
+#define free heap_free
+// heap_monitor prints node addresses as u32, which only fits on the 32-bit target.
+#pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
+#include "../../bdk/mem/heap.c"
+#pragma GCC diagnostic warning "-Wpointer-to-int-cast"
+#undef malloc
+#undef calloc
+#undef free
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// heap_monitor only prints node stats on request.
+void gfx_printf(const char *fmt, ...) {}
+
+#define HEAP_SZ  (8 * 1024 * 1024)
+#define ACTIONS  100
+
+static u32 rnd = 0x2545F491;
+
+static u32 _rand()
+{
+	rnd ^= rnd << 13;
+	rnd ^= rnd >> 17;
+	rnd ^= rnd << 5;
+	return rnd;
+}
+
+int main()
+{
+	u8 *mem = aligned_alloc(64, HEAP_SZ);
+	if (!mem)
+		return 1;
+	heap_init(mem);
+
+	// A global allocated on first use, before any action (like the unpacked messages pool).
+	u8 *global = heap_malloc(5000);
+	memset(global, 0x5A, 5000);
+	hnode_t *mark = _heap.last;
+
+	for (u32 i = 0; i < ACTIONS; i++)
+	{
+		arena_t arena;
+		heap_monitor_t mon;
+		u32 used = 0;
+
+		arena_begin(&arena);
+		u32 allocs = 1 + _rand() % 32;
+		for (u32 j = 0; j < allocs; j++)
+		{
+			u32 size = 1 + _rand() % 65536;
+			u8 *buf = j & 1 ? heap_calloc(1, size) : heap_malloc(size);
+			memset(buf, 0xA5, size);
+			used += ALIGN(size, sizeof(hnode_t)) + sizeof(hnode_t);
+			if (j % 3 == 0)
+				heap_free(buf);
+		}
+		arena_end(&arena);
+		heap_monitor(&mon, false);
+
+		if (_heap.last != mark || mark->next)
+		{
+			printf("heap: action %u left the heap above its watermark\n", i);
+			return 1;
+		}
+		if (mon.arena_peak != used)
+		{
+			printf("heap: action %u peak %u, expected %u\n", i, mon.arena_peak, used);
+			return 1;
+		}
+		for (u32 j = 0; j < 5000; j++)
+		{
+			if (global[j] != 0x5A)
+			{
+				printf("heap: action %u overwrote a global allocated before it\n", i);
+				return 1;
+			}
+		}
+	}
+
+	// An action on an empty heap rewinds it to empty.
+	heap_init(mem);
+	arena_t arena;
+	arena_begin(&arena);
+	heap_malloc(100);
+	arena_end(&arena);
+	if (_heap.first || _heap.last || heap_malloc(16) != mem + sizeof(hnode_t))
+	{
+		printf("heap: empty heap did not rewind\n");
+		return 1;
+	}
+
+	printf("heap: OK\n");
+	return 0;
+}
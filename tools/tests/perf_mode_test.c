@@ -0,0 +1,150 @@
+/*
+ * Host check of the performance mode policy and its clock bookkeeping.
+ * Sensors, clocks and the timer are stubs, the policy and nesting are the real code.
+ */
+
+#include "../../source/perf/perf_mode.c"
+
+#include <stdio.h>
+
+bool have_minerva = true;
+bpmp_freq_t bpmp_fid_current = BPMP_CLK_NORMAL;
+
+static u32 soc_temp, now_ms, dram_khz = FREQ_800, trainings, bpmp_sets;
+static int batt_raw_soc, batt_mv, batt_ma;
+static int failed;
+
+u16 tmp451_get_soc_temp(bool integer) { return soc_temp; }
+u32 get_tmr_ms() { return now_ms; }
+void minerva_change_freq(minerva_freq_t freq) { dram_khz = freq; }
+minerva_freq_t minerva_get_freq() { return dram_khz; }
+void minerva_periodic_training() { trainings++; }
+
+void bpmp_clk_rate_set(bpmp_freq_t fid)
+{
+	bpmp_fid_current = fid;
+	bpmp_sets++;
+}
+
+int max17050_get_property(enum MAX17050_reg reg, int *value)
+{
+	if (reg == MAX17050_RepSOC)
+		*value = batt_raw_soc;
+	else if (reg == MAX17050_VCELL)
+		*value = batt_mv;
+	else if (reg == MAX17050_Current)
+		*value = batt_ma;
+	return 0;
+}
+
+static void _check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		printf("perf_mode: FAIL %s\n", what);
+		failed = 1;
+	}
+}
+
+// Sensor readings seen by the next enter. A negative current is a discharging battery.
+static void _state(u32 temp, u32 pct, int mv, int ma)
+{
+	soc_temp = temp;
+	batt_raw_soc = pct << 8; // RepSOC holds the percent in its high byte.
+	batt_mv = mv;
+	batt_ma = ma;
+}
+
+static bool _boosts()
+{
+	perf_mode_enter("test");
+	bool boosted = dram_khz == FREQ_1600 && bpmp_fid_current == BPMP_CLK_DEFAULT_BOOST;
+	perf_mode_exit();
+	_check(dram_khz == FREQ_800 && bpmp_fid_current == BPMP_CLK_NORMAL, "clocks restored after exit");
+	return boosted;
+}
+
+int main()
+{
+	// Policy edges.
+	_check(_perf_mode_allowed(PERF_MODE_TEMP_MAX - 1, 50, 3900, false), "cool and charged");
+	_check(!_perf_mode_allowed(PERF_MODE_TEMP_MAX, 50, 3900, false), "too hot");
+	_check(!_perf_mode_allowed(PERF_MODE_TEMP_MAX, 50, 3900, true), "too hot while charging");
+	_check(_perf_mode_allowed(40, PERF_MODE_BATT_MIN_PCT, PERF_MODE_BATT_MIN_MV, false), "battery at the limits");
+	_check(!_perf_mode_allowed(40, PERF_MODE_BATT_MIN_PCT - 1, 3900, false), "battery too low");
+	_check(!_perf_mode_allowed(40, 50, PERF_MODE_BATT_MIN_MV - 1, false), "voltage too low");
+	_check(_perf_mode_allowed(40, 2, 3300, true), "charging lifts the battery limits");
+
+	// The same decisions through the sensors.
+	_state(45, 50, 3900, -300);
+	_check(_boosts(), "boost when allowed");
+	_state(PERF_MODE_TEMP_MAX + 5, 50, 3900, -300);
+	_check(!_boosts() && dram_khz == FREQ_800, "no boost when hot");
+	_state(45, PERF_MODE_BATT_MIN_PCT - 1, 3900, -300);
+	_check(!_boosts(), "no boost on a low battery");
+	_state(45, PERF_MODE_BATT_MIN_PCT - 1, 3900, 500);
+	_check(_boosts(), "boost on a low battery while charging");
+
+	// Only the outermost pair touches the clocks.
+	_state(45, 50, 3900, -300);
+	bpmp_sets = 0;
+	perf_mode_enter("outer");
+	perf_mode_enter("inner");
+	perf_mode_exit();
+	_check(dram_khz == FREQ_1600 && bpmp_fid_current == BPMP_CLK_DEFAULT_BOOST, "inner exit keeps the boost");
+	perf_mode_exit();
+	_check(dram_khz == FREQ_800 && bpmp_fid_current == BPMP_CLK_NORMAL && bpmp_sets == 2, "outer exit restores once");
+	perf_mode_exit();
+	_check(!_depth, "unbalanced exit ignored");
+
+	// A BPMP clock already at the boost is left alone and kept after exit.
+	bpmp_fid_current = BPMP_CLK_DEFAULT_BOOST;
+	bpmp_sets = 0;
+	perf_mode_enter("boosted");
+	_check(!bpmp_sets, "boosted clock not set again");
+	perf_mode_exit();
+	_check(bpmp_fid_current == BPMP_CLK_DEFAULT_BOOST, "boosted clock kept");
+	bpmp_fid_current = BPMP_CLK_NORMAL;
+
+	// DRAM goes back to the rate it had before, not to a fixed one.
+	dram_khz = FREQ_1066;
+	perf_mode_enter("dram rate");
+	_check(dram_khz == FREQ_1600, "DRAM boosted from another rate");
+	perf_mode_exit();
+	_check(dram_khz == FREQ_1066, "DRAM rate restored");
+	dram_khz = FREQ_800;
+
+	// Without minerva DRAM stays where it is.
+	have_minerva = false;
+	perf_mode_enter("no minerva");
+	_check(dram_khz == FREQ_800 && bpmp_fid_current == BPMP_CLK_DEFAULT_BOOST, "no DRAM change without minerva");
+	perf_mode_exit();
+	have_minerva = true;
+
+	// Ticks retrain at most every PERF_MODE_TICK_MS and drop the boost for good once hot.
+	now_ms = 1000;
+	trainings = 0;
+	perf_mode_enter("ticks");
+	now_ms += PERF_MODE_TICK_MS - 1;
+	perf_mode_tick();
+	_check(!trainings, "no training before the tick period");
+	now_ms += 1;
+	perf_mode_tick();
+	perf_mode_tick();
+	_check(trainings == 1, "one training per tick period");
+	soc_temp = PERF_MODE_TEMP_MAX;
+	now_ms += PERF_MODE_TICK_MS;
+	perf_mode_tick();
+	_check(dram_khz == FREQ_800 && bpmp_fid_current == BPMP_CLK_NORMAL, "throttled when hot");
+	soc_temp = 45;
+	now_ms += PERF_MODE_TICK_MS;
+	perf_mode_tick();
+	_check(trainings == 1 && dram_khz == FREQ_800, "no boost back during the action");
+	bpmp_sets = 0;
+	perf_mode_exit();
+	_check(!bpmp_sets, "exit after a throttle leaves clocks alone");
+
+	if (!failed)
+		printf("perf_mode: OK\n");
+	return failed;
+}
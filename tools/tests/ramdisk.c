@@ -0,0 +1,69 @@
+/*
+ * RAM disks behind the FatFs disk I/O calls for the host checks.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <libs/fatfs/diskio.h>
+
+#include "ramdisk.h"
+
+ramdisk_t ramdisk[FF_VOLUMES];
+
+void *ff_memalloc(UINT size) { return malloc(size); }
+void ff_memfree(void *p) { free(p); }
+
+// FatFs reports mount errors on screen.
+void gfx_printf(const char *fmt, ...) {}
+
+DSTATUS disk_status(BYTE pdrv) { return 0; }
+DSTATUS disk_initialize(BYTE pdrv) { return 0; }
+DWORD get_fattime() { return 0; }
+
+void ramdisk_init(BYTE pdrv, u32 sectors)
+{
+	ramdisk_t *disk = &ramdisk[pdrv];
+	free(disk->data);
+	memset(disk, 0, sizeof(*disk));
+	disk->data = calloc(sectors, 512);
+	disk->sectors = sectors;
+}
+
+void ramdisk_reset_counts(BYTE pdrv)
+{
+	ramdisk_t *disk = &ramdisk[pdrv];
+	disk->reads = disk->writes = 0;
+	disk->read_sectors = disk->write_sectors = 0;
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE *buf, DWORD sector, UINT count)
+{
+	ramdisk_t *disk = &ramdisk[pdrv];
+	if (!disk->data || sector + count > disk->sectors)
+		return RES_PARERR;
+	disk->reads++;
+	disk->read_sectors += count;
+	memcpy(buf, disk->data + (size_t)sector * 512, count * 512);
+	return RES_OK;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buf, DWORD sector, UINT count)
+{
+	ramdisk_t *disk = &ramdisk[pdrv];
+	if (!disk->data || sector + count > disk->sectors)
+		return RES_PARERR;
+	if (++disk->writes == disk->fail_write)
+		return RES_ERROR;
+	disk->write_sectors += count;
+	memcpy(disk->data + (size_t)sector * 512, buf, count * 512);
+	return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buf)
+{
+	if (cmd == GET_SECTOR_COUNT)
+		*(DWORD *)buf = ramdisk[pdrv].sectors;
+	else if (cmd == GET_BLOCK_SIZE)
+		*(DWORD *)buf = 32;
+	return RES_OK;
+}
@@ -0,0 +1,26 @@
+/*
+ * RAM disks behind the FatFs disk I/O calls for the host checks, one per volume.
+ * Calls and sectors are counted per disk, and a write can be made to fail.
+ */
+
+#ifndef _RAMDISK_H_
+#define _RAMDISK_H_
+
+#include <libs/fatfs/ff.h>
+
+typedef struct _ramdisk_t
+{
+	u8 *data;
+	u32 sectors;
+	u32 reads, writes;               // Calls.
+	u32 read_sectors, write_sectors;
+	u32 fail_write;                  // The write call that fails, counted from 1 on writes. 0 never fails.
+} ramdisk_t;
+
+extern ramdisk_t ramdisk[FF_VOLUMES];
+
+// Allocates a zeroed disk for the physical drive, freeing the one it had.
+void ramdisk_init(BYTE pdrv, u32 sectors);
+void ramdisk_reset_counts(BYTE pdrv);
+
+#endif
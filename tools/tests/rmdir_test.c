@@ -0,0 +1,271 @@
+/*
+ * Host check of f_rmdir_contents on the real FatFs over a RAM disk, FAT32 and exFAT.
+ * A deleted tree must give back every cluster, leave no entry behind, and keep
+ * read-only files and what is deeper than the directory stack.
+ * A 50k file FAT32 tree is also deleted both ways and the disk traffic printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libs/fatfs/ff.h>
+#include <libs/fatfs/diskio.h>
+
+#include "ramdisk.h"
+
+#define DISK_SECTORS (128 * 1024 * 2) // 128MB.
+#define STACK_DEPTH  8
+#define BENCH_DIRS   5
+#define BENCH_FILES  10000 // Per folder.
+
+static u8 data[SZ_64K];
+static int failed;
+
+
+
+static void _check(bool cond, const char *fs_name, const char *what)
+{
+	if (!cond)
+	{
+		printf("rmdir: FAIL %s %s\n", fs_name, what);
+		failed = 1;
+	}
+}
+
+// Remounts so the free count comes from a full FAT or bitmap scan.
+static DWORD _free_clusters(FATFS *fs)
+{
+	FATFS *pfs;
+	DWORD fre = 0;
+	f_mount(NULL, "sd:", 1);
+	f_mount(fs, "sd:", 1);
+	f_getfree("sd:", &fre, &pfs);
+	return fre;
+}
+
+static void _file(const char *path, u32 size)
+{
+	FIL fp;
+	UINT bw;
+	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE))
+	{
+		printf("rmdir: cannot create %s\n", path);
+		exit(1);
+	}
+	for (u32 done = 0; done < size; done += bw)
+		f_write(&fp, data, MIN(size - done, sizeof(data)), &bw);
+	f_close(&fp);
+}
+
+// Short and long names mixed so LFN blocks land across sector edges, empty files hold no cluster.
+static void _tree(const char *path, u32 level)
+{
+	char sub[256];
+	f_mkdir(path);
+	for (u32 i = 0; i < 150; i++)
+	{
+		if (i % 3)
+			sprintf(sub, "%s/a_rather_long_file_name_number_%u.bin", path, i);
+		else
+			sprintf(sub, "%s/S%u.BIN", path, i);
+		_file(sub, i % 7 ? 100 + (i % 5) * 9000 : 0);
+	}
+	if (level)
+	{
+		for (u32 i = 0; i < 3; i++)
+		{
+			sprintf(sub, "%s/folder with a long name %u", path, i);
+			_tree(sub, level - 1);
+		}
+	}
+}
+
+static FRESULT _rm(const char *path)
+{
+	static DIR stack[STACK_DEPTH];
+	if (f_opendir(&stack[0], path))
+		return FR_NO_PATH;
+	FRESULT res = f_rmdir_contents(stack, STACK_DEPTH);
+	f_closedir(&stack[0]);
+	return res;
+}
+
+static u32 _entries(const char *path)
+{
+	DIR dir;
+	FILINFO fno;
+	u32 count = 0;
+	if (f_opendir(&dir, path))
+		return 0;
+	while (!f_readdir(&dir, &fno) && fno.fname[0])
+		count++;
+	f_closedir(&dir);
+	return count;
+}
+
+static void _run(BYTE fmt, const char *fs_name)
+{
+	static FATFS fs;
+	static u8 work[SZ_64K];
+
+	ramdisk_init(DRIVE_SD, DISK_SECTORS);
+	if (f_mkfs("sd:", fmt | FM_SFD, 0, work, sizeof(work)) || f_mount(&fs, "sd:", 1))
+	{
+		_check(false, fs_name, "ram disk");
+		return;
+	}
+	_file("sd:/keep.bin", 5000);
+	DWORD base = _free_clusters(&fs);
+
+	// Whole tree, twice so freed clusters and entries get reused.
+	for (u32 pass = 0; pass < 2; pass++)
+	{
+		_tree("sd:/t", 2);
+		_check(_free_clusters(&fs) < base, fs_name, "tree uses clusters");
+		_check(_rm("sd:/t") == FR_OK, fs_name, "delete tree");
+		_check(!_entries("sd:/t"), fs_name, "tree empty");
+		_check(f_unlink("sd:/t") == FR_OK, fs_name, "remove emptied root");
+		_check(_free_clusters(&fs) == base, fs_name, "every cluster freed");
+		_check(_entries("sd:/") == 1 && f_stat("sd:/keep.bin", NULL) == FR_OK, fs_name, "siblings untouched");
+	}
+
+	// A read-only file keeps itself and its parents, everything else goes.
+	_tree("sd:/t", 1);
+	_file("sd:/t/folder with a long name 1/ro.bin", 3000);
+	f_chmod("sd:/t/folder with a long name 1/ro.bin", AM_RDO, AM_RDO);
+	_check(_rm("sd:/t") == FR_DENIED, fs_name, "read-only reported");
+	_check(_entries("sd:/t") == 1 && _entries("sd:/t/folder with a long name 1") == 1, fs_name, "only the read-only path left");
+	f_chmod("sd:/t/folder with a long name 1/ro.bin", 0, AM_RDO);
+	_check(_rm("sd:/t") == FR_OK && f_unlink("sd:/t") == FR_OK, fs_name, "delete after clearing read-only");
+	_check(_free_clusters(&fs) == base, fs_name, "read-only pass frees every cluster");
+
+	// Deeper than the stack is left in place and reported.
+	char path[512] = "sd:/t";
+	f_mkdir(path);
+	for (u32 i = 0; i < STACK_DEPTH + 2; i++)
+	{
+		strcat(path, "/d");
+		f_mkdir(path);
+	}
+	strcat(path, "/deep.bin");
+	_file(path, 2000);
+	_check(_rm("sd:/t") == FR_DENIED, fs_name, "too deep reported");
+	_check(f_stat(path, NULL) == FR_OK, fs_name, "too deep kept");
+
+	f_mount(NULL, "sd:", 1);
+}
+
+// The delete loop f_cp_or_rm_rf ran before f_rmdir_contents: a path per entry, each one unlinked.
+static void _unlink_walk(const char *root)
+{
+	static DIR dir[STACK_DEPTH];
+	static char stack[STACK_DEPTH][256];
+	FILINFO fno;
+	char path[512];
+	int sp = 0;
+
+	if (f_opendir(&dir[0], root))
+		return;
+	strcpy(stack[0], root);
+	while (sp >= 0)
+	{
+		if (f_readdir(&dir[sp], &fno) || !fno.fname[0])
+		{
+			f_closedir(&dir[sp]);
+			if (sp > 0)
+				f_unlink(stack[sp]);
+			sp--;
+			continue;
+		}
+		sprintf(path, "%s/%s", stack[sp], fno.fname);
+		if (fno.fattrib & AM_DIR)
+		{
+			if (sp + 1 < STACK_DEPTH && !f_opendir(&dir[sp + 1], path))
+				strcpy(stack[++sp], path);
+			continue;
+		}
+		f_unlink(path);
+	}
+}
+
+static u32 _ms_since(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+// Deletes the same tree of small files both ways, starting from one disk image each time.
+static void _bench()
+{
+	static FATFS fs;
+	static u8 work[SZ_64K];
+	ramdisk_t *sd = &ramdisk[DRIVE_SD];
+	char path[64];
+
+	ramdisk_init(DRIVE_SD, DISK_SECTORS);
+	if (f_mkfs("sd:", FM_FAT32 | FM_SFD, 0, work, sizeof(work)) || f_mount(&fs, "sd:", 1))
+	{
+		_check(false, "bench", "ram disk");
+		return;
+	}
+	DWORD base = _free_clusters(&fs);
+	f_mkdir("sd:/t");
+	for (u32 d = 0; d < BENCH_DIRS; d++)
+	{
+		sprintf(path, "sd:/t/%08X", d);
+		f_mkdir(path);
+		for (u32 i = 0; i < BENCH_FILES; i++)
+		{
+			// Named like save files and NCAs, so every entry takes LFN slots.
+			sprintf(path, "sd:/t/%08X/%016X", d, i * 0x9E3779B1);
+			_file(path, 100);
+		}
+	}
+	f_mount(NULL, "sd:", 1);
+	u8 *image = malloc((size_t)DISK_SECTORS * 512);
+	memcpy(image, sd->data, (size_t)DISK_SECTORS * 512);
+
+	u32 reads[2], writes[2], ms[2];
+	for (u32 way = 0; way < 2; way++)
+	{
+		struct timespec start;
+		memcpy(sd->data, image, (size_t)DISK_SECTORS * 512);
+		f_mount(&fs, "sd:", 1);
+		ramdisk_reset_counts(DRIVE_SD);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (way)
+			_check(_rm("sd:/t") == FR_OK, "bench", "f_rmdir_contents");
+		else
+			_unlink_walk("sd:/t");
+		f_unlink("sd:/t");
+		f_mount(NULL, "sd:", 1);
+		ms[way] = _ms_since(&start);
+		reads[way] = sd->read_sectors;
+		writes[way] = sd->write_sectors;
+		_check(_free_clusters(&fs) == base && !_entries("sd:/"), "bench", way ? "f_rmdir_contents frees all" : "unlink frees all");
+		f_mount(NULL, "sd:", 1);
+	}
+	free(image);
+
+	printf("rmdir: %u files on FAT32, per-path f_unlink %u sector reads, %u writes, %u ms\n",
+		BENCH_DIRS * BENCH_FILES, reads[0], writes[0], ms[0]);
+	printf("rmdir: %u files on FAT32, f_rmdir_contents %u sector reads, %u writes, %u ms\n",
+		BENCH_DIRS * BENCH_FILES, reads[1], writes[1], ms[1]);
+	_check(reads[1] < reads[0] && writes[1] < writes[0], "bench", "f_rmdir_contents moves less");
+}
+
+int main()
+{
+	for (u32 i = 0; i < sizeof(data); i++)
+		data[i] = i * 7;
+
+	_run(FM_FAT32, "fat32");
+	_run(FM_EXFAT, "exfat");
+	_bench();
+
+	if (!failed)
+		printf("rmdir: OK\n");
+	return failed;
+}
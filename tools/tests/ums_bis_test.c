@@ -0,0 +1,182 @@
+/*
+ * Host check of the USB mass storage BIS layer against a flat model of the partition.
+ * The partition is a temporary file. Random host reads and writes must match the model,
+ * and every write that reaches the partition must cover whole XTS clusters.
+ */
+
+// The BDK heap API is declared with u32 sizes, rename it next to the host one.
+#define malloc heap_malloc
+#define calloc heap_calloc
+#define free heap_free
+#include "../../source/storage/ums_bis.c"
+#undef malloc
+#undef calloc
+#undef free
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PART_SECTORS (UMS_BIS_CLUSTER_SECTORS * 200 + 11) // Short last cluster.
+#define PART_SIZE    (PART_SECTORS * UMS_BIS_SECTOR_SIZE)
+#define OPS          20000
+#define MAX_XFER     (UMS_BIS_CLUSTER_SECTORS * 20)
+
+void *heap_malloc(u32 size) { return malloc(size); }
+void heap_free(void *p) { free(p); }
+
+static FILE *part;
+static u8 *model;
+static u32 reads, writes, bad_writes;
+
+static int _part_read(u32 sector, u32 count, void *buf)
+{
+	reads++;
+	if (sector + count > PART_SECTORS)
+		return 1;
+	fseek(part, (long)sector * UMS_BIS_SECTOR_SIZE, SEEK_SET);
+	return fread(buf, UMS_BIS_SECTOR_SIZE, count, part) != count;
+}
+
+static int _part_write(u32 sector, u32 count, void *buf)
+{
+	writes++;
+	// Partial clusters would need a read-modify-write under XTS.
+	if (sector % UMS_BIS_CLUSTER_SECTORS || (count % UMS_BIS_CLUSTER_SECTORS && sector + count != PART_SECTORS))
+		bad_writes++;
+	if (sector + count > PART_SECTORS)
+		return 1;
+	fseek(part, (long)sector * UMS_BIS_SECTOR_SIZE, SEEK_SET);
+	return fwrite(buf, UMS_BIS_SECTOR_SIZE, count, part) != count;
+}
+
+static u32 rnd = 0x2545F491;
+
+static u32 _rand()
+{
+	rnd ^= rnd << 13;
+	rnd ^= rnd >> 17;
+	rnd ^= rnd << 5;
+	return rnd;
+}
+
+// Mostly small or sequential transfers like a host file system, with whole-cluster runs mixed in.
+static void _pick(u32 *sector, u32 *count, u32 *next)
+{
+	u32 kind = _rand() % 4;
+	if (kind == 0 && *next < PART_SECTORS)
+		*sector = *next;
+	else if (kind == 1)
+		*sector = ALIGN_DOWN(_rand() % PART_SECTORS, UMS_BIS_CLUSTER_SECTORS);
+	else
+		*sector = _rand() % PART_SECTORS;
+
+	*count = kind == 1 ? UMS_BIS_CLUSTER_SECTORS * (1 + _rand() % 4) : 1 + _rand() % (_rand() % 4 ? 8 : MAX_XFER);
+	*count = MIN(*count, PART_SECTORS - *sector);
+	*next = *sector + *count;
+}
+
+static int failed;
+
+static void _xfer(ums_bis_t *lun, bool write, u32 sector, u32 count, u8 *buf)
+{
+	u8 *at = model + (size_t)sector * UMS_BIS_SECTOR_SIZE;
+
+	if (write)
+	{
+		for (u32 i = 0; i < count * UMS_BIS_SECTOR_SIZE; i++)
+			buf[i] = _rand();
+		memcpy(at, buf, count * UMS_BIS_SECTOR_SIZE);
+		if (ums_bis_write(lun, sector, count, buf))
+		{
+			printf("ums_bis: FAIL write %u+%u\n", sector, count);
+			failed = 1;
+		}
+	}
+	else if (ums_bis_read(lun, sector, count, buf) || memcmp(buf, at, count * UMS_BIS_SECTOR_SIZE))
+	{
+		printf("ums_bis: FAIL read %u+%u\n", sector, count);
+		failed = 1;
+	}
+}
+
+// Orders a random mix rarely hits: each one once against the cached state it could leave stale.
+static void _directed(ums_bis_t *lun, u8 *buf)
+{
+	// Whole clusters written inside the read-ahead window a sequential read filled.
+	_xfer(lun, false, 0, UMS_BIS_CLUSTER_SECTORS, buf);
+	_xfer(lun, false, UMS_BIS_CLUSTER_SECTORS, 8, buf);
+	_xfer(lun, true, UMS_BIS_CLUSTER_SECTORS * 3, UMS_BIS_CLUSTER_SECTORS, buf);
+	_xfer(lun, false, UMS_BIS_CLUSTER_SECTORS * 3, 8, buf);
+
+	// A gathered cluster overwritten whole before it was flushed.
+	_xfer(lun, true, UMS_BIS_CLUSTER_SECTORS * 40 + 3, 2, buf);
+	_xfer(lun, true, UMS_BIS_CLUSTER_SECTORS * 40, UMS_BIS_CLUSTER_SECTORS * 2, buf);
+	_xfer(lun, true, UMS_BIS_CLUSTER_SECTORS * 60 + 1, 1, buf);
+	_xfer(lun, false, UMS_BIS_CLUSTER_SECTORS * 40, UMS_BIS_CLUSTER_SECTORS, buf);
+
+	// A gathered cluster inside a sequential window, then read back.
+	_xfer(lun, true, UMS_BIS_CLUSTER_SECTORS * 81 + 5, 3, buf);
+	_xfer(lun, false, UMS_BIS_CLUSTER_SECTORS * 80, 8, buf);
+	_xfer(lun, false, UMS_BIS_CLUSTER_SECTORS * 80 + 8, 8, buf);
+	_xfer(lun, false, UMS_BIS_CLUSTER_SECTORS * 81, UMS_BIS_CLUSTER_SECTORS, buf);
+
+	// The short last cluster, gathered a sector at a time, goes down as soon as it is complete.
+	u32 before = writes;
+	for (u32 s = ALIGN_DOWN(PART_SECTORS, UMS_BIS_CLUSTER_SECTORS); s < PART_SECTORS; s++)
+		_xfer(lun, true, s, 1, buf);
+	if (writes != before + 1)
+	{
+		printf("ums_bis: FAIL short last cluster not written once complete\n");
+		failed = 1;
+	}
+	_xfer(lun, false, PART_SECTORS - 20, 20, buf);
+}
+
+int main()
+{
+	ums_bis_t lun;
+	u8 *buf = malloc(MAX_XFER * UMS_BIS_SECTOR_SIZE);
+	u32 next = 0;
+
+	part = tmpfile();
+	model = malloc(PART_SIZE);
+	for (u32 i = 0; i < PART_SIZE; i++)
+		model[i] = _rand();
+
+	if (!part || fwrite(model, 1, PART_SIZE, part) != PART_SIZE || ums_bis_init(&lun, PART_SECTORS, _part_read, _part_write))
+	{
+		printf("ums_bis: FAIL init\n");
+		return 1;
+	}
+
+	_directed(&lun, buf);
+
+	for (u32 op = 0; op < OPS && !failed; op++)
+	{
+		u32 sector, count;
+		_pick(&sector, &count, &next);
+		_xfer(&lun, !(_rand() % 3), sector, count, buf);
+	}
+
+	// Eject writes back the last gathered cluster.
+	if (ums_bis_end(&lun))
+		failed = 1;
+
+	u8 *disk = malloc(PART_SIZE);
+	fseek(part, 0, SEEK_SET);
+	if (fread(disk, 1, PART_SIZE, part) != PART_SIZE || memcmp(disk, model, PART_SIZE))
+	{
+		printf("ums_bis: FAIL partition differs after eject\n");
+		failed = 1;
+	}
+	if (bad_writes)
+	{
+		printf("ums_bis: FAIL %u writes not on whole clusters\n", bad_writes);
+		failed = 1;
+	}
+
+	if (!failed)
+		printf("ums_bis: OK (%u ops, %u reads, %u writes)\n", OPS, reads, writes);
+
+	return failed;
+}